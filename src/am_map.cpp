@@ -1831,6 +1831,7 @@ void DAutomap::drawGrid (int color)
 	double minx, miny;
 	auto bmaporgx = Level->blockmap.bmaporgx;
 	auto bmaporgy = Level->blockmap.bmaporgy;
+	const double blockunits = Level->blockmap.blockunits;
 
 	// [RH] Calculate a minimum for how long the grid lines should be so that
 	// they cover the screen at any rotation.
@@ -1843,12 +1844,12 @@ void DAutomap::drawGrid (int color)
 
 	// Figure out start of vertical gridlines
 	start = minx - extx;
-	start = ceil((start - bmaporgx) / FBlockmap::MAPBLOCKUNITS) * FBlockmap::MAPBLOCKUNITS + bmaporgx;
+	start = ceil((start - bmaporgx) / blockunits) * blockunits + bmaporgx;
 
 	end = minx + minlen - extx;
 
 	// draw vertical gridlines
-	for (x = start; x < end; x += FBlockmap::MAPBLOCKUNITS)
+	for (x = start; x < end; x += blockunits)
 	{
 		ml.a.x = x;
 		ml.b.x = x;
@@ -1864,11 +1865,11 @@ void DAutomap::drawGrid (int color)
 
 	// Figure out start of horizontal gridlines
 	start = miny - exty;
-	start = ceil((start - bmaporgy) / FBlockmap::MAPBLOCKUNITS) * FBlockmap::MAPBLOCKUNITS + bmaporgy;
+	start = ceil((start - bmaporgy) / blockunits) * blockunits + bmaporgy;
 	end = miny + minlen - exty;
 
 	// draw horizontal gridlines
-	for (y=start; y<end; y+=FBlockmap::MAPBLOCKUNITS)
+	for (y=start; y<end; y+=blockunits)
 	{
 		ml.a.x = minx - extx;
 		ml.b.x = ml.a.x + minlen;
@@ -431,6 +431,49 @@ FRandom *FRandom::StaticFindRNG (const char *name, bool client)
 	return probe;
 }
 
+//==========================================================================
+//
+// FRandom :: StaticFindRNGByCRC
+//
+// Looks up an existing RNG by the CRC of its name, which is what
+// identifies it in savegames and the script code cache. Nameless RNGs
+// cannot be found this way, except for M_Random.
+//
+//==========================================================================
+
+FRandom *FRandom::StaticFindRNGByCRC (uint32_t crc, bool client)
+{
+	if (crc == 0) return client ? &M_Random : nullptr;
+
+	for (FRandom *probe = (client ? CRNGList : RNGList); probe != NULL && probe->NameCRC <= crc; probe = probe->Next)
+	{
+		if (probe->NameCRC == crc) return probe;
+	}
+	return nullptr;
+}
+
+//==========================================================================
+//
+// FRandom :: StaticIsRNG
+//
+// Checks if the pointer is an RNG that StaticFindRNGByCRC can find again.
+//
+//==========================================================================
+
+bool FRandom::StaticIsRNG (const FRandom *rng)
+{
+	if (rng == &M_Random) return true;
+	for (FRandom *probe = RNGList; probe != NULL; probe = probe->Next)
+	{
+		if (probe == rng) return probe->NameCRC != 0;
+	}
+	for (FRandom *probe = CRNGList; probe != NULL; probe = probe->Next)
+	{
+		if (probe == rng) return probe->NameCRC != 0;
+	}
+	return false;
+}
+
 void FRandom::SaveRNGState(TArray<FRandom>& backups)
 {
 	for (auto cur = RNGList; cur != nullptr; cur = cur->Next)
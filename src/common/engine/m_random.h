@@ -171,6 +171,10 @@ public:
 	static void StaticReadRNGState (FSerializer &arc);
 	static void StaticWriteRNGState (FSerializer &file);
 	static FRandom *StaticFindRNG(const char *name, bool client);
+	static FRandom *StaticFindRNGByCRC(uint32_t crc, bool client);
+	static bool StaticIsRNG(const FRandom *rng);
+	uint32_t GetNameCRC() const { return NameCRC; }
+	bool IsClient() const { return bClient; }
 	static void SaveRNGState(TArray<FRandom>& backups);
 	static void RestoreRNGState(TArray<FRandom>& backups);
 
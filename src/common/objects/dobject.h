@@ -35,6 +35,7 @@
 #define __DOBJECT_H__
 
 #include <stdlib.h>
+#include <string.h>
 #include <type_traits>
 #include "m_alloc.h"
 #include "vectors.h"
@@ -178,6 +179,7 @@ public: \
 #define _X_VMEXPORT_false(cls)		nullptr
 
 #include "dobjgc.h"
+#include "dobjpool.h"
 
 class DObject
 {
@@ -266,18 +268,18 @@ private:
 
 	void *operator new(size_t len, nonew&)
 	{
-		return M_Calloc(len, 1);
+		return memset(ObjectPool::Alloc(len), 0, len);
 	}
 public:
 
 	void operator delete (void *mem, nonew&)
 	{
-		M_Free(mem);
+		ObjectPool::Free(mem);
 	}
 
 	void operator delete (void *mem)
 	{
-		M_Free(mem);
+		ObjectPool::Free(mem);
 	}
 
 	// GC fiddling
@@ -344,7 +346,7 @@ protected:
 
 	void operator delete (void *mem, EInPlace *)
 	{
-		M_Free (mem);
+		ObjectPool::Free (mem);
 	}
 
 	template<typename T, typename... Args>
@@ -59,10 +59,12 @@
 #include "dobject.h"
 
 #include "c_dispatch.h"
+#include "c_cvars.h"
 #include "menu.h"
 #include "stats.h"
 #include "printf.h"
 #include "cmdlib.h"
+#include "i_time.h"
 
 // MACROS ------------------------------------------------------------------
 
@@ -107,6 +109,10 @@
 // Cost of destroying an object
 #define GCDESTROYCOST		15
 
+// Once the time budget has left this many regular steps worth of work
+// undone, a step ignores the budget to catch up.
+#define GCMAXDEBTSTEPS		4
+
 // TYPES -------------------------------------------------------------------
 
 class FAveragizer
@@ -135,6 +141,28 @@ struct FStepStats
 	void Reset();
 };
 
+// Distribution of the time spent in each collector phase per call to
+// GC::Step, plus whole steps.
+struct FStepHistogram
+{
+	enum
+	{
+		Row_Step = GC::GCS_Done,	// GCS_Done itself takes no time worth measuring
+		NumRows,
+
+		FirstBucketUS = 16,			// Buckets are < 16us, < 32us, ..., >= 8192us
+		NumBuckets = 11
+	};
+
+	uint32_t Buckets[NumRows][NumBuckets];
+	uint64_t MaxNS[NumRows];
+	uint64_t TotalNS[NumRows];
+
+	void Add(int row, uint64_t ns);
+	void Reset();
+	void Dump();
+};
+
 // EXTERNAL FUNCTION PROTOTYPES --------------------------------------------
 
 // PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
@@ -165,6 +193,12 @@ int Pause = DEFAULT_GCPAUSE;
 int StepMul = DEFAULT_GCMUL;
 FStepStats StepStats;
 FStepStats PrevStepStats;
+FStepHistogram StepHistogram;
+uint64_t StepBudget;		// Maximum time a single step may take in ns, 0 for no limit
+int BudgetHits;				// Number of steps that were cut short by the budget
+int BudgetOverruns;			// Number of steps that took longer than the budget anyway
+int BudgetCatchUps;			// Number of steps that ignored the budget to pay off the debt
+size_t StepDebt;			// Work the budgeted steps of the current cycle left undone
 bool FinalGC;
 bool HadToDestroy;
 
@@ -172,6 +206,7 @@ bool HadToDestroy;
 
 static FAveragizer AllocHistory;// Tracks allocation rate over time
 static cycle_t GCTime;			// Track time spent in GC
+static double Throughput;		// Bytes covered per ns in recent steps, to size budgeted steps
 
 // CODE --------------------------------------------------------------------
 
@@ -518,13 +553,31 @@ void Step()
 	StepStats.Count[enter_state]++;
 	StepStats.Clock[enter_state].Clock();
 
-	size_t did = 0;
-	size_t lim = CalcStepSize();
+	// Whatever earlier steps were not allowed to do is still owed, or the
+	// collector would fall behind the allocations for good.
+	size_t did = 0, total = 0;
+	const size_t size = CalcStepSize();
+	const size_t planned = size + StepDebt;
+	size_t lim = planned;
+	const bool budgeted = StepBudget != 0 && StepDebt <= size * GCMAXDEBTSTEPS;
+	if (budgeted && Throughput > 0)
+	{
+		// Don't plan for more than can be done in the time budget.
+		lim = std::min(lim, std::max<size_t>(GCMINSTEPSIZE, size_t(Throughput * StepBudget)));
+	}
+	else if (StepBudget != 0)
+	{
+		BudgetCatchUps++;
+	}
+	const uint64_t start = I_nsTime();
+	const uint64_t deadline = budgeted ? start + StepBudget : 0;
+	uint64_t phasestart = start;
 
 	do
 	{
 		size_t done = SingleStep();
 		did += done;
+		total += done;
 		if (done < lim)
 		{
 			lim -= done;
@@ -533,11 +586,15 @@ void Step()
 		{
 			lim = 0;
 		}
+		uint64_t now = 0;
 		if (State != enter_state)
 		{
 			// Finish stats on old state
 			StepStats.Clock[enter_state].Unclock();
 			StepStats.BytesCovered[enter_state] += did;
+			now = I_nsTime();
+			if (enter_state != GCS_Done) StepHistogram.Add(enter_state, now - phasestart);
+			phasestart = now;
 
 			// Start stats on new state
 			did = 0;
@@ -545,11 +602,34 @@ void Step()
 			StepStats.Clock[enter_state].Clock();
 			StepStats.Count[enter_state]++;
 		}
+		// A single step can still overrun the budget, but nothing more will follow it.
+		if (deadline != 0 && lim && State != GCS_Pause)
+		{
+			if (now == 0) now = I_nsTime();
+			if (now >= deadline)
+			{
+				BudgetHits++;
+				break;
+			}
+		}
 	} while (lim && State != GCS_Pause);
 
 	StepStats.Clock[enter_state].Unclock();
 	StepStats.BytesCovered[enter_state] += did;
 	GCTime.Unclock();
+
+	// A finished cycle owes nothing.
+	StepDebt = State != GCS_Pause && total < planned ? planned - total : 0;
+
+	const uint64_t end = I_nsTime();
+	if (enter_state != GCS_Done && enter_state != GCS_Pause) StepHistogram.Add(enter_state, end - phasestart);
+	StepHistogram.Add(FStepHistogram::Row_Step, end - start);
+	if (StepBudget != 0 && end - start > StepBudget) BudgetOverruns++;
+	if (end > start && total > 0)
+	{
+		double rate = double(total) / double(end - start);
+		Throughput = Throughput > 0 ? Throughput * 0.9 + rate * 0.1 : rate;
+	}
 }
 
 //==========================================================================
@@ -710,6 +790,24 @@ void DelSoftRoot(DObject *obj)
 
 }
 
+//==========================================================================
+//
+// CVAR gc_stepbudget
+//
+// Maximum time in microseconds a single collection step may take. Steps
+// are sized by the measured throughput to fit into it and cut short if
+// they still take longer. The work left undone is carried over, and once
+// it adds up to GCMAXDEBTSTEPS steps, one step runs unbudgeted to catch
+// up. 0 means no limit.
+//
+//==========================================================================
+
+CUSTOM_CVAR(Int, gc_stepbudget, 0, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+{
+	if (self < 0) self = 0;
+	else GC::StepBudget = uint64_t(self) * 1000;
+}
+
 //==========================================================================
 //
 // FAveragizer - Constructor
@@ -787,9 +885,84 @@ ADD_STAT(gc)
 		(GC::AllocBytes + 1023) >> 10,
 		(GC::Estimate + 1023) >> 10,
 		(GC::Threshold + 1023) >> 10);
+	if (GC::StepBudget != 0)
+	{
+		out.AppendFormat("\nBudget:%4dus  Cut short:%5d  Over budget:%5d  Caught up:%5d  Debt:%6zuK",
+			int(GC::StepBudget / 1000), GC::BudgetHits, GC::BudgetOverruns, GC::BudgetCatchUps, (GC::StepDebt + 1023) >> 10);
+	}
 	return out;
 }
 
+//==========================================================================
+//
+// FStepHistogram :: Add
+//
+//==========================================================================
+
+void FStepHistogram::Add(int row, uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	int bucket = 0;
+	while (bucket < NumBuckets - 1 && us >= (uint64_t(FirstBucketUS) << bucket))
+	{
+		bucket++;
+	}
+	Buckets[row][bucket]++;
+	TotalNS[row] += ns;
+	if (ns > MaxNS[row]) MaxNS[row] = ns;
+}
+
+//==========================================================================
+//
+// FStepHistogram :: Reset
+//
+//==========================================================================
+
+void FStepHistogram::Reset()
+{
+	memset(Buckets, 0, sizeof(Buckets));
+	memset(MaxNS, 0, sizeof(MaxNS));
+	memset(TotalNS, 0, sizeof(TotalNS));
+}
+
+//==========================================================================
+//
+// FStepHistogram :: Dump
+//
+//==========================================================================
+
+void FStepHistogram::Dump()
+{
+	static const char *RowNames[NumRows] = { "Roots", "Propagate", "Sweep", "Destroy", "Step" };
+
+	FString line;
+	line.Format("%-10s", "us");
+	for (int b = 0; b < NumBuckets - 1; b++)
+	{
+		line.AppendFormat("%7s%d", "<", FirstBucketUS << b);
+	}
+	line.AppendFormat("%7s%d%10s%10s\n", ">=", FirstBucketUS << (NumBuckets - 2), "avg", "max");
+	Printf("%s", line.GetChars());
+
+	for (int r = 0; r < NumRows; r++)
+	{
+		uint32_t count = 0;
+		line.Format("%-10s", RowNames[r]);
+		for (int b = 0; b < NumBuckets; b++)
+		{
+			line.AppendFormat("%8u", Buckets[r][b]);
+			count += Buckets[r][b];
+		}
+		line.AppendFormat("%10.1f%10.1f\n", count > 0 ? TotalNS[r] / 1000. / count : 0., MaxNS[r] / 1000.);
+		Printf("%s", line.GetChars());
+	}
+	if (GC::StepBudget != 0)
+	{
+		Printf("Step budget %dus, %d steps cut short, %d steps over budget, %d steps to catch up\n",
+			int(GC::StepBudget / 1000), GC::BudgetHits, GC::BudgetOverruns, GC::BudgetCatchUps);
+	}
+}
+
 //==========================================================================
 //
 // FStepStats :: Reset
@@ -842,7 +1015,7 @@ CCMD(gc)
 {
 	if (argv.argc() == 1)
 	{
-		Printf ("Usage: gc stop|now|full|count|pause [size]|stepmul [size]\n");
+		Printf ("Usage: gc stop|now|full|count|histogram [reset]|pause [size]|stepmul [size]\n");
 		return;
 	}
 	if (stricmp(argv[1], "stop") == 0)
@@ -857,6 +1030,18 @@ CCMD(gc)
 	{
 		GC::FullGC();
 	}
+	else if (stricmp(argv[1], "histogram") == 0)
+	{
+		if (argv.argc() > 2 && stricmp(argv[2], "reset") == 0)
+		{
+			GC::StepHistogram.Reset();
+			GC::BudgetHits = GC::BudgetOverruns = GC::BudgetCatchUps = 0;
+		}
+		else
+		{
+			GC::StepHistogram.Dump();
+		}
+	}
 	else if (stricmp(argv[1], "count") == 0)
 	{
 		int cnt = 0;
@@ -0,0 +1,282 @@
+/*
+** dobjpool.cpp
+**
+** Size class based slab allocator for DObjects
+**
+**---------------------------------------------------------------------------
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/
+**
+**---------------------------------------------------------------------------
+**
+** Every chunk is CHUNKSIZE bytes large and aligned to CHUNKSIZE, so the
+** chunk an object lives in can be found by masking its address. A chunk
+** only ever holds objects of a single size class and keeps its own free
+** list, which allows it to be given back to the system once it is empty.
+** Objects too large for the size classes get an aligned block of their
+** own with the same header in front, so they can be told apart the same
+** way.
+**
+** The pool is shared by all threads and protected by a single lock, just
+** like the system allocator it replaces.
+**
+** The pool reports each handed out slot to the GC the same way M_Malloc
+** does, so the collector's pacing is not affected by the chunk overhead.
+**
+*/
+
+#include <stdlib.h>
+#include <mutex>
+#include "dobject.h"
+#include "dobjpool.h"
+#include "engineerrors.h"
+#include "stats.h"
+
+namespace ObjectPool
+{
+
+enum
+{
+	CHUNKSHIFT = 16,
+	CHUNKSIZE = 1 << CHUNKSHIFT,
+	GRANULARITY = 32,
+	MAXPOOLED = 4096,
+	NUMCLASSES = MAXPOOLED / GRANULARITY,
+	LARGECLASS = NUMCLASSES		// a single object that is too large for the pool
+};
+
+struct FChunk
+{
+	FChunk *Prev, *Next;	// Links in the size class's list of chunks with free slots
+	void *FreeList;			// Slots that were used and given back
+	uint32_t SizeClass;
+	uint32_t SlotSize;		// for LARGECLASS the size of the object
+	uint32_t Bump;			// Offset of the first slot that was never used
+	uint32_t Used;
+};
+
+static constexpr uint32_t HEADERSIZE = (sizeof(FChunk) + 63) & ~63u;
+
+struct FSizeClass
+{
+	FChunk *Partial;		// Chunks which have at least one free slot
+	unsigned NumChunks;
+};
+
+static FSizeClass Classes[NUMCLASSES];
+static size_t Reserved, Used, NumObjects;
+static std::mutex PoolMutex;
+
+//==========================================================================
+//
+// Chunk management
+//
+//==========================================================================
+
+static inline bool IsFull(const FChunk *chunk)
+{
+	return chunk->FreeList == nullptr && chunk->Bump + chunk->SlotSize > CHUNKSIZE;
+}
+
+static void Link(FSizeClass &sc, FChunk *chunk)
+{
+	chunk->Prev = nullptr;
+	chunk->Next = sc.Partial;
+	if (sc.Partial != nullptr) sc.Partial->Prev = chunk;
+	sc.Partial = chunk;
+}
+
+static void Unlink(FSizeClass &sc, FChunk *chunk)
+{
+	if (chunk->Prev != nullptr) chunk->Prev->Next = chunk->Next;
+	else sc.Partial = chunk->Next;
+	if (chunk->Next != nullptr) chunk->Next->Prev = chunk->Prev;
+	chunk->Prev = chunk->Next = nullptr;
+}
+
+static FChunk *AllocChunk(size_t size)
+{
+	void *mem;
+#if defined (_MSC_VER) || defined (__MINGW32__)
+	mem = _aligned_malloc(size, CHUNKSIZE);
+#else
+	if (posix_memalign(&mem, CHUNKSIZE, size) != 0) mem = nullptr;
+#endif
+	if (mem == nullptr)
+	{
+		I_FatalError("Could not allocate object pool chunk");
+	}
+	return (FChunk *)mem;
+}
+
+static void FreeChunk(FChunk *chunk)
+{
+#if defined (_MSC_VER) || defined (__MINGW32__)
+	_aligned_free(chunk);
+#else
+	free(chunk);
+#endif
+}
+
+static inline FChunk *ChunkOf(void *mem)
+{
+	return (FChunk *)(uintptr_t(mem) & ~uintptr_t(CHUNKSIZE - 1));
+}
+
+static FChunk *NewChunk(unsigned cls)
+{
+	FChunk *chunk = AllocChunk(CHUNKSIZE);
+	chunk->FreeList = nullptr;
+	chunk->SizeClass = cls;
+	chunk->SlotSize = (cls + 1) * GRANULARITY;
+	chunk->Bump = HEADERSIZE;
+	chunk->Used = 0;
+	Link(Classes[cls], chunk);
+	Classes[cls].NumChunks++;
+	Reserved += CHUNKSIZE;
+	return chunk;
+}
+
+static void ReleaseChunk(FChunk *chunk)
+{
+	auto &sc = Classes[chunk->SizeClass];
+	Unlink(sc, chunk);
+	sc.NumChunks--;
+	Reserved -= CHUNKSIZE;
+	FreeChunk(chunk);
+}
+
+//==========================================================================
+//
+// ObjectPool :: Alloc
+//
+//==========================================================================
+
+void *Alloc(size_t size)
+{
+	if (size == 0 || size > MAXPOOLED)
+	{
+		FChunk *chunk = AllocChunk(HEADERSIZE + size);
+		chunk->Prev = chunk->Next = nullptr;
+		chunk->FreeList = nullptr;
+		chunk->SizeClass = LARGECLASS;
+		chunk->SlotSize = uint32_t(size);
+		chunk->Bump = chunk->Used = 0;
+		GC::ReportAlloc(size);
+		return (uint8_t *)chunk + HEADERSIZE;
+	}
+
+	std::lock_guard<std::mutex> lock(PoolMutex);
+	unsigned cls = unsigned((size - 1) / GRANULARITY);
+	FChunk *chunk = Classes[cls].Partial;
+	if (chunk == nullptr)
+	{
+		chunk = NewChunk(cls);
+	}
+
+	void *mem;
+	if (chunk->FreeList != nullptr)
+	{
+		mem = chunk->FreeList;
+		chunk->FreeList = *(void **)mem;
+	}
+	else
+	{
+		mem = (uint8_t *)chunk + chunk->Bump;
+		chunk->Bump += chunk->SlotSize;
+	}
+	chunk->Used++;
+	if (IsFull(chunk))
+	{
+		Unlink(Classes[cls], chunk);
+	}
+	Used += chunk->SlotSize;
+	NumObjects++;
+	GC::ReportAlloc(chunk->SlotSize);
+	return mem;
+}
+
+//==========================================================================
+//
+// ObjectPool :: Free
+//
+//==========================================================================
+
+void Free(void *mem)
+{
+	if (mem == nullptr) return;
+
+	FChunk *chunk = ChunkOf(mem);
+	if (chunk->SizeClass == LARGECLASS)
+	{
+		GC::ReportDealloc(chunk->SlotSize);
+		FreeChunk(chunk);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(PoolMutex);
+	auto &sc = Classes[chunk->SizeClass];
+	bool wasfull = IsFull(chunk);
+
+	*(void **)mem = chunk->FreeList;
+	chunk->FreeList = mem;
+	chunk->Used--;
+	Used -= chunk->SlotSize;
+	NumObjects--;
+	GC::ReportDealloc(chunk->SlotSize);
+
+	if (wasfull)
+	{
+		Link(sc, chunk);
+	}
+	// Keep one chunk per size class around so that a single actor being
+	// spawned and destroyed over and over does not hit the system allocator.
+	else if (chunk->Used == 0 && (sc.Partial != chunk || chunk->Next != nullptr))
+	{
+		ReleaseChunk(chunk);
+	}
+}
+
+size_t ReservedBytes()
+{
+	return Reserved;
+}
+
+size_t UsedBytes()
+{
+	return Used;
+}
+
+}
+
+//==========================================================================
+//
+// STAT objpool
+//
+//==========================================================================
+
+ADD_STAT(objpool)
+{
+	using namespace ObjectPool;
+	FString out;
+	unsigned classes = 0;
+	for (auto &sc : Classes)
+	{
+		if (sc.NumChunks > 0) classes++;
+	}
+	out.Format("Objects: %zu  Used: %zuK  Reserved: %zuK (%zu chunks in %u size classes)  Fill: %.1f%%",
+		NumObjects, Used >> 10, Reserved >> 10, Reserved / CHUNKSIZE, classes,
+		Reserved > 0 ? Used * 100. / Reserved : 0.);
+	return out;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <stddef.h>
+
+// Slab allocator for objects created through PClass::CreateNew.
+//
+// Objects are grouped by size class into 64 KB chunks, so that actors and
+// thinkers of the same (or similarly sized) class end up next to each other
+// in memory and spawning or destroying one is a free list operation instead
+// of a round trip through the system allocator. Anything too large for the
+// size classes gets a chunk of its own. Safe to use from any thread.
+
+namespace ObjectPool
+{
+	// Returns memory for an object of the given size. Never returns null.
+	void *Alloc(size_t size);
+
+	// Releases memory obtained from Alloc. Must not be used for anything else,
+	// since the chunk is found through the address alone.
+	void Free(void *mem);
+
+	// Bytes currently held in chunks / handed out to live objects.
+	size_t ReservedBytes();
+	size_t UsedBytes();
+}
@@ -423,7 +423,7 @@ PClass *PClass::FindClass (FName zaname)
 
 DObject *PClass::CreateNew()
 {
-	uint8_t *mem = (uint8_t *)M_Malloc (Size);
+	uint8_t *mem = (uint8_t *)ObjectPool::Alloc (Size);
 	assert (mem != nullptr);
 
 	// Set this object's defaults before constructing it.
@@ -434,7 +434,7 @@ DObject *PClass::CreateNew()
 
 	if (ConstructNative == nullptr || bAbstract)
 	{
-		M_Free(mem);
+		ObjectPool::Free(mem);
 		I_Error("Attempt to instantiate abstract class %s.", TypeName.GetChars());
 	}
 	ConstructNative (mem);
@@ -44,6 +44,7 @@
 #include "m_random.h"
 #include "v_font.h"
 #include "palettecontainer.h"
+#include "vmcache.h"
 
 
 extern FRandom pr_exrandom;
@@ -1447,7 +1448,9 @@ FxExpression *FxColorCast::Resolve(FCompileContext &ctx)
 			}
 			else
 			{
-				FxExpression *x = new FxConstant(V_GetColor(constval.GetString().GetChars(), &ScriptPosition), ScriptPosition);
+				int color = V_GetColor(constval.GetString().GetChars(), &ScriptPosition);
+				VMCache::NoteLookup(VMCache::LOOKUP_Color, constval.GetString().GetChars(), color);
+				FxExpression *x = new FxConstant(color, ScriptPosition);
 				delete this;
 				return x;
 			}
@@ -1527,7 +1530,9 @@ FxExpression *FxSoundCast::Resolve(FCompileContext &ctx)
 		if (basex->isConstant())
 		{
 			ExpVal constval = static_cast<FxConstant *>(basex)->GetValue();
-			FxExpression *x = new FxConstant(S_FindSound(constval.GetString().GetChars()), ScriptPosition);
+			FSoundID sound = S_FindSound(constval.GetString().GetChars());
+			VMCache::NoteLookup(VMCache::LOOKUP_Sound, constval.GetString().GetChars(), sound.index());
+			FxExpression *x = new FxConstant(sound, ScriptPosition);
 			delete this;
 			return x;
 		}
@@ -1619,7 +1624,9 @@ FxExpression* FxTranslationCast::Resolve(FCompileContext& ctx)
 		if (basex->isConstant())
 		{
 			ExpVal constval = static_cast<FxConstant*>(basex)->GetValue();
-			FxExpression* x = new FxConstant(R_FindCustomTranslation(constval.GetName()), ScriptPosition);
+			FTranslationID translation = R_FindCustomTranslation(constval.GetName());
+			VMCache::NoteLookup(VMCache::LOOKUP_Translation, constval.GetName().GetChars(), translation.index());
+			FxExpression* x = new FxConstant(translation, ScriptPosition);
 			x->ValueType = TypeTranslationID;
 			delete this;
 			return x;
@@ -3384,6 +3391,12 @@ error:
 //
 //==========================================================================
 
+void *FxAddSub::GetTextureCountAddress()
+{
+	auto * ptr = (FArray*)&TexMan.Textures;
+	return &ptr->Count;
+}
+
 ExpEmit FxAddSub::Emit(VMFunctionBuilder *build)
 {
 	assert(Operator == '+' || Operator == '-');
@@ -3483,8 +3496,7 @@ ExpEmit FxAddSub::Emit(VMFunctionBuilder *build)
 
 texcheck:
 	// Do a bounds check for the texture index. Note that count can change at run time so this needs to read the value from the texture manager.
-	auto * ptr = (FArray*)&TexMan.Textures;
-	auto * countptr = &ptr->Count;
+	auto * countptr = GetTextureCountAddress();
 	ExpEmit bndp(build, REGT_POINTER);
 	ExpEmit bndc(build, REGT_INT);
 	build->Emit(OP_LKP, bndp.RegNum, build->GetConstantAddress(countptr));
@@ -7421,6 +7433,45 @@ FxExpression *FxCVar::Resolve(FCompileContext &ctx)
 	return this;
 }
 
+//==========================================================================
+//
+// FxCVar :: GetValueAddress
+//
+// Returns the address the generated code reads the CVar's value from,
+// or null for CVar types that cannot be accessed from scripts.
+//
+//==========================================================================
+
+void *FxCVar::GetValueAddress(FBaseCVar *cvar)
+{
+	switch (cvar->GetRealType())
+	{
+	case CVAR_Int:
+		return &static_cast<FIntCVar *>(cvar)->Value;
+
+	case CVAR_Color:
+		return &static_cast<FColorCVar *>(cvar)->Value;
+
+	case CVAR_Float:
+		return &static_cast<FFloatCVar *>(cvar)->Value;
+
+	case CVAR_Bool:
+		return &static_cast<FBoolCVar *>(cvar)->Value;
+
+	case CVAR_String:
+		return &static_cast<FStringCVar *>(cvar)->mValue;
+
+	case CVAR_Flag:
+		return &static_cast<FFlagCVar *>(cvar)->ValueVar.Value;
+
+	case CVAR_Mask:
+		return &static_cast<FMaskCVar *>(cvar)->ValueVar.Value;
+
+	default:
+		return nullptr;
+	}
+}
+
 ExpEmit FxCVar::Emit(VMFunctionBuilder *build)
 {
 	ExpEmit dest(build, CVar->GetRealType() == CVAR_String ? REGT_STRING : ValueType->GetRegType());
@@ -7429,37 +7480,34 @@ ExpEmit FxCVar::Emit(VMFunctionBuilder *build)
 	switch (CVar->GetRealType())
 	{
 	case CVAR_Int:
-		build->Emit(OP_LKP, addr.RegNum, build->GetConstantAddress(&static_cast<FIntCVar *>(CVar)->Value));
+		build->Emit(OP_LKP, addr.RegNum, build->GetConstantAddress(GetValueAddress(CVar)));
 		build->Emit(OP_LW, dest.RegNum, addr.RegNum, nul);
 		break;
 
 	case CVAR_Color:
-		build->Emit(OP_LKP, addr.RegNum, build->GetConstantAddress(&static_cast<FColorCVar *>(CVar)->Value));
+		build->Emit(OP_LKP, addr.RegNum, build->GetConstantAddress(GetValueAddress(CVar)));
 		build->Emit(OP_LW, dest.RegNum, addr.RegNum, nul);
 		break;
 
 	case CVAR_Float:
-		build->Emit(OP_LKP, addr.RegNum, build->GetConstantAddress(&static_cast<FFloatCVar *>(CVar)->Value));
+		build->Emit(OP_LKP, addr.RegNum, build->GetConstantAddress(GetValueAddress(CVar)));
 		build->Emit(OP_LSP, dest.RegNum, addr.RegNum, nul);
 		break;
 
 	case CVAR_Bool:
-		build->Emit(OP_LKP, addr.RegNum, build->GetConstantAddress(&static_cast<FBoolCVar *>(CVar)->Value));
+		build->Emit(OP_LKP, addr.RegNum, build->GetConstantAddress(GetValueAddress(CVar)));
 		build->Emit(OP_LBU, dest.RegNum, addr.RegNum, nul);
 		break;
 
 	case CVAR_String:
-		build->Emit(OP_LKP, addr.RegNum, build->GetConstantAddress(&static_cast<FStringCVar *>(CVar)->mValue));
+		build->Emit(OP_LKP, addr.RegNum, build->GetConstantAddress(GetValueAddress(CVar)));
 		build->Emit(OP_LS, dest.RegNum, addr.RegNum, nul);
 		break;
 
 	case CVAR_Flag:
 	{
-		int *pVal;
 		auto cv = static_cast<FFlagCVar *>(CVar);
-		auto vcv = &cv->ValueVar;
-		pVal = &vcv->Value;
-		build->Emit(OP_LKP, addr.RegNum, build->GetConstantAddress(pVal));
+		build->Emit(OP_LKP, addr.RegNum, build->GetConstantAddress(GetValueAddress(CVar)));
 		build->Emit(OP_LW, dest.RegNum, addr.RegNum, nul);
 		build->Emit(OP_SRL_RI, dest.RegNum, dest.RegNum, cv->BitNum);
 		build->Emit(OP_AND_RK, dest.RegNum, dest.RegNum, build->GetConstantInt(1));
@@ -7469,7 +7517,7 @@ ExpEmit FxCVar::Emit(VMFunctionBuilder *build)
 	case CVAR_Mask:
 	{
 		auto cv = static_cast<FMaskCVar *>(CVar);
-		build->Emit(OP_LKP, addr.RegNum, build->GetConstantAddress(&cv->ValueVar.Value));
+		build->Emit(OP_LKP, addr.RegNum, build->GetConstantAddress(GetValueAddress(CVar)));
 		build->Emit(OP_LW, dest.RegNum, addr.RegNum, nul);
 		build->Emit(OP_AND_RK, dest.RegNum, dest.RegNum, build->GetConstantInt(cv->BitVal));
 		build->Emit(OP_SRL_RI, dest.RegNum, dest.RegNum, cv->BitNum);
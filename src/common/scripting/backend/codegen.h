@@ -1007,6 +1007,7 @@ public:
 	FxAddSub(int, FxExpression*, FxExpression*);
 	FxExpression *Resolve(FCompileContext&);
 	ExpEmit Emit(VMFunctionBuilder *build);
+	static void *GetTextureCountAddress();
 };
 
 //==========================================================================
@@ -1462,6 +1463,7 @@ public:
 	FxCVar(FBaseCVar*, const FScriptPosition&);
 	FxExpression *Resolve(FCompileContext&);
 	ExpEmit Emit(VMFunctionBuilder *build);
+	static void *GetValueAddress(FBaseCVar *cvar);
 };
 
 
@@ -2395,6 +2397,13 @@ struct CompileEnvironment
 	FxExpression* (*CheckCustomGlobalFunctions)(FxFunctionCall* func, FCompileContext& ctx);
 	bool (*ResolveSpecialFunction)(FxVMFunctionCall* func, FCompileContext& ctx);
 	FName CustomBuiltinNew;	//override the 'new' function if some classes need special treatment.
+
+	// The script code cache needs help from the game to relocate pointers to game data and to restore what code generation does to it.
+	bool (*CacheEncodeAddress)(void* ptr, FString& key);
+	void* (*CacheDecodeAddress)(const FString& key);
+	void (*CacheBeginBuild)(FString& fingerprint);
+	bool (*CacheGetBuildRecords)(TArray<FString>& records);
+	bool (*CacheReplayBuildRecords)(const TArray<FString>& records);
 };
 
 extern CompileEnvironment compileEnvironment;
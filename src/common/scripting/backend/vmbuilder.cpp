@@ -33,6 +33,7 @@
 */
 
 #include "vmbuilder.h"
+#include "vmcache.h"
 #include "codegen.h"
 #include "m_argv.h"
 #include "c_cvars.h"
@@ -44,6 +45,7 @@ CVAR(Bool, warningstoerrors, false, CVAR_GLOBALCONFIG | CVAR_ARCHIVE)
 
 EXTERN_CVAR(Bool, vm_jit)
 EXTERN_CVAR(Bool, vm_jit_aot)
+EXTERN_CVAR(Int, vm_jit_threshold)
 
 struct VMRemap
 {
@@ -840,12 +842,41 @@ void FFunctionBuildList::Build()
 {
 	VMDisassemblyDumper disasmdump(VMDisassemblyDumper::Overwrite);
 
+	// Try to restore the code of all functions from the cache. This only succeeds if nothing changed since it got written.
+	TArray<VMScriptFunction *> functions(mItems.Size(), true);
+	TArray<int> lumps(mItems.Size(), true);
+	for (unsigned i = 0; i < mItems.Size(); i++)
+	{
+		bool isAbstract = mItems[i].Func->Variants[0].Implementation->VarFlags & VARF_Abstract;
+		functions[i] = isAbstract ? nullptr : mItems[i].Function;
+		lumps[i] = mItems[i].Lump;
+	}
+	bool cached = VMCache::Begin(functions, lumps);
+
+	// Ahead of time JIT compilation is done for all functions at once after code generation.
+	TArray<VMScriptFunction *> aotfuncs;
+#if HAVE_VM_JIT
+	// With a call threshold functions start out in the interpreter and only hot ones get compiled.
+	const bool aot = vm_jit && vm_jit_aot && vm_jit_threshold <= 0;
+#else
+	const bool aot = false;
+#endif
+
 	for (auto &item : mItems)
 	{
 		// [Player701] Do not emit code for abstract functions
 		bool isAbstract = item.Func->Variants[0].Implementation->VarFlags & VARF_Abstract;
 		if (isAbstract) continue;
 
+		if (cached)
+		{
+			disasmdump.Write(item.Function, item.PrintableName);
+			if (aot) aotfuncs.Push(item.Function);
+			delete item.Code;
+			disasmdump.Flush();
+			continue;
+		}
+
 		assert(item.Code != NULL);
 
 		// We don't know the return type in advance for anonymous functions.
@@ -941,12 +972,7 @@ void FFunctionBuildList::Build()
 
 				sfunc->Unsafe = ctx.Unsafe;
 
-				#if HAVE_VM_JIT
-					if(vm_jit && vm_jit_aot)
-					{
-						sfunc->JitCompile();
-					}
-				#endif
+				if (aot) aotfuncs.Push(sfunc);
 			}
 			catch (CRecoverableError &err)
 			{
@@ -957,6 +983,8 @@ void FFunctionBuildList::Build()
 		delete item.Code;
 		disasmdump.Flush();
 	}
+	VMScriptFunction::JitCompileAll(aotfuncs);
+	VMCache::End(FScriptPosition::ErrorCounter == 0);
 	VMFunction::CreateRegUseInfo();
 	FScriptPosition::StrictErrors = strictdecorate;
 
@@ -1127,6 +1155,7 @@ ExpEmit FunctionCallEmitter::EmitCall(VMFunctionBuilder *build, TArray<ExpEmit>
 		// It would really be nicer to actually pass real types but that'd require a far more complex interface on the compiler side than what we have.
 		uint8_t *regbuffer = (uint8_t*)ClassDataAllocator.Alloc(reginfo.Size());	// Allocate in the arena so that the pointer does not need to be maintained.
 		memcpy(regbuffer, reginfo.Data(), reginfo.Size());
+		VMCache::NoteBlob(regbuffer, reginfo.Size());
 		build->Emit(OP_PARAM, REGT_POINTER | REGT_KONST, build->GetConstantAddress(regbuffer));
 		paramcount++;
 	}
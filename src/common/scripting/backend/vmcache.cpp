@@ -0,0 +1,1356 @@
+/*
+** vmcache.cpp
+**
+** On-disk cache for generated script code
+**
+**---------------------------------------------------------------------------
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/
+**
+**---------------------------------------------------------------------------
+**
+** Parsing the scripts and setting up the type system is comparatively
+** cheap. Most of the compile time is spent resolving and emitting the
+** function bodies, so that is the step being cached here: the bytecode,
+** constant tables and frame layout of every function.
+**
+** Address constants cannot be stored as they are, so each one is written
+** as a symbolic reference (a type, class, function, CVar, RNG, global
+** variable or something only the game knows about) and looked up again
+** on load.
+**
+** The cache file is keyed on the engine version and the contents of all
+** script lumps. Code generation also depends on some state that is not
+** covered by that, like the name table and the state label storage, so
+** that is checked separately. The same goes for sound, color and
+** translation names the compiler turns into constants: their values come
+** from lumps like SNDINFO, so every such lookup is stored and repeated on
+** load. If anything does not match or a reference cannot be resolved the
+** scripts are compiled normally.
+**
+*/
+
+#include <miniz.h>
+#include "vmcache.h"
+#include "vmintern.h"
+#include "codegen.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "filesystem.h"
+#include "files.h"
+#include "fs_findfile.h"
+#include "i_specialpaths.h"
+#include "i_time.h"
+#include "cmdlib.h"
+#include "md5.h"
+#include "m_random.h"
+#include "m_swap.h"
+#include "version.h"
+#include "printf.h"
+#include "palutil.h"
+
+FTranslationID R_FindCustomTranslation(FName name);
+
+CVAR(Bool, vm_cache, false, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
+EXTERN_CVAR(Bool, strictdecorate)
+EXTERN_CVAR(Bool, vm_jit)
+
+namespace VMCache
+{
+
+typedef TArray<uint8_t> MemFile;
+
+enum
+{
+	CACHE_VERSION = 2,
+	HEADER_SIZE = 4 + 4 + 16 + 4,
+};
+
+// How address constants are stored.
+enum EAddressTag : uint8_t
+{
+	ADDR_Null,
+	ADDR_Int,			// small integer cast to a pointer, e.g. a field offset
+	ADDR_Type,
+	ADDR_Class,
+	ADDR_Defaults,
+	ADDR_Function,
+	ADDR_CVar,
+	ADDR_RNG,
+	ADDR_Field,			// global or static variable
+	ADDR_Blob,			// data allocated by the code generator
+	ADDR_TextureCount,
+	ADDR_Game,
+};
+
+enum ETypeTag : uint8_t
+{
+	TYPE_Null,
+	TYPE_Basic,
+	TYPE_Class,
+	TYPE_Struct,
+	TYPE_Pointer,
+	TYPE_ClassPointer,
+	TYPE_Array,
+	TYPE_StaticArray,
+	TYPE_DynArray,
+	TYPE_Map,
+	TYPE_MapIterator,
+	TYPE_Prototype,
+};
+
+struct FAddress
+{
+	uint8_t Tag;
+	const void *Object;		// type, class or field container
+	FString Name;
+	uint32_t Index;
+};
+
+struct FLookup
+{
+	ELookup Kind;
+	FString Name;
+	int Value;
+};
+
+struct FCachedFunction
+{
+	TArray<VMOP> Code;
+	TArray<FStatementInfo> LineInfo;
+	FString SourceFileName;
+	TArray<int> KonstD;
+	TArray<double> KonstF;
+	TArray<FString> KonstS;
+	TArray<void *> KonstA;
+	TArray<FTypeAndOffset> SpecialInits;
+	PPrototype *Proto;
+	TArray<uint32_t> ArgFlags;
+	int ExtraSpace;
+	unsigned StackSize;
+	uint8_t NumRegD, NumRegF, NumRegS, NumRegA;
+	uint16_t MaxParam;
+	uint8_t NumArgs;
+	bool Unsafe;
+};
+
+static bool Active;
+static bool Restored;
+static bool Tainted;
+static uint8_t Key[16];
+static int FirstName;
+static uint8_t NamesDigest[16];
+static FString GameFingerprint;
+static TArray<VMScriptFunction *> Functions;
+static TArray<bool> Anonymous;
+static TArray<PType *> BasicTypes;
+static TMap<const void *, FAddress> Addresses;
+static TMap<const void *, TArray<uint8_t>> Blobs;
+static TArray<int> SourceLumps;
+static TArray<FLookup> Lookups;
+static TMap<FString, TArray<VMFunction *>> FunctionsByName;
+
+//==========================================================================
+//
+// DoLookup
+//
+// Must return exactly what the code generator got for the name.
+//
+//==========================================================================
+
+static int DoLookup(ELookup kind, const char *name)
+{
+	switch (kind)
+	{
+	case LOOKUP_Sound:			return S_FindSound(name).index();
+	case LOOKUP_Color:			return V_GetColor(name);
+	case LOOKUP_Translation:	return R_FindCustomTranslation(name).index();
+	default:					return -1;
+	}
+}
+
+//==========================================================================
+//
+// Serialization helpers
+//
+//==========================================================================
+
+static void WriteByte(MemFile &f, uint8_t b)
+{
+	f.Push(b);
+}
+
+static void WriteLong(MemFile &f, uint32_t b)
+{
+	int v = f.Reserve(4);
+	f[v] = (uint8_t)b;
+	f[v+1] = (uint8_t)(b>>8);
+	f[v+2] = (uint8_t)(b>>16);
+	f[v+3] = (uint8_t)(b>>24);
+}
+
+static void WriteBytes(MemFile &f, const void *data, size_t len)
+{
+	if (len > 0)
+	{
+		int v = f.Reserve((unsigned)len);
+		memcpy(&f[v], data, len);
+	}
+}
+
+static void WriteString(MemFile &f, const char *s)
+{
+	size_t len = strlen(s);
+	WriteLong(f, (uint32_t)len);
+	WriteBytes(f, s, len);
+}
+
+struct FCacheReader
+{
+	const uint8_t *Pos, *End;
+	bool Failed = false;
+
+	bool ReadBytes(void *dest, size_t len)
+	{
+		if (Failed || size_t(End - Pos) < len)
+		{
+			Failed = true;
+			if (len > 0) memset(dest, 0, len);
+			return false;
+		}
+		if (len > 0) memcpy(dest, Pos, len);
+		Pos += len;
+		return true;
+	}
+
+	uint8_t ReadByte()
+	{
+		uint8_t b;
+		ReadBytes(&b, 1);
+		return b;
+	}
+
+	uint32_t ReadLong()
+	{
+		uint8_t b[4];
+		ReadBytes(b, 4);
+		return b[0] | (b[1] << 8) | (b[2] << 16) | (uint32_t(b[3]) << 24);
+	}
+
+	// Every element takes up at least one byte, so this can reject garbage before anything gets allocated.
+	unsigned ReadCount(unsigned limit = 0x10000)
+	{
+		uint32_t count = ReadLong();
+		if (Failed || count > limit || count > size_t(End - Pos))
+		{
+			Failed = true;
+			return 0;
+		}
+		return count;
+	}
+
+	FString ReadString()
+	{
+		uint32_t len = ReadLong();
+		if (Failed || size_t(End - Pos) < len)
+		{
+			Failed = true;
+			return FString();
+		}
+		FString s((const char *)Pos, len);
+		Pos += len;
+		return s;
+	}
+};
+
+//==========================================================================
+//
+// MakeKey
+//
+// Everything that can change the generated code without changing any of
+// the fingerprints checked on load: the engine itself, the settings the
+// code generator looks at and the script sources. The contents are hashed
+// for every lump the parsers read and every lump a function comes from,
+// for everything else the name and size have to do.
+//
+//==========================================================================
+
+static void MakeKey(const TArray<int> &lumps, const TArray<int> &sources, uint8_t key[16])
+{
+	MD5Context md5;
+	auto addstring = [&](const char *s) { md5.Update((const uint8_t *)s, (unsigned)strlen(s) + 1); };
+	auto addint = [&](uint32_t v) { md5.Update((const uint8_t *)&v, 4); };
+
+	addstring(GetVersionString());
+	addstring(GetGitHash());
+	addint(CACHE_VERSION);
+	addint(sizeof(void *));
+	addint(NUM_OPS);
+	addint(strictdecorate);
+	addint(vm_jit);
+
+	TArray<bool> hashlump(fileSystem.GetNumEntries(), true);
+	memset(hashlump.Data(), 0, hashlump.Size() * sizeof(bool));
+	for (auto lump : lumps)
+	{
+		if ((unsigned)lump < hashlump.Size()) hashlump[lump] = true;
+	}
+	for (auto lump : sources)
+	{
+		if ((unsigned)lump < hashlump.Size()) hashlump[lump] = true;
+	}
+
+	for (int i = 0; i < fileSystem.GetNumWads(); i++)
+	{
+		addstring(fileSystem.GetResourceFileFullName(i));
+	}
+	for (int i = 0; i < fileSystem.GetNumEntries(); i++)
+	{
+		addstring(fileSystem.GetFileFullName(i));
+		addint(fileSystem.GetFileContainer(i));
+		addint((uint32_t)fileSystem.FileLength(i));
+		if (hashlump[i])
+		{
+			auto data = fileSystem.ReadFile(i);
+			md5.Update((const uint8_t *)data.data(), (unsigned)data.size());
+		}
+	}
+	md5.Final(key);
+}
+
+//==========================================================================
+//
+// HashNames
+//
+// Name indices end up in the code as integer constants so the name table
+// must look exactly the same as when the cache was written.
+//
+//==========================================================================
+
+static void HashNames(int count, uint8_t digest[16])
+{
+	MD5Context md5;
+	for (int i = 0; i < count; i++)
+	{
+		const char *name = FName((ENamedName)i).GetChars();
+		md5.Update((const uint8_t *)name, (unsigned)strlen(name) + 1);
+	}
+	md5.Final(digest);
+}
+
+//==========================================================================
+//
+// CacheFileName
+//
+//==========================================================================
+
+static FString CacheFileName(bool create)
+{
+	FString path = M_GetCachePath(create);
+	path << "/vmcode";
+	if (create) CreatePath(path.GetChars());
+	path << '/';
+	for (auto b : Key) path.AppendFormat("%02x", b);
+	path << ".zvc";
+	return path;
+}
+
+//==========================================================================
+//
+// Types
+//
+// Types are written structurally so that derived types the code generator
+// created on the fly can be recreated on load.
+//
+//==========================================================================
+
+static void InitBasicTypes()
+{
+	PType *types[] = {
+		TypeError, TypeAuto, TypeVoid, TypeSInt8, TypeUInt8, TypeSInt16, TypeUInt16, TypeSInt32, TypeUInt32,
+		TypeBool, TypeFloat32, TypeFloat64, TypeString, TypeName, TypeSound, TypeColor, TypeTextureID,
+		TypeTranslationID, TypeSpriteID, TypeVector2, TypeVector3, TypeVector4, TypeFVector2, TypeFVector3,
+		TypeFVector4, TypeQuaternion, TypeFQuaternion, TypeColorStruct, TypeStringStruct, TypeQuaternionStruct,
+		TypeState, TypeFont, TypeStateLabel, TypeNullPtr, TypeVoidPtr, TypeRawFunction, TypeVMFunction
+	};
+	BasicTypes.Clear();
+	for (auto type : types) BasicTypes.Push(type);
+}
+
+static bool WriteType(MemFile &f, PType *type);
+
+static bool WriteOuter(MemFile &f, PTypeBase *outer)
+{
+	if (outer == nullptr)
+	{
+		WriteByte(f, 0);
+		return true;
+	}
+	for (unsigned i = 0; i < Namespaces.AllNamespaces.Size(); i++)
+	{
+		if (Namespaces.AllNamespaces[i] == outer)
+		{
+			WriteByte(f, 1);
+			WriteLong(f, i);
+			return true;
+		}
+	}
+	WriteByte(f, 2);
+	return WriteType(f, static_cast<PType *>(outer));
+}
+
+static bool WriteType(MemFile &f, PType *type)
+{
+	if (type == nullptr)
+	{
+		WriteByte(f, TYPE_Null);
+		return true;
+	}
+	unsigned basic = BasicTypes.Find(type);
+	if (basic < BasicTypes.Size())
+	{
+		WriteByte(f, TYPE_Basic);
+		WriteByte(f, (uint8_t)basic);
+		return true;
+	}
+	if (type->isClass())
+	{
+		WriteByte(f, TYPE_Class);
+		WriteString(f, static_cast<PClassType *>(type)->Descriptor->TypeName.GetChars());
+		return true;
+	}
+
+	switch (type->TypeTableType.GetIndex())
+	{
+	case NAME_Struct:
+	{
+		auto stype = static_cast<PStruct *>(type);
+		WriteByte(f, TYPE_Struct);
+		WriteString(f, stype->TypeName.GetChars());
+		return WriteOuter(f, stype->Outer);
+	}
+
+	case NAME_Pointer:
+	{
+		auto ptype = static_cast<PPointer *>(type);
+		WriteByte(f, TYPE_Pointer);
+		WriteByte(f, ptype->IsConst);
+		return WriteType(f, ptype->PointedType);
+	}
+
+	case NAME_Class:
+	{
+		auto ctype = static_cast<PClassPointer *>(type);
+		if (ctype->ClassRestriction == nullptr) return false;
+		WriteByte(f, TYPE_ClassPointer);
+		WriteString(f, ctype->ClassRestriction->TypeName.GetChars());
+		return true;
+	}
+
+	case NAME_Array:
+	{
+		auto atype = static_cast<PArray *>(type);
+		WriteByte(f, TYPE_Array);
+		WriteLong(f, atype->ElementCount);
+		return WriteType(f, atype->ElementType);
+	}
+
+	case NAME_StaticArray:
+		WriteByte(f, TYPE_StaticArray);
+		return WriteType(f, static_cast<PStaticArray *>(type)->ElementType);
+
+	case NAME_DynArray:
+		WriteByte(f, TYPE_DynArray);
+		return WriteType(f, static_cast<PDynArray *>(type)->ElementType);
+
+	case NAME_Map:
+		WriteByte(f, TYPE_Map);
+		return WriteType(f, static_cast<PMap *>(type)->KeyType) && WriteType(f, static_cast<PMap *>(type)->ValueType);
+
+	case NAME_MapIterator:
+		WriteByte(f, TYPE_MapIterator);
+		return WriteType(f, static_cast<PMapIterator *>(type)->KeyType) && WriteType(f, static_cast<PMapIterator *>(type)->ValueType);
+
+	case NAME_Prototype:
+	{
+		auto proto = static_cast<PPrototype *>(type);
+		WriteByte(f, TYPE_Prototype);
+		WriteLong(f, proto->ReturnTypes.Size());
+		for (auto t : proto->ReturnTypes) if (!WriteType(f, t)) return false;
+		WriteLong(f, proto->ArgumentTypes.Size());
+		for (auto t : proto->ArgumentTypes) if (!WriteType(f, t)) return false;
+		return true;
+	}
+
+	default:
+		// Enums and function pointers cannot be looked up again.
+		return false;
+	}
+}
+
+static bool ReadType(FCacheReader &fr, PType *&type);
+
+static bool ReadOuter(FCacheReader &fr, PTypeBase *&outer)
+{
+	outer = nullptr;
+	switch (fr.ReadByte())
+	{
+	case 0:
+		return !fr.Failed;
+
+	case 1:
+	{
+		unsigned index = fr.ReadLong();
+		if (index >= Namespaces.AllNamespaces.Size()) return false;
+		outer = Namespaces.AllNamespaces[index];
+		return !fr.Failed;
+	}
+
+	case 2:
+	{
+		PType *type;
+		if (!ReadType(fr, type) || type == nullptr) return false;
+		outer = type;
+		return true;
+	}
+
+	default:
+		return false;
+	}
+}
+
+static PClass *ReadClass(FCacheReader &fr)
+{
+	FName name(fr.ReadString(), true);
+	return name == NAME_None ? nullptr : PClass::FindClass(name);
+}
+
+static bool ReadTypeList(FCacheReader &fr, TArray<PType *> &list)
+{
+	list.Resize(fr.ReadCount());
+	if (fr.Failed) return false;
+	for (auto &t : list)
+	{
+		if (!ReadType(fr, t)) return false;
+	}
+	return true;
+}
+
+static bool ReadType(FCacheReader &fr, PType *&type)
+{
+	type = nullptr;
+	uint8_t tag = fr.ReadByte();
+	switch (tag)
+	{
+	case TYPE_Null:
+		return !fr.Failed;
+
+	case TYPE_Basic:
+	{
+		unsigned index = fr.ReadByte();
+		if (index >= BasicTypes.Size()) return false;
+		type = BasicTypes[index];
+		break;
+	}
+
+	case TYPE_Class:
+	{
+		auto cls = ReadClass(fr);
+		if (cls != nullptr) type = cls->VMType;
+		break;
+	}
+
+	case TYPE_Struct:
+	{
+		FName name(fr.ReadString(), true);
+		PTypeBase *outer;
+		if (name == NAME_None || !ReadOuter(fr, outer)) return false;
+		size_t bucket;
+		type = TypeTable.FindType(NAME_Struct, (intptr_t)outer, name.GetIndex(), &bucket);
+		break;
+	}
+
+	case TYPE_Pointer:
+	{
+		bool isconst = !!fr.ReadByte();
+		PType *pointed;
+		if (!ReadType(fr, pointed) || pointed == nullptr) return false;
+		type = NewPointer(pointed, isconst);
+		break;
+	}
+
+	case TYPE_ClassPointer:
+	{
+		auto cls = ReadClass(fr);
+		if (cls != nullptr) type = NewClassPointer(cls);
+		break;
+	}
+
+	case TYPE_Array:
+	{
+		unsigned count = fr.ReadLong();
+		PType *element;
+		if (!ReadType(fr, element) || element == nullptr) return false;
+		type = NewArray(element, count);
+		break;
+	}
+
+	case TYPE_StaticArray:
+	case TYPE_DynArray:
+	{
+		PType *element;
+		if (!ReadType(fr, element) || element == nullptr) return false;
+		type = tag == TYPE_DynArray ? (PType *)NewDynArray(element) : (PType *)NewStaticArray(element);
+		break;
+	}
+
+	case TYPE_Map:
+	case TYPE_MapIterator:
+	{
+		PType *keytype, *valuetype;
+		if (!ReadType(fr, keytype) || !ReadType(fr, valuetype) || keytype == nullptr || valuetype == nullptr) return false;
+		type = tag == TYPE_MapIterator ? (PType *)NewMapIterator(keytype, valuetype) : (PType *)NewMap(keytype, valuetype);
+		break;
+	}
+
+	case TYPE_Prototype:
+	{
+		TArray<PType *> rets, args;
+		if (!ReadTypeList(fr, rets) || !ReadTypeList(fr, args)) return false;
+		type = NewPrototype(rets, args);
+		break;
+	}
+
+	default:
+		return false;
+	}
+	return !fr.Failed && type != nullptr;
+}
+
+//==========================================================================
+//
+// Address constants
+//
+//==========================================================================
+
+static void AddAddress(const void *p, uint8_t tag, const void *object, const char *name, uint32_t index)
+{
+	if (p != nullptr && Addresses.CheckKey(p) == nullptr)
+	{
+		Addresses.Insert(p, { tag, object, name, index });
+	}
+}
+
+static void AddFields(PSymbolTable &symbols, const void *container, uint32_t nsindex)
+{
+	auto it = symbols.GetIterator();
+	PSymbolTable::MapType::Pair *pair;
+	while (it.NextPair(pair))
+	{
+		auto field = dyn_cast<PField>(pair->Value);
+		// Anything below 64k is an offset, not an address, and gets written as a plain number.
+		if (field != nullptr && field->Offset >= 0x10000)
+		{
+			AddAddress((void *)field->Offset, ADDR_Field, container, pair->Key.GetChars(), nsindex);
+		}
+	}
+}
+
+static void BuildAddressMap()
+{
+	Addresses.Clear();
+	for (auto bucket : TypeTable.TypeHash)
+	{
+		for (PType *type = bucket; type != nullptr; type = type->HashNext)
+		{
+			AddAddress(type, ADDR_Type, type, "", 0);
+			AddFields(type->Symbols, type, ~0u);
+		}
+	}
+	for (unsigned i = 0; i < Namespaces.AllNamespaces.Size(); i++)
+	{
+		AddFields(Namespaces.AllNamespaces[i]->Symbols, nullptr, i);
+	}
+	for (auto cls : PClass::AllClasses)
+	{
+		AddAddress(cls, ADDR_Class, cls, "", 0);
+		AddAddress(cls->Defaults, ADDR_Defaults, cls, "", 0);
+	}
+
+	// Functions are identified by name and, for the few that share one, their position in the list.
+	TMap<FString, uint32_t> ordinals;
+	for (auto func : VMFunction::AllFunctions)
+	{
+		FString name = func->QualifiedName ? func->QualifiedName : "";
+		uint32_t *ordinal = ordinals.CheckKey(name);
+		uint32_t index = ordinal == nullptr ? 0 : *ordinal + 1;
+		ordinals[name] = index;
+		AddAddress(func, ADDR_Function, nullptr, name.GetChars(), index);
+	}
+
+	CVarMap::Iterator it(cvarMap);
+	CVarMap::Pair *pair;
+	while (it.NextPair(pair))
+	{
+		AddAddress(FxCVar::GetValueAddress(pair->Value), ADDR_CVar, nullptr, pair->Value->GetName(), 0);
+	}
+
+	AddAddress(FxAddSub::GetTextureCountAddress(), ADDR_TextureCount, nullptr, "", 0);
+}
+
+static bool WriteAddress(MemFile &f, const void *p)
+{
+	if (p == nullptr)
+	{
+		WriteByte(f, ADDR_Null);
+		return true;
+	}
+	if ((uintptr_t)p < 0x10000)
+	{
+		WriteByte(f, ADDR_Int);
+		WriteLong(f, (uint32_t)(uintptr_t)p);
+		return true;
+	}
+	if (auto blob = Blobs.CheckKey(p))
+	{
+		WriteByte(f, ADDR_Blob);
+		WriteLong(f, blob->Size());
+		WriteBytes(f, blob->Data(), blob->Size());
+		return true;
+	}
+	if (auto addr = Addresses.CheckKey(p))
+	{
+		WriteByte(f, addr->Tag);
+		switch (addr->Tag)
+		{
+		case ADDR_Type:
+			return WriteType(f, (PType *)addr->Object);
+
+		case ADDR_Class:
+		case ADDR_Defaults:
+			WriteString(f, ((PClass *)addr->Object)->TypeName.GetChars());
+			return true;
+
+		case ADDR_Function:
+			WriteString(f, addr->Name.GetChars());
+			WriteLong(f, addr->Index);
+			return true;
+
+		case ADDR_CVar:
+			WriteString(f, addr->Name.GetChars());
+			return true;
+
+		case ADDR_Field:
+			WriteLong(f, addr->Index);
+			WriteString(f, addr->Name.GetChars());
+			return addr->Index != ~0u || WriteType(f, (PType *)addr->Object);
+
+		case ADDR_TextureCount:
+			return true;
+		}
+		return false;
+	}
+	if (FRandom::StaticIsRNG((const FRandom *)p))
+	{
+		auto rng = (const FRandom *)p;
+		WriteByte(f, ADDR_RNG);
+		WriteLong(f, rng->GetNameCRC());
+		WriteByte(f, rng->IsClient());
+		return true;
+	}
+	FString key;
+	if (compileEnvironment.CacheEncodeAddress != nullptr && compileEnvironment.CacheEncodeAddress((void *)p, key))
+	{
+		WriteByte(f, ADDR_Game);
+		WriteString(f, key.GetChars());
+		return true;
+	}
+	return false;
+}
+
+static bool ReadAddress(FCacheReader &fr, void *&p)
+{
+	p = nullptr;
+	switch (fr.ReadByte())
+	{
+	case ADDR_Null:
+		return !fr.Failed;
+
+	case ADDR_Int:
+		p = (void *)(uintptr_t)fr.ReadLong();
+		break;
+
+	case ADDR_Type:
+	{
+		PType *type;
+		if (!ReadType(fr, type)) return false;
+		p = type;
+		break;
+	}
+
+	case ADDR_Class:
+		p = ReadClass(fr);
+		break;
+
+	case ADDR_Defaults:
+	{
+		auto cls = ReadClass(fr);
+		if (cls != nullptr) p = cls->Defaults;
+		break;
+	}
+
+	case ADDR_Function:
+	{
+		FString name = fr.ReadString();
+		unsigned index = fr.ReadLong();
+		auto list = FunctionsByName.CheckKey(name);
+		if (list != nullptr && index < list->Size()) p = (*list)[index];
+		break;
+	}
+
+	case ADDR_CVar:
+	{
+		FBaseCVar *cvar = FindCVar(fr.ReadString().GetChars(), nullptr);
+		if (cvar != nullptr) p = FxCVar::GetValueAddress(cvar);
+		break;
+	}
+
+	case ADDR_RNG:
+	{
+		uint32_t crc = fr.ReadLong();
+		p = FRandom::StaticFindRNGByCRC(crc, !!fr.ReadByte());
+		break;
+	}
+
+	case ADDR_Field:
+	{
+		unsigned index = fr.ReadLong();
+		FName name(fr.ReadString(), true);
+		PSymbolTable *symbols = nullptr;
+		if (index != ~0u)
+		{
+			if (index < Namespaces.AllNamespaces.Size()) symbols = &Namespaces.AllNamespaces[index]->Symbols;
+		}
+		else
+		{
+			PType *type;
+			if (!ReadType(fr, type)) return false;
+			symbols = &type->Symbols;
+		}
+		if (symbols == nullptr || name == NAME_None) return false;
+		auto field = dyn_cast<PField>(symbols->FindSymbol(name, false));
+		if (field != nullptr) p = (void *)field->Offset;
+		break;
+	}
+
+	case ADDR_Blob:
+	{
+		unsigned size = fr.ReadLong();
+		if (fr.Failed || size_t(fr.End - fr.Pos) < size) return false;
+		p = ClassDataAllocator.Alloc(size);
+		fr.ReadBytes(p, size);
+		break;
+	}
+
+	case ADDR_TextureCount:
+		p = FxAddSub::GetTextureCountAddress();
+		break;
+
+	case ADDR_Game:
+	{
+		FString key = fr.ReadString();
+		if (compileEnvironment.CacheDecodeAddress != nullptr) p = compileEnvironment.CacheDecodeAddress(key);
+		break;
+	}
+
+	default:
+		return false;
+	}
+	return !fr.Failed && p != nullptr;
+}
+
+//==========================================================================
+//
+// WriteFunction / ReadFunction
+//
+//==========================================================================
+
+static bool WriteFunction(MemFile &f, VMScriptFunction *func, bool anonymous)
+{
+	WriteLong(f, func->CodeSize);
+	WriteBytes(f, func->Code, func->CodeSize * sizeof(VMOP));
+	WriteLong(f, func->LineInfoCount);
+	WriteBytes(f, func->LineInfo, func->LineInfoCount * sizeof(FStatementInfo));
+	WriteString(f, func->SourceFileName.GetChars());
+
+	WriteLong(f, func->NumKonstD);
+	WriteBytes(f, func->KonstD, func->NumKonstD * sizeof(int));
+	WriteLong(f, func->NumKonstF);
+	WriteBytes(f, func->KonstF, func->NumKonstF * sizeof(double));
+	WriteLong(f, func->NumKonstS);
+	for (unsigned i = 0; i < func->NumKonstS; i++)
+	{
+		WriteString(f, func->KonstS[i].GetChars());
+	}
+	WriteLong(f, func->NumKonstA);
+	for (unsigned i = 0; i < func->NumKonstA; i++)
+	{
+		if (!WriteAddress(f, func->KonstA[i].v))
+		{
+			DPrintf(DMSG_NOTIFY, "Script code cache: cannot store constant %p in %s\n", func->KonstA[i].v, func->PrintableName);
+			return false;
+		}
+	}
+
+	WriteLong(f, func->SpecialInits.Size());
+	for (auto &init : func->SpecialInits)
+	{
+		if (!WriteType(f, const_cast<PType *>(init.first))) return false;
+		WriteLong(f, init.second);
+	}
+
+	WriteLong(f, func->ExtraSpace);
+	WriteLong(f, func->StackSize);
+	WriteByte(f, func->NumRegD);
+	WriteByte(f, func->NumRegF);
+	WriteByte(f, func->NumRegS);
+	WriteByte(f, func->NumRegA);
+	WriteLong(f, func->MaxParam);
+	WriteByte(f, func->NumArgs);
+	WriteByte(f, func->Unsafe);
+
+	// Anonymous functions get their prototype from the code generator.
+	WriteByte(f, anonymous);
+	if (anonymous)
+	{
+		if (!WriteType(f, func->Proto)) return false;
+		WriteLong(f, func->ArgFlags.Size());
+		for (auto flag : func->ArgFlags) WriteLong(f, flag);
+	}
+	return true;
+}
+
+template<class T> static bool ReadArray(FCacheReader &fr, TArray<T> &array)
+{
+	unsigned count = fr.ReadCount(0x100000);
+	if (fr.Failed || size_t(fr.End - fr.Pos) < count * sizeof(T)) return false;
+	array.Resize(count);
+	return fr.ReadBytes(array.Data(), count * sizeof(T));
+}
+
+static bool ReadFunction(FCacheReader &fr, FCachedFunction &func)
+{
+	if (!ReadArray(fr, func.Code) || func.Code.Size() == 0) return false;
+	if (!ReadArray(fr, func.LineInfo)) return false;
+	func.SourceFileName = fr.ReadString();
+
+	if (!ReadArray(fr, func.KonstD)) return false;
+	if (!ReadArray(fr, func.KonstF)) return false;
+	func.KonstS.Resize(fr.ReadCount());
+	for (auto &s : func.KonstS)
+	{
+		s = fr.ReadString();
+		if (fr.Failed) return false;
+	}
+	func.KonstA.Resize(fr.ReadCount());
+	for (auto &a : func.KonstA)
+	{
+		if (!ReadAddress(fr, a)) return false;
+	}
+	if (fr.Failed || func.KonstD.Size() > 65535 || func.KonstF.Size() > 65535 || func.KonstS.Size() > 65535 || func.KonstA.Size() > 65535) return false;
+
+	func.SpecialInits.Resize(fr.ReadCount());
+	for (auto &init : func.SpecialInits)
+	{
+		PType *type;
+		if (!ReadType(fr, type) || type == nullptr) return false;
+		init.first = type;
+		init.second = fr.ReadLong();
+	}
+
+	func.ExtraSpace = fr.ReadLong();
+	func.StackSize = fr.ReadLong();
+	func.NumRegD = fr.ReadByte();
+	func.NumRegF = fr.ReadByte();
+	func.NumRegS = fr.ReadByte();
+	func.NumRegA = fr.ReadByte();
+	func.MaxParam = (uint16_t)fr.ReadLong();
+	func.NumArgs = fr.ReadByte();
+	func.Unsafe = !!fr.ReadByte();
+
+	func.Proto = nullptr;
+	if (fr.ReadByte())
+	{
+		PType *proto;
+		if (!ReadType(fr, proto) || proto == nullptr || !proto->isPrototype()) return false;
+		func.Proto = static_cast<PPrototype *>(proto);
+		func.ArgFlags.Resize(fr.ReadCount());
+		for (auto &flag : func.ArgFlags) flag = fr.ReadLong();
+	}
+	return !fr.Failed;
+}
+
+static void InstallFunction(VMScriptFunction *sfunc, FCachedFunction &func)
+{
+	sfunc->Alloc(func.Code.Size(), func.KonstD.Size(), func.KonstF.Size(), func.KonstS.Size(), func.KonstA.Size(), func.LineInfo.Size());
+	memcpy(sfunc->Code, func.Code.Data(), func.Code.Size() * sizeof(VMOP));
+	if (func.LineInfo.Size() > 0) memcpy(sfunc->LineInfo, func.LineInfo.Data(), func.LineInfo.Size() * sizeof(FStatementInfo));
+	if (func.KonstD.Size() > 0) memcpy(sfunc->KonstD, func.KonstD.Data(), func.KonstD.Size() * sizeof(int));
+	if (func.KonstF.Size() > 0) memcpy(sfunc->KonstF, func.KonstF.Data(), func.KonstF.Size() * sizeof(double));
+	for (unsigned i = 0; i < func.KonstS.Size(); i++) sfunc->KonstS[i] = func.KonstS[i];
+	for (unsigned i = 0; i < func.KonstA.Size(); i++) sfunc->KonstA[i].v = func.KonstA[i];
+
+	sfunc->SourceFileName = func.SourceFileName;
+	sfunc->SpecialInits = std::move(func.SpecialInits);
+	sfunc->ExtraSpace = func.ExtraSpace;
+	sfunc->StackSize = func.StackSize;
+	sfunc->NumRegD = func.NumRegD;
+	sfunc->NumRegF = func.NumRegF;
+	sfunc->NumRegS = func.NumRegS;
+	sfunc->NumRegA = func.NumRegA;
+	sfunc->MaxParam = func.MaxParam;
+	sfunc->NumArgs = func.NumArgs;
+	sfunc->Unsafe = func.Unsafe;
+	if (func.Proto != nullptr)
+	{
+		sfunc->Proto = func.Proto;
+		sfunc->ArgFlags = std::move(func.ArgFlags);
+	}
+}
+
+//==========================================================================
+//
+// Load
+//
+// Nothing gets touched until all the function data has been read and all
+// references resolved, so any failure up to that point leaves things as
+// they were.
+//
+//==========================================================================
+
+static bool Load()
+{
+	FString path = CacheFileName(false);
+	FileReader fr;
+	if (!fr.OpenFile(path.GetChars()))
+	{
+		DPrintf(DMSG_NOTIFY, "Script code cache: no cache file\n");
+		return false;
+	}
+
+	uint8_t header[HEADER_SIZE];
+	auto length = fr.GetLength();
+	if (length <= HEADER_SIZE || fr.Read(header, HEADER_SIZE) != HEADER_SIZE) return false;
+	if (memcmp(header, "ZVMC", 4) || header[4] != CACHE_VERSION || memcmp(header + 8, Key, 16)) return false;
+
+	uLongf size = header[24] | (header[25] << 8) | (header[26] << 16) | (uLongf(header[27]) << 24);
+	TArray<uint8_t> compressed((unsigned)(length - HEADER_SIZE), true);
+	TArray<uint8_t> data((unsigned)size, true);
+	if (fr.Read(compressed.Data(), compressed.Size()) != (ptrdiff_t)compressed.Size()) return false;
+	if (uncompress(data.Data(), &size, compressed.Data(), compressed.Size()) != Z_OK || size != data.Size()) return false;
+	compressed.Reset();
+
+	FCacheReader reader = { data.Data(), data.Data() + data.Size() };
+	uint8_t digest[16];
+	if ((int)reader.ReadLong() != FirstName) return false;
+	if (!reader.ReadBytes(digest, 16) || memcmp(digest, NamesDigest, 16)) return false;
+	if (reader.ReadString().Compare(GameFingerprint)) return false;
+
+	if (reader.ReadCount(0x1000000) != Functions.Size() || reader.Failed)
+	{
+		DPrintf(DMSG_NOTIFY, "Script code cache: function list changed\n");
+		return false;
+	}
+	for (auto func : Functions)
+	{
+		FString name = reader.ReadString();
+		if (name.Compare(func == nullptr ? "" : func->PrintableName))
+		{
+			DPrintf(DMSG_NOTIFY, "Script code cache: function list changed\n");
+			return false;
+		}
+	}
+
+	TArray<FLookup> lookups(reader.ReadCount(0x1000000), true);
+	for (auto &lookup : lookups)
+	{
+		lookup.Kind = (ELookup)reader.ReadByte();
+		lookup.Name = reader.ReadString();
+		lookup.Value = (int)reader.ReadLong();
+	}
+	if (reader.Failed) return false;
+	for (auto &lookup : lookups)
+	{
+		if (DoLookup(lookup.Kind, lookup.Name.GetChars()) != lookup.Value)
+		{
+			DPrintf(DMSG_NOTIFY, "Script code cache: value of '%s' changed\n", lookup.Name.GetChars());
+			return false;
+		}
+	}
+
+	TArray<FString> names(reader.ReadCount(0x1000000), true);
+	for (auto &name : names) name = reader.ReadString();
+	TArray<FString> records(reader.ReadCount(0x1000000), true);
+	for (auto &record : records) record = reader.ReadString();
+	if (reader.Failed) return false;
+
+	FunctionsByName.Clear();
+	for (auto func : VMFunction::AllFunctions)
+	{
+		FunctionsByName[func->QualifiedName ? func->QualifiedName : ""].Push(func);
+	}
+
+	TArray<FCachedFunction> cached(Functions.Size(), true);
+	for (unsigned i = 0; i < Functions.Size(); i++)
+	{
+		if (Functions[i] == nullptr) continue;
+		if (!ReadFunction(reader, cached[i]))
+		{
+			DPrintf(DMSG_NOTIFY, "Script code cache: could not restore %s\n", Functions[i]->PrintableName);
+			FunctionsByName.Clear();
+			return false;
+		}
+	}
+	FunctionsByName.Clear();
+
+	// From here on the global state gets changed, if this fails the cache must not be written again.
+	for (unsigned i = 0; i < names.Size(); i++)
+	{
+		if (FName(names[i]).GetIndex() != FirstName + (int)i)
+		{
+			Tainted = true;
+			return false;
+		}
+	}
+	if (compileEnvironment.CacheReplayBuildRecords != nullptr && !compileEnvironment.CacheReplayBuildRecords(records))
+	{
+		Tainted = true;
+		return false;
+	}
+	else if (compileEnvironment.CacheReplayBuildRecords == nullptr && records.Size() > 0)
+	{
+		return false;
+	}
+
+	for (unsigned i = 0; i < Functions.Size(); i++)
+	{
+		if (Functions[i] != nullptr) InstallFunction(Functions[i], cached[i]);
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// Save
+//
+//==========================================================================
+
+static void Save()
+{
+	MemFile data;
+	WriteLong(data, FirstName);
+	WriteBytes(data, NamesDigest, 16);
+	WriteString(data, GameFingerprint.GetChars());
+
+	WriteLong(data, Functions.Size());
+	for (auto func : Functions)
+	{
+		WriteString(data, func == nullptr ? "" : func->PrintableName);
+	}
+
+	WriteLong(data, Lookups.Size());
+	for (auto &lookup : Lookups)
+	{
+		WriteByte(data, lookup.Kind);
+		WriteString(data, lookup.Name.GetChars());
+		WriteLong(data, lookup.Value);
+	}
+
+	int numnames = FName::GetNumNames();
+	WriteLong(data, numnames - FirstName);
+	for (int i = FirstName; i < numnames; i++)
+	{
+		WriteString(data, FName((ENamedName)i).GetChars());
+	}
+
+	TArray<FString> records;
+	if (compileEnvironment.CacheGetBuildRecords != nullptr && !compileEnvironment.CacheGetBuildRecords(records)) return;
+	WriteLong(data, records.Size());
+	for (auto &record : records) WriteString(data, record.GetChars());
+
+	BuildAddressMap();
+	for (unsigned i = 0; i < Functions.Size(); i++)
+	{
+		// Functions that failed to compile were reported as errors so there should not be any here.
+		if (Functions[i] != nullptr && (Functions[i]->Code == nullptr || !WriteFunction(data, Functions[i], Anonymous[i])))
+		{
+			Addresses.Clear();
+			return;
+		}
+	}
+	Addresses.Clear();
+
+	uLongf outlen = compressBound(data.Size());
+	TArray<uint8_t> compressed(unsigned(outlen + HEADER_SIZE), true);
+	if (compress(compressed.Data() + HEADER_SIZE, &outlen, data.Data(), data.Size()) != Z_OK) return;
+
+	memcpy(compressed.Data(), "ZVMC", 4);
+	uint32_t header[2] = { LittleLong((uint32_t)CACHE_VERSION), LittleLong(data.Size()) };
+	memcpy(&compressed[4], &header[0], 4);
+	memcpy(&compressed[8], Key, 16);
+	memcpy(&compressed[24], &header[1], 4);
+
+	FString path = CacheFileName(true);
+	FileWriter *fw = FileWriter::Open(path.GetChars());
+	if (fw != nullptr)
+	{
+		const size_t length = outlen + HEADER_SIZE;
+		if (fw->Write(compressed.Data(), length) != length)
+		{
+			Printf("Error saving script code to file %s\n", path.GetChars());
+		}
+		delete fw;
+	}
+	else
+	{
+		Printf("Cannot open script code cache %s for writing\n", path.GetChars());
+	}
+}
+
+//==========================================================================
+//
+// VMCache :: Begin
+//
+//==========================================================================
+
+bool Begin(const TArray<VMScriptFunction *> &functions, const TArray<int> &lumps)
+{
+	TArray<int> sources = std::move(SourceLumps);
+	SourceLumps.Clear();
+
+	Active = vm_cache && FScriptPosition::ErrorCounter == 0;
+	Restored = Tainted = false;
+	Blobs.Clear();
+	if (!Active) return false;
+
+	uint64_t start = I_msTime();
+	InitBasicTypes();
+	MakeKey(lumps, sources, Key);
+	FirstName = FName::GetNumNames();
+	HashNames(FirstName, NamesDigest);
+	GameFingerprint = "";
+	if (compileEnvironment.CacheBeginBuild != nullptr) compileEnvironment.CacheBeginBuild(GameFingerprint);
+
+	Functions = functions;
+	Anonymous.Resize(Functions.Size());
+	for (unsigned i = 0; i < Functions.Size(); i++)
+	{
+		Anonymous[i] = Functions[i] != nullptr && Functions[i]->Proto == nullptr;
+	}
+
+	Restored = Load();
+	DPrintf(DMSG_NOTIFY, "Script code cache: %s after %llu ms\n", Restored ? "restored all functions" : "miss", (unsigned long long)(I_msTime() - start));
+	return Restored;
+}
+
+//==========================================================================
+//
+// VMCache :: End
+//
+//==========================================================================
+
+void End(bool success)
+{
+	if (Active && success && !Restored && !Tainted)
+	{
+		uint64_t start = I_msTime();
+		Save();
+		DPrintf(DMSG_NOTIFY, "Script code cache: written in %llu ms\n", (unsigned long long)(I_msTime() - start));
+	}
+	Active = false;
+	Functions.Reset();
+	Anonymous.Reset();
+	Blobs.Clear();
+	Lookups.Reset();
+}
+
+//==========================================================================
+//
+// VMCache :: NoteBlob
+//
+//==========================================================================
+
+void NoteBlob(const void *data, unsigned size)
+{
+	if (Active && !Restored)
+	{
+		auto &blob = Blobs[data];
+		blob.Resize(size);
+		memcpy(blob.Data(), data, size);
+	}
+}
+
+//==========================================================================
+//
+// VMCache :: NoteSourceLump
+//
+//==========================================================================
+
+void NoteSourceLump(int lump)
+{
+	SourceLumps.Push(lump);
+}
+
+//==========================================================================
+//
+// VMCache :: NoteLookup
+//
+// Lookups can happen before Begin while constants are being evaluated,
+// so they are collected until the compile ends.
+//
+//==========================================================================
+
+void NoteLookup(ELookup kind, const char *name, int value)
+{
+	for (auto &lookup : Lookups)
+	{
+		if (lookup.Kind == kind && lookup.Value == value && !lookup.Name.Compare(name)) return;
+	}
+	Lookups.Push({ kind, name, value });
+}
+
+}
+
+//==========================================================================
+//
+// CCMD clearvmcache
+//
+//==========================================================================
+
+UNSAFE_CCMD(clearvmcache)
+{
+	FileSys::FileList list;
+	FString path = M_GetCachePath(false);
+	path += "/vmcode/";
+
+	if (!FileSys::ScanDirectory(list, path.GetChars(), "*.zvc", true))
+	{
+		Printf("Unable to scan script code cache directory %s\n", path.GetChars());
+		return;
+	}
+	for (auto &entry : list)
+	{
+		if (!entry.isDirectory) RemoveFile(entry.FilePath.c_str());
+	}
+}
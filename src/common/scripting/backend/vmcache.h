@@ -0,0 +1,39 @@
+#pragma once
+
+#include "tarray.h"
+
+class VMScriptFunction;
+
+//==========================================================================
+//
+// On-disk cache for the code FFunctionBuildList::Build generates.
+//
+// Begin is called with the list of functions about to be compiled and
+// returns true if all of them could be restored from the cache, in which
+// case code generation is skipped. End writes a new cache file after a
+// successful full compile.
+//
+//==========================================================================
+
+namespace VMCache
+{
+	bool Begin(const TArray<VMScriptFunction *> &functions, const TArray<int> &lumps);
+	void End(bool success);
+
+	// Data the code generator allocates for a function, which has to be saved along with the code.
+	void NoteBlob(const void *data, unsigned size);
+
+	// Called by the script parsers for every lump they read, so that its contents are part of the cache key.
+	void NoteSourceLump(int lump);
+
+	// Names the code generator turns into constants. Their values depend on data outside the script lumps.
+	enum ELookup : uint8_t
+	{
+		LOOKUP_Sound,
+		LOOKUP_Color,
+		LOOKUP_Translation,
+	};
+
+	// Remembers the value a name was resolved to, so that a cache built with a different value is not used.
+	void NoteLookup(ELookup kind, const char *name, int value);
+}
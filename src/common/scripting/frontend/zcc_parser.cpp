@@ -40,6 +40,7 @@
 #include "version.h"
 #include "zcc_parser.h"
 #include "zcc_compile.h"
+#include "vmcache.h"
 
 
 TArray<FString> Includes;
@@ -322,6 +323,7 @@ static void ParseSingleFile(FScanner *pSC, const char *filename, int lump, void
 	FScanner &sc = *pSC;
 	sc.SetParseVersion(state.ParseVersion);
 	state.sc = &sc;
+	VMCache::NoteSourceLump(sc.LumpNum);
 
 	while (sc.GetToken())
 	{
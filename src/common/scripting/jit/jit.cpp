@@ -1,7 +1,15 @@
 
+#include <mutex>
+#include <atomic>
+#include <thread>
 #include "jit.h"
 #include "jitintern.h"
 #include "printf.h"
+#include "c_cvars.h"
+#include "ctpl.h"
+
+CVAR(Int, vm_jit_threads, 0, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
+CVAR(Bool, vm_jit_optimize, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
 
 extern PString *TypeString;
 extern PStruct *TypeVector2;
@@ -11,6 +19,7 @@ extern PStruct* TypeQuaternion;
 extern PStruct* TypeFQuaternion;
 
 static void OutputJitLog(const asmjit::StringLogger &logger);
+static std::mutex JitLogMutex;
 
 JitFuncPtr JitCompile(VMScriptFunction *sfunc)
 {
@@ -34,12 +43,65 @@ JitFuncPtr JitCompile(VMScriptFunction *sfunc)
 	}
 	catch (const CRecoverableError &e)
 	{
+		std::lock_guard<std::mutex> lock(JitLogMutex);
 		OutputJitLog(logger);
 		Printf("%s: Unexpected JIT error: %s\n",sfunc->PrintableName, e.what());
 		return nullptr;
 	}
 }
 
+//==========================================================================
+//
+// JitCompile
+//
+// Compiles a list of functions on all cores. Each function is translated
+// independently, only placing the finished code in executable memory is
+// serialized, so the result is the same as compiling them one by one.
+//
+//==========================================================================
+
+void JitCompile(const TArray<VMScriptFunction *> &funcs, TArray<JitFuncPtr> &results)
+{
+	results.Resize(funcs.Size());
+
+	int numthreads = vm_jit_threads > 0 ? *vm_jit_threads : int(std::thread::hardware_concurrency());
+	numthreads = clamp<int>(numthreads, 1, 64);
+	if (numthreads == 1 || funcs.Size() < 64)
+	{
+		for (unsigned i = 0; i < funcs.Size(); i++) results[i] = JitCompile(funcs[i]);
+		return;
+	}
+
+	// Must be set up before the workers start.
+	GetHostCodeInfo();
+
+	ctpl::thread_pool pool(numthreads - 1);
+	std::atomic<unsigned> next{ 0 };
+	auto worker = [&](int)
+	{
+		const unsigned batch = 16;
+		for (unsigned first; (first = next.fetch_add(batch)) < funcs.Size();)
+		{
+			const unsigned last = min(first + batch, funcs.Size());
+			for (unsigned i = first; i < last; i++)
+			{
+				results[i] = JitCompile(funcs[i]);
+			}
+		}
+	};
+
+	TArray<std::future<void>> futures;
+	for (int i = 0; i < numthreads - 1; i++)
+	{
+		futures.Push(pool.push(worker));
+	}
+	worker(0);
+	for (auto &f : futures)
+	{
+		f.get();
+	}
+}
+
 void JitDumpLog(FILE *file, VMScriptFunction *sfunc)
 {
 	using namespace asmjit;
@@ -98,7 +160,7 @@ static void OutputJitLog(const asmjit::StringLogger &logger)
 
 /////////////////////////////////////////////////////////////////////////////
 
-static const char *OpNames[NUM_OPS] =
+const char *OpNames[NUM_OPS] =
 {
 #define xx(op, name, mode, alt, kreg, ktype)	#op,
 #include "vmops.h"
@@ -109,6 +171,14 @@ asmjit::CCFunc *JitCompiler::Codegen()
 {
 	Setup();
 
+	optimize = vm_jit_optimize;
+	if (optimize)
+	{
+		FindJumpTargets();
+		knownNonNull.Resize(sfunc->NumRegA);
+		ClearKnownNonNull();
+	}
+
 	int lastLine = -1;
 
 	pc = sfunc->Code;
@@ -142,7 +212,10 @@ asmjit::CCFunc *JitCompiler::Codegen()
 
 		labels[i].cursor = cc.getCursor();
 		ResetTemp();
+		if (optimize && jumpTargets[i]) ClearKnownNonNull();
+		const VMOP *start = pc;
 		EmitOpcode();
+		if (optimize) UpdateKnownNonNull(start);
 
 		pc++;
 	}
@@ -186,6 +259,64 @@ void JitCompiler::EmitOpcode()
 	}
 }
 
+//==========================================================================
+//
+// Null check elimination
+//
+// Within a basic block an address register only needs to be checked for
+// null once, until an instruction writes to it again. Everything that can
+// be jumped to starts a new block and forgets what has been checked.
+//
+//==========================================================================
+
+void JitCompiler::FindJumpTargets()
+{
+	jumpTargets.Resize(sfunc->CodeSize);
+	for (int i = 0; i < sfunc->CodeSize; i++) jumpTargets[i] = false;
+
+	for (int i = 0; i < sfunc->CodeSize; i++)
+	{
+		const VMOP *op = &sfunc->Code[i];
+		int target = -1;
+		if (op->op == OP_JMP) target = i + 1 + JMPOFS(op);
+		else if (op->op == OP_TEST || op->op == OP_TESTN) target = i + 2;
+
+		if (target >= 0 && target < sfunc->CodeSize) jumpTargets[target] = true;
+	}
+}
+
+void JitCompiler::ClearKnownNonNull()
+{
+	for (auto &known : knownNonNull) known = false;
+}
+
+void JitCompiler::UpdateKnownNonNull(const VMOP *start)
+{
+	switch (start->op)
+	{
+	case OP_CALL:
+	case OP_CALL_K:
+		// Results and out parameters can end up in any register.
+		ClearKnownNonNull();
+		return;
+
+	case OP_NULLCHECK:
+	case OP_SCOPE:
+		return;
+
+	default:
+		// Stores only read the address in A.
+		if (start->op >= OP_SB && start->op <= OP_SBIT) return;
+		break;
+	}
+
+	int amode = OpInfo[start->op].Mode & MODE_ATYPE;
+	if (amode == MODE_AP || amode == MODE_AX)
+	{
+		knownNonNull[start->a] = false;
+	}
+}
+
 void JitCompiler::BindLabels()
 {
 	asmjit::CBNode *cursor = cc.getCursor();
@@ -480,9 +611,14 @@ void JitCompiler::CreateRegisters()
 
 void JitCompiler::EmitNullPointerThrow(int index, EVMAbortException reason)
 {
+	if (optimize && knownNonNull[index])
+		return;
+
 	auto label = EmitThrowExceptionLabel(reason);
 	cc.test(regA[index], regA[index]);
 	cc.je(label);
+
+	if (optimize) knownNonNull[index] = true;
 }
 
 void JitCompiler::ThrowException(int reason)
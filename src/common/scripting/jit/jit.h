@@ -4,5 +4,6 @@
 #include "vmintern.h"
 
 JitFuncPtr JitCompile(VMScriptFunction *func);
+void JitCompile(const TArray<VMScriptFunction *> &funcs, TArray<JitFuncPtr> &results);
 void JitDumpLog(FILE *file, VMScriptFunction *func);
 FString JitCaptureStackTrace(int framesToSkip, bool includeNativeFrames, int maxFrames = -1);
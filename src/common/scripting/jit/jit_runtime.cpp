@@ -1,5 +1,6 @@
 
 #include <memory>
+#include <mutex>
 #include "jit.h"
 #include "jitintern.h"
 
@@ -44,6 +45,9 @@ asmjit::CodeInfo GetHostCodeInfo()
 	return codeInfo;
 }
 
+// Guards the code blocks and the debug info when functions are compiled in parallel.
+static std::mutex JitMemoryMutex;
+
 static void *AllocJitMemory(size_t size)
 {
 	using namespace asmjit;
@@ -274,6 +278,7 @@ void *AddJitFunction(asmjit::CodeHolder* code, JitCompiler *compiler)
 
 	codeSize = (codeSize + 15) / 16 * 16;
 
+	std::lock_guard<std::mutex> lock(JitMemoryMutex);
 	uint8_t *p = (uint8_t *)AllocJitMemory(codeSize + unwindInfoSize + functionTableSize);
 	if (!p)
 		return nullptr;
@@ -665,6 +670,7 @@ void *AddJitFunction(asmjit::CodeHolder* code, JitCompiler *compiler)
 
 	codeSize = (codeSize + 15) / 16 * 16;
 
+	std::lock_guard<std::mutex> lock(JitMemoryMutex);
 	uint8_t *p = (uint8_t *)AllocJitMemory(codeSize + unwindInfoSize);
 	if (!p)
 		return nullptr;
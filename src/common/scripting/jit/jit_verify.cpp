@@ -0,0 +1,377 @@
+/*
+** jit_verify.cpp
+**
+** Runs single VM instructions through both the interpreter and the JIT
+** and reports every input for which the results differ. This is meant for
+** checking a JIT code generator against vmexec.h, one opcode at a time.
+**
+** Usage: jitverify [opcode name]
+**
+*/
+
+#include "jitintern.h"
+#include "c_dispatch.h"
+#include "printf.h"
+
+enum EVerifyKind
+{
+	VK_IntBinary,		// dA = dB op dC, B and C may be constants
+	VK_IntDivide,		// as above, but the divisor must not be 0
+	VK_IntShift,		// the shift count must be 0-31
+	VK_IntImmediate,	// dA = dB op C, C is a signed 8 bit immediate
+	VK_IntUnary,		// dA = op dB
+	VK_IntCompare,		// if ((dB op dC) != A) then pc++
+	VK_FloatBinary,		// fA = fB op fC, B and C may be constants
+	VK_FloatDivide,		// as above, but the divisor must not be 0
+	VK_FloatUnary,		// fA = op(fB), function selected by C
+	VK_FloatCompare,	// if ((fB op fC) != (A & 1)) then pc++
+};
+
+struct FVerifyOp
+{
+	int Op;
+	EVerifyKind Kind;
+};
+
+static const FVerifyOp VerifyOps[] =
+{
+	{ OP_ADD_RR, VK_IntBinary },	{ OP_ADD_RK, VK_IntBinary },
+	{ OP_SUB_RR, VK_IntBinary },	{ OP_SUB_RK, VK_IntBinary },	{ OP_SUB_KR, VK_IntBinary },
+	{ OP_MUL_RR, VK_IntBinary },	{ OP_MUL_RK, VK_IntBinary },
+	{ OP_DIV_RR, VK_IntDivide },	{ OP_DIV_RK, VK_IntDivide },	{ OP_DIV_KR, VK_IntDivide },
+	{ OP_DIVU_RR, VK_IntDivide },	{ OP_DIVU_RK, VK_IntDivide },	{ OP_DIVU_KR, VK_IntDivide },
+	{ OP_MOD_RR, VK_IntDivide },	{ OP_MOD_RK, VK_IntDivide },	{ OP_MOD_KR, VK_IntDivide },
+	{ OP_MODU_RR, VK_IntDivide },	{ OP_MODU_RK, VK_IntDivide },	{ OP_MODU_KR, VK_IntDivide },
+	{ OP_AND_RR, VK_IntBinary },	{ OP_AND_RK, VK_IntBinary },
+	{ OP_OR_RR, VK_IntBinary },		{ OP_OR_RK, VK_IntBinary },
+	{ OP_XOR_RR, VK_IntBinary },	{ OP_XOR_RK, VK_IntBinary },
+	{ OP_MIN_RR, VK_IntBinary },	{ OP_MIN_RK, VK_IntBinary },
+	{ OP_MAX_RR, VK_IntBinary },	{ OP_MAX_RK, VK_IntBinary },
+	{ OP_MINU_RR, VK_IntBinary },	{ OP_MINU_RK, VK_IntBinary },
+	{ OP_MAXU_RR, VK_IntBinary },	{ OP_MAXU_RK, VK_IntBinary },
+	{ OP_SLL_RR, VK_IntShift },		{ OP_SLL_RI, VK_IntShift },		{ OP_SLL_KR, VK_IntShift },
+	{ OP_SRL_RR, VK_IntShift },		{ OP_SRL_RI, VK_IntShift },		{ OP_SRL_KR, VK_IntShift },
+	{ OP_SRA_RR, VK_IntShift },		{ OP_SRA_RI, VK_IntShift },		{ OP_SRA_KR, VK_IntShift },
+	{ OP_ADDI, VK_IntImmediate },
+	{ OP_ABS, VK_IntUnary },		{ OP_NEG, VK_IntUnary },		{ OP_NOT, VK_IntUnary },
+	{ OP_EQ_R, VK_IntCompare },		{ OP_EQ_K, VK_IntCompare },
+	{ OP_LT_RR, VK_IntCompare },	{ OP_LT_RK, VK_IntCompare },	{ OP_LT_KR, VK_IntCompare },
+	{ OP_LE_RR, VK_IntCompare },	{ OP_LE_RK, VK_IntCompare },	{ OP_LE_KR, VK_IntCompare },
+	{ OP_LTU_RR, VK_IntCompare },	{ OP_LTU_RK, VK_IntCompare },	{ OP_LTU_KR, VK_IntCompare },
+	{ OP_LEU_RR, VK_IntCompare },	{ OP_LEU_RK, VK_IntCompare },	{ OP_LEU_KR, VK_IntCompare },
+
+	{ OP_ADDF_RR, VK_FloatBinary },	{ OP_ADDF_RK, VK_FloatBinary },
+	{ OP_SUBF_RR, VK_FloatBinary },	{ OP_SUBF_RK, VK_FloatBinary },	{ OP_SUBF_KR, VK_FloatBinary },
+	{ OP_MULF_RR, VK_FloatBinary },	{ OP_MULF_RK, VK_FloatBinary },
+	{ OP_DIVF_RR, VK_FloatDivide },	{ OP_DIVF_RK, VK_FloatDivide },	{ OP_DIVF_KR, VK_FloatDivide },
+	{ OP_MODF_RR, VK_FloatDivide },	{ OP_MODF_RK, VK_FloatDivide },	{ OP_MODF_KR, VK_FloatDivide },
+	{ OP_POWF_RR, VK_FloatBinary },	{ OP_POWF_RK, VK_FloatBinary },	{ OP_POWF_KR, VK_FloatBinary },
+	{ OP_MINF_RR, VK_FloatBinary },	{ OP_MINF_RK, VK_FloatBinary },
+	{ OP_MAXF_RR, VK_FloatBinary },	{ OP_MAXF_RK, VK_FloatBinary },
+	{ OP_ATAN2, VK_FloatBinary },
+	{ OP_FLOP, VK_FloatUnary },
+	{ OP_EQF_R, VK_FloatCompare },	{ OP_EQF_K, VK_FloatCompare },
+	{ OP_LTF_RR, VK_FloatCompare },	{ OP_LTF_RK, VK_FloatCompare },	{ OP_LTF_KR, VK_FloatCompare },
+	{ OP_LEF_RR, VK_FloatCompare },	{ OP_LEF_RK, VK_FloatCompare },	{ OP_LEF_KR, VK_FloatCompare },
+};
+
+static const int IntValues[] = { 0, 1, -1, 2, 7, -13, 255, 65536, 12345678, INT_MAX, INT_MIN };
+static const int ShiftValues[] = { 0, 1, 5, 16, 31 };
+static const int ImmediateValues[] = { 0, 1, -1, 100, 127, -128 };
+static const double FloatValues[] = { 0., -0., 1., -1., 0.5, -2.5, 3.14159265358979, 90., 1e10, -1e-10, 1e300 };
+
+//==========================================================================
+//
+// The test function for one instruction. Arguments go to register 0 and 1,
+// the result is returned from register 2.
+//
+//==========================================================================
+
+struct FVerifyFunction
+{
+	VMScriptFunction *Func;
+	JitFuncPtr JitFunc;
+};
+
+static VMOP MakeOp(int op, int a, int b, int c)
+{
+	VMOP o;
+	o.word = 0;
+	o.op = op;
+	o.a = a;
+	o.b = b;
+	o.c = c;
+	return o;
+}
+
+// All test functions of a jitverify run share one VMScriptFunction, which
+// gets unregistered again when the run is done.
+enum { MAX_VERIFY_CODE = 5 };
+static VMScriptFunction *ScratchFunc;
+
+static FVerifyFunction CreateFunction(const FVerifyOp &vop, int a, int b, int c, int konstd, double konstf)
+{
+	static const uint8_t IntRegTypes[] = { REGT_INT, REGT_INT };
+	static const uint8_t FloatRegTypes[] = { REGT_FLOAT, REGT_FLOAT };
+
+	const bool floatargs = vop.Kind >= VK_FloatBinary;
+	const bool compare = vop.Kind == VK_IntCompare || vop.Kind == VK_FloatCompare;
+
+	TArray<VMOP> code;
+	if (compare)
+	{
+		// The result is 1 if the comparison takes the jump.
+		VMOP li = MakeOp(OP_LI, 2, 0, 0);
+		li.i16 = 1;
+		code.Push(li);
+		code.Push(MakeOp(vop.Op, a, b, c));
+		VMOP jmp = MakeOp(OP_JMP, 0, 0, 0);
+		jmp.i24 = 1;
+		code.Push(jmp);
+		code.Push(MakeOp(OP_LI, 2, 0, 0));
+		code.Push(MakeOp(OP_RET, RET_FINAL, REGT_INT, 2));
+	}
+	else
+	{
+		code.Push(MakeOp(vop.Op, 2, b, c));
+		code.Push(MakeOp(OP_RET, RET_FINAL, floatargs ? REGT_FLOAT : REGT_INT, 2));
+	}
+
+	auto func = ScratchFunc;
+	assert(code.Size() <= MAX_VERIFY_CODE);
+	memcpy(func->Code, code.Data(), code.Size() * sizeof(VMOP));
+	func->CodeSize = code.Size();
+	func->KonstD[0] = konstd;
+	func->KonstF[0] = konstf;
+	func->NumRegD = 3;
+	func->NumRegF = 3;
+	func->NumArgs = 2;
+	func->StackSize = VMFrame::FrameSize(func->NumRegD, func->NumRegF, 0, 0, 0, 0);
+	func->QualifiedName = func->PrintableName = OpNames[vop.Op];
+	func->RegTypes = floatargs ? FloatRegTypes : IntRegTypes;
+
+	PType *argtype = floatargs ? (PType *)TypeFloat64 : (PType *)TypeSInt32;
+	PType *rettype = floatargs && !compare ? (PType *)TypeFloat64 : (PType *)TypeSInt32;
+	TArray<PType *> args, rets;
+	args.Push(argtype);
+	args.Push(argtype);
+	rets.Push(rettype);
+	func->Proto = NewPrototype(rets, args);
+
+	return { func, JitCompile(func) };
+}
+
+//==========================================================================
+//
+// Running the test function
+//
+//==========================================================================
+
+static bool SameResult(int x, int y)
+{
+	return x == y;
+}
+
+static bool SameResult(double x, double y)
+{
+	return memcmp(&x, &y, sizeof(double)) == 0 || (x != x && y != y);
+}
+
+static FString ValueString(int v) { FString s; s.Format("%d", v); return s; }
+static FString ValueString(double v) { FString s; s.Format("%.17g", v); return s; }
+
+static int AsKonstD(int v) { return v; }
+static int AsKonstD(double v) { return 0; }
+static double AsKonstF(int v) { return 0.; }
+static double AsKonstF(double v) { return v; }
+
+template<typename T, typename R>
+static bool Run(const FVerifyFunction &vf, T b, T c, const char *details, int &errors)
+{
+	VMValue params[2] = { b, c };
+	R interp = 0, jit = 0;
+
+	VMReturn ret(&interp);
+	VMExec(vf.Func, params, 2, &ret, 1);
+
+	VMReturn jitret(&jit);
+	vf.JitFunc(vf.Func, params, 2, &jitret, 1);
+
+	if (!SameResult(interp, jit))
+	{
+		if (errors++ < 10)
+		{
+			Printf(TEXTCOLOR_RED "%s%s: %s, %s -> interpreter %s, JIT %s\n", vf.Func->PrintableName, details,
+				ValueString(b).GetChars(), ValueString(c).GetChars(), ValueString(interp).GetChars(), ValueString(jit).GetChars());
+		}
+		return false;
+	}
+	return true;
+}
+
+static bool ValidInput(EVerifyKind kind, int op, int b, int c)
+{
+	if (kind != VK_IntDivide) return true;
+	if (c == 0) return false;
+	return !(b == INT_MIN && c == -1 && (op == OP_DIV_RR || op == OP_DIV_RK || op == OP_DIV_KR || op == OP_MOD_RR || op == OP_MOD_RK || op == OP_MOD_KR));
+}
+
+static bool ValidInput(EVerifyKind kind, int op, double b, double c)
+{
+	return kind != VK_FloatDivide || c != 0.;
+}
+
+//==========================================================================
+//
+// VerifyOp
+//
+// Tries every combination of test values for the B and C operands. Values
+// that have to be encoded in the function (constants and immediates) each
+// get their own compiled function.
+//
+//==========================================================================
+
+template<typename T, typename R, size_t NV, size_t NC>
+static int VerifyOp(const FVerifyOp &vop, const T (&values)[NV], const int (&cvalues)[NC], const TArray<int> &aflags, int &tests)
+{
+	const int mode = OpInfo[vop.Op].Mode;
+	const int bmode = (mode & MODE_BTYPE) >> MODE_BSHIFT;
+	const int cmode = (mode & MODE_CTYPE) >> MODE_CSHIFT;
+	const bool bkonst = bmode == MODE_KI || bmode == MODE_KF;
+	const bool ckonst = cmode == MODE_KI || cmode == MODE_KF;
+	const bool cimm = cmode == MODE_IMMS || cmode == MODE_IMMZ;
+	const bool cunused = cmode == MODE_UNUSED;
+	const bool shift = vop.Kind == VK_IntShift;
+
+	int errors = 0;
+	for (int aflag : aflags)
+	{
+		FString details;
+		if (aflags.Size() > 1) details.Format(" (A = %d)", aflag);
+
+		if (bkonst || ckonst)
+		{
+			// One function per constant.
+			for (auto k : values)
+			{
+				if (ckonst && shift && (k < 0 || k > 31)) continue;
+
+				FVerifyFunction vf = CreateFunction(vop, aflag, 0, ckonst ? 0 : 1, AsKonstD(k), AsKonstF(k));
+				if (vf.JitFunc == nullptr) return ++errors;
+				for (auto v : values)
+				{
+					const T b = bkonst ? k : v, c = bkonst ? v : k;
+					if (bkonst && shift && (c < 0 || c > 31)) continue;
+					if (!ValidInput(vop.Kind, vop.Op, b, c)) continue;
+					tests++;
+					Run<T, R>(vf, b, c, details.GetChars(), errors);
+				}
+			}
+		}
+		else if (cimm)
+		{
+			// One function per immediate, C is only passed along for the report.
+			for (int imm : cvalues)
+			{
+				FVerifyFunction vf = CreateFunction(vop, aflag, 0, imm & 0xff, 0, 0.);
+				if (vf.JitFunc == nullptr) return ++errors;
+				FString immdetails;
+				immdetails.Format("%s (C = %d)", details.GetChars(), imm);
+				for (auto v : values)
+				{
+					tests++;
+					Run<T, R>(vf, v, T(0), immdetails.GetChars(), errors);
+				}
+			}
+		}
+		else
+		{
+			FVerifyFunction vf = CreateFunction(vop, aflag, 0, cunused ? 0 : 1, 0, 0.);
+			if (vf.JitFunc == nullptr) return ++errors;
+			for (auto b : values)
+			{
+				for (auto c : values)
+				{
+					if (cunused && c != values[0]) continue;
+					if (shift && (c < 0 || c > 31)) continue;
+					if (!ValidInput(vop.Kind, vop.Op, b, c)) continue;
+					tests++;
+					Run<T, R>(vf, b, c, details.GetChars(), errors);
+				}
+			}
+		}
+	}
+	return errors;
+}
+
+static int VerifyOp(const FVerifyOp &vop, int &tests)
+{
+	static const int FlopValues[] = { FLOP_ABS, FLOP_NEG, FLOP_EXP, FLOP_LOG, FLOP_LOG10, FLOP_SQRT, FLOP_CEIL, FLOP_FLOOR,
+		FLOP_ACOS, FLOP_ASIN, FLOP_ATAN, FLOP_COS, FLOP_SIN, FLOP_TAN,
+		FLOP_ACOS_DEG, FLOP_ASIN_DEG, FLOP_ATAN_DEG, FLOP_COS_DEG, FLOP_SIN_DEG, FLOP_TAN_DEG,
+		FLOP_COSH, FLOP_SINH, FLOP_TANH, FLOP_ROUND };
+
+	TArray<int> aflags;
+	aflags.Push(0);
+	if (vop.Kind == VK_IntCompare || vop.Kind == VK_FloatCompare) aflags.Push(CMP_CHECK);
+	// Only the equality compares look at CMP_APPROX.
+	if (vop.Op == OP_EQF_R || vop.Op == OP_EQF_K)
+	{
+		aflags.Push(CMP_APPROX);
+		aflags.Push(CMP_CHECK | CMP_APPROX);
+	}
+
+	switch (vop.Kind)
+	{
+	case VK_IntShift:
+		return VerifyOp<int, int>(vop, IntValues, ShiftValues, aflags, tests);
+
+	case VK_IntImmediate:
+		return VerifyOp<int, int>(vop, IntValues, ImmediateValues, aflags, tests);
+
+	case VK_FloatUnary:
+		return VerifyOp<double, double>(vop, FloatValues, FlopValues, aflags, tests);
+
+	case VK_FloatCompare:
+		return VerifyOp<double, int>(vop, FloatValues, ImmediateValues, aflags, tests);
+
+	case VK_FloatBinary:
+	case VK_FloatDivide:
+		return VerifyOp<double, double>(vop, FloatValues, ImmediateValues, aflags, tests);
+
+	default:
+		return VerifyOp<int, int>(vop, IntValues, ImmediateValues, aflags, tests);
+	}
+}
+
+//==========================================================================
+//
+// CCMD jitverify
+//
+//==========================================================================
+
+CCMD(jitverify)
+{
+	const char *filter = argv.argc() > 1 ? argv[1] : nullptr;
+	int tests = 0, failed = 0, ops = 0;
+
+	ScratchFunc = new VMScriptFunction(NAME_None);
+	ScratchFunc->Alloc(MAX_VERIFY_CODE, 1, 1, 0, 0, 0);
+
+	for (auto &vop : VerifyOps)
+	{
+		if (filter != nullptr && stricmp(filter, OpNames[vop.Op]) != 0) continue;
+
+		ops++;
+		if (VerifyOp(vop, tests) > 0)
+		{
+			Printf(TEXTCOLOR_RED "%s: JIT result differs from the interpreter\n", OpNames[vop.Op]);
+			failed++;
+		}
+	}
+
+	VMFunction::AllFunctions.Delete(VMFunction::AllFunctions.Find(ScratchFunc));
+	delete ScratchFunc;
+	ScratchFunc = nullptr;
+	Printf("%d opcodes checked with %d inputs, %d failed\n", ops, tests, failed);
+}
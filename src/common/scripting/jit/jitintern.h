@@ -15,6 +15,7 @@
 
 extern cycle_t VMCycles[10];
 extern int VMCalls[10];
+extern const char *OpNames[NUM_OPS];
 
 #define A				(pc[0].a)
 #define B				(pc[0].b)
@@ -58,6 +59,9 @@ private:
 	void SetupFullVMFrame();
 	void BindLabels();
 	void EmitOpcode();
+	void FindJumpTargets();
+	void UpdateKnownNonNull(const VMOP *start);
+	void ClearKnownNonNull();
 	void EmitPopFrame();
 
 	void EmitNativeCall(VMNativeFunction *target);
@@ -311,6 +315,11 @@ private:
 
 	TArray<OpcodeLabel> labels;
 
+	// Null check elimination: address registers that have already been checked in the current basic block.
+	bool optimize = false;
+	TArray<bool> jumpTargets;
+	TArray<bool> knownNonNull;
+
 	// Get temporary storage enough for DVector4 which is required by operation such as MULQQ and MULQV3
 	bool vectorStackAllocated = false;
 	asmjit::X86Mem vectorStack;
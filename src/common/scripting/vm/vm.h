@@ -57,6 +57,7 @@ extern FMemArena ClassDataAllocator;
 #define MAX_TRY_DEPTH	8	// Maximum number of nested TRYs in a single function
 
 void JitRelease();
+void VMProfilerRelease();
 
 extern void (*VM_CastSpriteIDToString)(FString* a, unsigned int b);
 
@@ -481,6 +482,7 @@ public:
 		AllFunctions.Clear();
 		// also release any JIT data
 		JitRelease();
+		VMProfilerRelease();
 	}
 	static void CreateRegUseInfo()
 	{
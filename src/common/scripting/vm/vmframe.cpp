@@ -59,6 +59,9 @@ CUSTOM_CVAR(Bool, vm_jit_aot, true, CVAR_NOINITCALL)
 	Printf("You must restart " GAMENAME " for this change to take effect.\n");
 	Printf("This cvar is currently not saved. You must specify it on the command line.");
 }
+
+// Number of calls a function runs in the interpreter before it gets compiled. 0 compiles on the first call.
+CVAR(Int, vm_jit_threshold, 0, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
 #else
 CVAR(Bool, vm_jit, false, CVAR_NOINITCALL|CVAR_NOSET)
 CVAR(Bool, vm_jit_aot, false, CVAR_NOINITCALL|CVAR_NOSET)
@@ -309,6 +312,43 @@ void VMScriptFunction::JitCompile()
 	}
 }
 
+//==========================================================================
+//
+// VMScriptFunction :: JitCompileAll
+//
+// Ahead of time compilation for a whole list of functions. The native code
+// is generated in parallel but installed in list order.
+//
+//==========================================================================
+
+void VMScriptFunction::JitCompileAll(const TArray<VMScriptFunction *> &funcs)
+{
+#ifdef HAVE_VM_JIT
+	if (vm_jit)
+	{
+		TArray<VMScriptFunction *> jitfuncs;
+		for (auto func : funcs)
+		{
+			if (func->VarFlags & VARF_Abstract) continue;
+			if (CanJit(func)) jitfuncs.Push(func);
+			else func->ScriptCall = VMExec;
+		}
+
+		TArray<JitFuncPtr> results;
+		::JitCompile(jitfuncs, results);
+		for (unsigned i = 0; i < jitfuncs.Size(); i++)
+		{
+			jitfuncs[i]->ScriptCall = results[i] ? results[i] : VMExec;
+		}
+		return;
+	}
+#endif // HAVE_VM_JIT
+	for (auto func : funcs)
+	{
+		func->JitCompile();
+	}
+}
+
 int VMScriptFunction::FirstScriptCall(VMFunction *func, VMValue *params, int numparams, VMReturn *ret, int numret)
 {
 	// [Player701] Check that we aren't trying to call an abstract function.
@@ -319,7 +359,15 @@ int VMScriptFunction::FirstScriptCall(VMFunction *func, VMValue *params, int num
 		ThrowAbortException(X_OTHER, "attempt to call abstract function %s.", func->PrintableName);
 	}
 	
-	static_cast<VMScriptFunction*>(func)->JitCompile();
+	auto sfunc = static_cast<VMScriptFunction*>(func);
+#ifdef HAVE_VM_JIT
+	// Cold functions stay in the interpreter, ScriptCall keeps pointing here so the calls get counted.
+	if (vm_jit && ++sfunc->CallCount <= (unsigned)max<int>(*vm_jit_threshold, 0))
+	{
+		return VMExec(func, params, numparams, ret, numret);
+	}
+#endif
+	sfunc->JitCompile();
 
 	return func->ScriptCall(func, params, numparams, ret, numret);
 }
@@ -475,6 +475,8 @@ public:
 	TArray<FTypeAndOffset> SpecialInits;	// list of all contents on the extra stack which require construction and destruction
 
 	bool blockJit = false; // function triggers Jit bugs, block compilation until bugs are fixed
+	unsigned CallCount = 0; // calls made through the interpreter before the function got compiled
+	JitFuncPtr UnprofiledCall = nullptr; // the actual ScriptCall while the profiler is running
 
 	void InitExtra(void *addr);
 	void DestroyExtra(void *addr);
@@ -484,5 +486,6 @@ public:
 private:
 	static int FirstScriptCall(VMFunction *func, VMValue *params, int numparams, VMReturn *ret, int numret);
 	void JitCompile();
+	static void JitCompileAll(const TArray<VMScriptFunction *> &funcs);
 	friend class FFunctionBuildList;
 };
@@ -0,0 +1,347 @@
+/*
+** vmprofile.cpp
+**
+** Call tree profiler for script functions
+**
+**---------------------------------------------------------------------------
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/
+**
+**---------------------------------------------------------------------------
+**
+** All calls to script functions, from native code, the interpreter and
+** JIT compiled code alike, go through VMFunction::ScriptCall. While the
+** profiler is running that pointer is replaced for every script function
+** with an entry that times the call and records it in a call tree, so
+** there is no cost at all when it is not in use.
+**
+** Usage: vmprofile start
+**        vmprofile stop [file]
+**
+** Stopping prints the functions with the highest exclusive time and writes
+** the call stacks in the folded format used by flamegraph tools, with the
+** exclusive time of each stack in microseconds.
+**
+*/
+
+#include "vmintern.h"
+#include "types.h"
+#include "v_text.h"
+#include "c_dispatch.h"
+#include "printf.h"
+#include "files.h"
+#include "stats.h"
+
+struct FProfileNode
+{
+	VMScriptFunction *Func;
+	int Parent;
+	int FirstChild;
+	int NextSibling;
+	unsigned Calls;
+	cycle_t Time;
+};
+
+static bool Profiling;
+static unsigned ProfileGeneration;
+static TArray<FProfileNode> ProfileNodes;
+static int CurrentNode;
+
+// Only calls made on the thread that started the profiler are recorded.
+static thread_local bool ProfilerThread;
+
+//==========================================================================
+//
+// Call tree
+//
+//==========================================================================
+
+static void ClearProfile()
+{
+	ProfileNodes.Clear();
+	FProfileNode &root = ProfileNodes[ProfileNodes.Reserve(1)];
+	root = {};
+	root.Parent = root.FirstChild = root.NextSibling = -1;
+	root.Time.Reset();
+	CurrentNode = 0;
+	ProfileGeneration++;
+}
+
+static int EnterNode(VMScriptFunction *func)
+{
+	int node = ProfileNodes[CurrentNode].FirstChild;
+	while (node >= 0 && ProfileNodes[node].Func != func)
+	{
+		node = ProfileNodes[node].NextSibling;
+	}
+
+	if (node < 0)
+	{
+		node = ProfileNodes.Reserve(1);
+		FProfileNode &n = ProfileNodes[node];
+		n.Func = func;
+		n.Parent = CurrentNode;
+		n.FirstChild = -1;
+		n.NextSibling = ProfileNodes[CurrentNode].FirstChild;
+		n.Calls = 0;
+		n.Time.Reset();
+		ProfileNodes[CurrentNode].FirstChild = node;
+	}
+
+	ProfileNodes[node].Calls++;
+	ProfileNodes[node].Time.Clock();
+	CurrentNode = node;
+	return node;
+}
+
+static void LeaveNode(int node)
+{
+	ProfileNodes[node].Time.Unclock();
+	CurrentNode = ProfileNodes[node].Parent;
+}
+
+struct FProfileScope
+{
+	int Node;
+	unsigned Generation;
+
+	FProfileScope(VMScriptFunction *func)
+	{
+		Node = Profiling ? EnterNode(func) : -1;
+		Generation = ProfileGeneration;
+	}
+
+	// Also runs when the call is left through an exception.
+	~FProfileScope()
+	{
+		if (Node >= 0 && Profiling && Generation == ProfileGeneration) LeaveNode(Node);
+	}
+};
+
+//==========================================================================
+//
+// ProfiledCall
+//
+// Replaces ScriptCall while the profiler is running.
+//
+//==========================================================================
+
+static int ProfiledCall(VMFunction *func, VMValue *params, int numparams, VMReturn *ret, int numret)
+{
+	auto sfunc = static_cast<VMScriptFunction *>(func);
+	auto call = sfunc->UnprofiledCall;
+	if (!ProfilerThread)
+	{
+		return call(func, params, numparams, ret, numret);
+	}
+
+	int result;
+	{
+		FProfileScope scope(sfunc);
+		result = call(func, params, numparams, ret, numret);
+	}
+
+	// The first call replaces ScriptCall with the compiled code, put the profiler back in front of it.
+	if (Profiling && sfunc->ScriptCall != ProfiledCall)
+	{
+		sfunc->UnprofiledCall = sfunc->ScriptCall;
+		sfunc->ScriptCall = ProfiledCall;
+	}
+	return result;
+}
+
+//==========================================================================
+//
+// Starting and stopping
+//
+//==========================================================================
+
+static void StartProfiling()
+{
+	if (Profiling) return;
+
+	ClearProfile();
+	for (auto func : VMFunction::AllFunctions)
+	{
+		if (func->VarFlags & VARF_Native) continue;
+		auto sfunc = static_cast<VMScriptFunction *>(func);
+		sfunc->UnprofiledCall = sfunc->ScriptCall;
+		sfunc->ScriptCall = ProfiledCall;
+	}
+	ProfilerThread = true;
+	Profiling = true;
+}
+
+static void StopProfiling()
+{
+	if (!Profiling) return;
+
+	for (auto func : VMFunction::AllFunctions)
+	{
+		if (func->VarFlags & VARF_Native) continue;
+		auto sfunc = static_cast<VMScriptFunction *>(func);
+		if (sfunc->ScriptCall == ProfiledCall)
+		{
+			sfunc->ScriptCall = sfunc->UnprofiledCall;
+		}
+		sfunc->UnprofiledCall = nullptr;
+	}
+	ProfilerThread = false;
+	Profiling = false;
+}
+
+//==========================================================================
+//
+// VMProfilerRelease
+//
+// The call tree refers to the functions, so it cannot outlive them.
+//
+//==========================================================================
+
+void VMProfilerRelease()
+{
+	StopProfiling();
+	ProfileNodes.Reset();
+}
+
+//==========================================================================
+//
+// Reports
+//
+//==========================================================================
+
+static double ExclusiveTime(int node)
+{
+	double time = ProfileNodes[node].Time.TimeMS();
+	for (int child = ProfileNodes[node].FirstChild; child >= 0; child = ProfileNodes[child].NextSibling)
+	{
+		time -= ProfileNodes[child].Time.TimeMS();
+	}
+	return max(time, 0.);
+}
+
+static bool IsRecursive(int node)
+{
+	auto func = ProfileNodes[node].Func;
+	for (int parent = ProfileNodes[node].Parent; parent > 0; parent = ProfileNodes[parent].Parent)
+	{
+		if (ProfileNodes[parent].Func == func) return true;
+	}
+	return false;
+}
+
+static void PrintSummary(unsigned limit)
+{
+	struct FFunctionTotals
+	{
+		VMScriptFunction *Func;
+		unsigned Calls;
+		double Inclusive;
+		double Exclusive;
+	};
+
+	TMap<VMScriptFunction *, unsigned> index;
+	TArray<FFunctionTotals> totals;
+	for (unsigned i = 1; i < ProfileNodes.Size(); i++)
+	{
+		auto &node = ProfileNodes[i];
+		auto pos = index.CheckKey(node.Func);
+		if (pos == nullptr)
+		{
+			index[node.Func] = totals.Push({ node.Func, 0, 0., 0. });
+			pos = index.CheckKey(node.Func);
+		}
+		auto &total = totals[*pos];
+		total.Calls += node.Calls;
+		total.Exclusive += ExclusiveTime(i);
+		// Recursive calls are already contained in the outermost one.
+		if (!IsRecursive(i)) total.Inclusive += node.Time.TimeMS();
+	}
+
+	std::sort(totals.begin(), totals.end(), [](const FFunctionTotals &left, const FFunctionTotals &right)
+	{
+		return right.Exclusive < left.Exclusive;
+	});
+
+	Printf(TEXTCOLOR_YELLOW "Self, ms    Total, ms   Calls     Function\n");
+	Printf(TEXTCOLOR_YELLOW "----------  ----------  --------  --------------------\n");
+
+	const unsigned count = min(limit, totals.Size());
+	for (unsigned i = 0; i < count; i++)
+	{
+		auto &total = totals[i];
+		Printf("%10.4f  %10.4f  %8u  %s\n", total.Exclusive, total.Inclusive, total.Calls, total.Func->PrintableName);
+	}
+}
+
+static void WriteStack(FileWriter *fw, int node, FString &stack)
+{
+	const auto len = stack.Len();
+	if (node > 0)
+	{
+		FString name = ProfileNodes[node].Func->PrintableName;
+		name.ReplaceChars(';', ':');
+		if (len > 0) stack += ';';
+		stack += name;
+
+		auto us = (long long)(ExclusiveTime(node) * 1000.);
+		if (us > 0) fw->Printf("%s %lld\n", stack.GetChars(), us);
+	}
+
+	for (int child = ProfileNodes[node].FirstChild; child >= 0; child = ProfileNodes[child].NextSibling)
+	{
+		WriteStack(fw, child, stack);
+	}
+	stack.Truncate(len);
+}
+
+//==========================================================================
+//
+// CCMD vmprofile
+//
+//==========================================================================
+
+CCMD(vmprofile)
+{
+	if (argv.argc() >= 2 && !stricmp(argv[1], "start"))
+	{
+		StartProfiling();
+		Printf("Script profiling started\n");
+		return;
+	}
+	if (argv.argc() >= 2 && !stricmp(argv[1], "stop"))
+	{
+		if (!Profiling)
+		{
+			Printf("Script profiling is not running\n");
+			return;
+		}
+		StopProfiling();
+		PrintSummary(25);
+
+		const char *filename = argv.argc() >= 3 ? argv[2] : "vmprofile.folded";
+		FileWriter *fw = FileWriter::Open(filename);
+		if (fw == nullptr)
+		{
+			Printf("Unable to write %s\n", filename);
+			return;
+		}
+		FString stack;
+		WriteStack(fw, 0, stack);
+		delete fw;
+		Printf("Call stacks written to %s\n", filename);
+		return;
+	}
+	Printf("Usage: vmprofile start\n       vmprofile stop [file]\n");
+}
@@ -34,6 +34,7 @@
 **
 */
 
+#include <mutex>
 #include "printf.h"
 #include "files.h"
 #include "filesystem.h"
@@ -429,8 +430,14 @@ FTextureBuffer FTexture::CreateTexBuffer(int translation, int flags)
 
 bool FTexture::DetermineTranslucency()
 {
+	// The hardware renderer's BSP worker threads can get here concurrently for the same texture.
+	static std::mutex translucencyMutex;
+	std::lock_guard<std::mutex> lock(translucencyMutex);
+	if (bTranslucent == -1)
+	{
 		// This will calculate all we need, so just discard the result.
 		CreateTexBuffer(0);
+	}
 	return !!bTranslucent;
 }
 
@@ -61,6 +61,7 @@
 #include "i_sound.h"
 #include "i_video.h"
 #include "g_game.h"
+#include "g_benchmark.h"
 #include "hu_stuff.h"
 #include "wi_stuff.h"
 #include "st_stuff.h"
@@ -1290,12 +1291,17 @@ void D_DoomLoop ()
 					D_DoAdvanceDemo ();
 				C_Ticker ();
 				M_Ticker ();
+				G_BenchmarkClock (BENCH_Ticker);
 				G_Ticker ();
+				G_BenchmarkUnclock (BENCH_Ticker);
 				// [RH] Use the consoleplayer's camera to update sounds
 				S_UpdateSounds (players[consoleplayer].camera);	// move positional sounds
 				gametic++;
 				maketic++;
+				G_BenchmarkClock (BENCH_GC);
 				GC::CheckGC ();
+				G_BenchmarkUnclock (BENCH_GC);
+				G_BenchmarkEndTic ();
 				Net_NewMakeTic ();
 			}
 			else
@@ -3315,7 +3321,7 @@ static int D_InitGame(const FIWADInfo* iwad_info, std::vector<std::string>& allw
 
 	int max_progress = TexMan.GuesstimateNumTextures();
 	int per_shader_progress = 0;//screen->GetShaderCount()? (max_progress / 10 / screen->GetShaderCount()) : 0;
-	bool nostartscreen = batchrun || restart || Args->CheckParm("-join") || Args->CheckParm("-host") || Args->CheckParm("-norun");
+	bool nostartscreen = batchrun || benchmarking || restart || Args->CheckParm("-join") || Args->CheckParm("-host") || Args->CheckParm("-norun");
 
 	if (GameStartupInfo.Type == FStartupInfo::DefaultStartup)
 	{
@@ -3807,6 +3813,7 @@ static int D_DoomMain_Internal (void)
 		}
 		Printf("\n");
 	}
+	G_BenchmarkInit();
 
 	Printf("%s version %s\n", GAMENAME, GetVersionString());
 
@@ -0,0 +1,219 @@
+/*
+** g_benchmark.cpp
+**
+** Headless playsim benchmark built on top of -timedemo
+**
+**---------------------------------------------------------------------------
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/
+**
+**---------------------------------------------------------------------------
+**
+** Usage: -benchmark <demo> [-benchreport <file.csv|file.json>]
+**
+** This plays back the demo exactly like -timedemo -nodraw -nosound and
+** records how long each game tic took, split into the same groups that
+** the 'think', 'sight' and 'gc' stats display. When the demo ends the
+** report is written and the engine exits normally.
+**
+*/
+
+#include "g_levellocals.h"
+#include "g_benchmark.h"
+#include "doomstat.h"
+#include "m_argv.h"
+#include "stats.h"
+#include "version.h"
+#include "cmdlib.h"
+#include "printf.h"
+#include "fs_files.h"
+#include "i_interface.h"
+#include "engineerrors.h"
+
+extern cycle_t ThinkCycles, SightCycles, ActionCycles;
+extern int ThinkCount;
+extern FString defdemoname;
+
+bool benchmarking;
+
+struct FBenchTic
+{
+	int gametic;
+	int thinkers;
+	float ticker;
+	float think;
+	float action;
+	float sight;
+	float gc;
+};
+
+static cycle_t BenchCycles[NUM_BENCH_PHASES];
+static TArray<FBenchTic> BenchTics;
+static FString BenchReport;
+
+//==========================================================================
+//
+// G_BenchmarkInit
+//
+// Must be called before sound and the start screen are set up so that
+// -benchmark can turn them off.
+//
+//==========================================================================
+
+void G_BenchmarkInit ()
+{
+	const char *v = Args->CheckValue("-benchmark");
+	if (v == nullptr) return;
+
+	benchmarking = true;
+	BenchReport = Args->CheckValue("-benchreport");
+	if (BenchReport.IsEmpty()) BenchReport = "benchmark.csv";
+
+	// Everything except the playsim is noise for this measurement.
+	if (!Args->CheckParm("-nodraw")) Args->AppendArg("-nodraw");
+	if (!Args->CheckParm("-nosound")) Args->AppendArg("-nosound");
+	if (!Args->CheckParm("-timedemo"))
+	{
+		Args->AppendArg("-timedemo");
+		Args->AppendArg(v);
+	}
+	BenchTics.Clear();
+}
+
+//==========================================================================
+//
+// G_BenchmarkClock / G_BenchmarkUnclock
+//
+//==========================================================================
+
+void G_BenchmarkClock (EBenchPhase phase)
+{
+	if (benchmarking) BenchCycles[phase].ResetAndClock();
+}
+
+void G_BenchmarkUnclock (EBenchPhase phase)
+{
+	if (benchmarking) BenchCycles[phase].Unclock();
+}
+
+//==========================================================================
+//
+// G_BenchmarkEndTic
+//
+// Collects the timings of the tic that just ran. Only tics which actually
+// ran the playsim are recorded.
+//
+//==========================================================================
+
+void G_BenchmarkEndTic ()
+{
+	if (!benchmarking || !demoplayback || gamestate != GS_LEVEL) return;
+
+	FBenchTic &tic = BenchTics[BenchTics.Reserve(1)];
+	tic.gametic = gametic;
+	tic.thinkers = ThinkCount;
+	tic.ticker = (float)BenchCycles[BENCH_Ticker].TimeMS();
+	tic.think = (float)ThinkCycles.TimeMS();
+	tic.action = (float)ActionCycles.TimeMS();
+	tic.sight = (float)SightCycles.TimeMS();
+	tic.gc = (float)BenchCycles[BENCH_GC].TimeMS();
+}
+
+//==========================================================================
+//
+// WriteCSV / WriteJSON
+//
+//==========================================================================
+
+static void WriteCSV (FileWriter *fw)
+{
+	fw->Printf("gametic,thinkers,ticker_ms,think_ms,action_ms,sight_ms,gc_ms\n");
+	for (auto &tic : BenchTics)
+	{
+		fw->Printf("%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f\n", tic.gametic, tic.thinkers,
+			tic.ticker, tic.think, tic.action, tic.sight, tic.gc);
+	}
+}
+
+static void WriteJSON (FileWriter *fw, int gametics, int realtics)
+{
+	double total[5] = {}, peak[5] = {};
+	for (auto &tic : BenchTics)
+	{
+		const float v[5] = { tic.ticker, tic.think, tic.action, tic.sight, tic.gc };
+		for (int i = 0; i < 5; i++)
+		{
+			total[i] += v[i];
+			if (v[i] > peak[i]) peak[i] = v[i];
+		}
+	}
+	static const char *names[5] = { "ticker", "think", "action", "sight", "gc" };
+	const double count = max(1u, BenchTics.Size());
+
+	fw->Printf("{\n\t\"engine\": \"%s %s\",\n", GAMENAME, GetVersionString());
+	FString demoname = defdemoname;
+	FixPathSeperator(demoname);
+	fw->Printf("\t\"demo\": \"%s\",\n", demoname.GetChars());
+	fw->Printf("\t\"map\": \"%s\",\n", primaryLevel->MapName.GetChars());
+	fw->Printf("\t\"gametics\": %d,\n\t\"realtics\": %d,\n", gametics, realtics);
+	fw->Printf("\t\"tps\": %.2f,\n", realtics > 0 ? (double)gametics * TICRATE / realtics : 0.);
+	fw->Printf("\t\"summary\": {");
+	for (int i = 0; i < 5; i++)
+	{
+		fw->Printf("%s\n\t\t\"%s\": { \"avg_ms\": %.4f, \"max_ms\": %.4f, \"total_ms\": %.4f }",
+			i == 0 ? "" : ",", names[i], total[i] / count, peak[i], total[i]);
+	}
+	fw->Printf("\n\t},\n\t\"tics\": [");
+	for (unsigned i = 0; i < BenchTics.Size(); i++)
+	{
+		auto &tic = BenchTics[i];
+		fw->Printf("%s\n\t\t[%d, %d, %.4f, %.4f, %.4f, %.4f, %.4f]", i == 0 ? "" : ",", tic.gametic, tic.thinkers,
+			tic.ticker, tic.think, tic.action, tic.sight, tic.gc);
+	}
+	fw->Printf("\n\t],\n\t\"columns\": [\"gametic\", \"thinkers\", \"ticker_ms\", \"think_ms\", \"action_ms\", \"sight_ms\", \"gc_ms\"]\n}\n");
+}
+
+//==========================================================================
+//
+// G_BenchmarkFinish
+//
+// Called from G_CheckDemoStatus when a timed demo ends. Writes the report
+// and leaves the engine without the fatal error plain -timedemo uses.
+//
+//==========================================================================
+
+void G_BenchmarkFinish (int gametics, int realtics)
+{
+	if (!benchmarking) return;
+	benchmarking = false;
+
+	FileWriter *fw = FileWriter::Open(BenchReport.GetChars());
+	if (fw == nullptr)
+	{
+		I_FatalError("Unable to write benchmark report '%s'", BenchReport.GetChars());
+	}
+	if (BenchReport.Right(5).CompareNoCase(".json") == 0)
+	{
+		WriteJSON(fw, gametics, realtics);
+	}
+	else
+	{
+		WriteCSV(fw);
+	}
+	delete fw;
+
+	Printf("timed %i gametics in %i realtics (%.1f fps), report written to %s\n", gametics, realtics,
+		realtics > 0 ? (float)gametics / (float)realtics * (float)TICRATE : 0.f, BenchReport.GetChars());
+	throw CExitEvent(0);
+}
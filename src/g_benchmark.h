@@ -0,0 +1,21 @@
+#ifndef __G_BENCHMARK_H
+#define __G_BENCHMARK_H
+
+// Timed phases of a single game tic as seen from the main loop.
+enum EBenchPhase
+{
+	BENCH_Ticker,
+	BENCH_GC,
+
+	NUM_BENCH_PHASES
+};
+
+extern bool benchmarking;
+
+void G_BenchmarkInit ();
+void G_BenchmarkClock (EBenchPhase phase);
+void G_BenchmarkUnclock (EBenchPhase phase);
+void G_BenchmarkEndTic ();
+void G_BenchmarkFinish (int gametics, int realtics);
+
+#endif
@@ -82,6 +82,7 @@
 
 #include "v_video.h"
 #include "g_hub.h"
+#include "g_benchmark.h"
 #include "g_levellocals.h"
 #include "events.h"
 #include "c_buttons.h"
@@ -3133,6 +3134,8 @@ bool G_CheckDemoStatus (void)
 		{
 			if (timingdemo)
 			{
+				G_BenchmarkFinish (gametic, endtime);
+
 				// Trying to get back to a stable state after timing a demo
 				// seems to cause problems. I don't feel like fixing that
 				// right now.
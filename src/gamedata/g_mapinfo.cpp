@@ -286,6 +286,7 @@ void level_info_t::Reset()
 	aircontrol = 0.f;
 	WarpTrans = 0;
 	airsupply = 20;
+	blockmapcellsize = 0;
 	compatflags = compatflags2 = 0;
 	compatmask = compatmask2 = 0;
 	Translator = "";
@@ -1259,6 +1260,13 @@ DEFINE_MAP_OPTION(airsupply, true)
 	info->airsupply = parse.sc.Number;
 }
 
+DEFINE_MAP_OPTION(blockmapcellsize, true)
+{
+	parse.ParseAssign();
+	parse.sc.MustGetNumber();
+	info->blockmapcellsize = parse.sc.Number;
+}
+
 DEFINE_MAP_OPTION(interpic, true)
 {
 	parse.ParseAssign();
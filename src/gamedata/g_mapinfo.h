@@ -366,6 +366,7 @@ struct level_info_t
 	double		aircontrol;
 	int			WarpTrans;
 	int			airsupply;
+	int			blockmapcellsize;
 	uint32_t	compatflags, compatflags2;
 	uint32_t	compatmask, compatmask2;
 	FString		Translator;	// for converting Doom-format linedef and sector types.
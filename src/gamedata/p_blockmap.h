@@ -15,6 +15,7 @@ struct FBlockNode
 	FBlockNode *NextActor;			// next actor in this block
 	FBlockNode **PrevBlock;			// previous block this actor is in
 	FBlockNode *NextBlock;			// next block this actor is in
+	int ThingIndex;					// index of this link in the block's FBlockThingList
 
 	static FBlockNode *Create (AActor *who, int x, int y, int group = -1);
 	void Release ();
@@ -22,6 +23,27 @@ struct FBlockNode
 	static FBlockNode *FreeBlocks;
 };
 
+// Flat copy of a block's thing chain so that iterators can scan contiguous
+// memory instead of chasing FBlockNodes. Entries are kept in link order, so
+// walking the arrays backwards visits actors in the same order as the chain.
+// Removal only clears the entry, which also keeps the position of iterators
+// scanning the block valid. The holes get compacted once they make up half
+// of the list and no iterator is scanning the block.
+struct FBlockThingList
+{
+	TArray<AActor *> Actors;		// nullptr for removed entries
+	TArray<FBlockNode *> Nodes;
+	TArray<uint8_t> Spans;			// actor is linked into more than one block
+	unsigned Dead = 0;
+	int Iterators = 0;				// number of FBlockThingsIterators currently scanning this block
+
+	void Add(FBlockNode *node);
+	void Remove(FBlockNode *node);
+	void Compact();
+	void CompactIfSparse();
+	unsigned Size() const { return Actors.Size(); }
+};
+
 // BLOCKMAP
 // Created from axis aligned bounding box
 // of the map, a rectangular array of
@@ -40,19 +62,32 @@ struct FBlockmap
 	double				bmaporgx;
 	double				bmaporgy;		// origin of block map
 	FBlockNode**		blocklinks; 	// for thing chains
+	FBlockThingList*	blockthings = nullptr;	// contiguous copy of the thing chains
+	int					thinggeneration = 0;	// changes whenever blockthings gets reallocated
 
 	// mapblocks are used to check movement
 	// against lines and things
-	static constexpr int MAPBLOCKUNITS = 128;
+	static constexpr int MAPBLOCKUNITS = 128;	// the vanilla block size. Distances given in blocks are based on this.
+	int					blockunits = MAPBLOCKUNITS;	// the block size this level was set up with
+
+	// The coarse grid summarizes (1 << COARSESHIFT) x (1 << COARSESHIFT) blocks
+	// so that iterators can skip empty parts of large maps without touching the
+	// per-block data. It is optional; coarsewidth is 0 when it is not in use.
+	static constexpr int COARSESHIFT = 3;
+	static constexpr int COARSEMASK = (1 << COARSESHIFT) - 1;
+	int					coarsewidth = 0;
+	int					coarseheight = 0;
+	TArray<int>			coarsethings;	// number of thing links in each coarse cell
+	TArray<uint8_t>		coarselines;	// coarse cell has lines in its blocks
 
 	inline int GetBlockX(double xpos)
 	{
-		return int((xpos - bmaporgx) / MAPBLOCKUNITS);
+		return int((xpos - bmaporgx) / blockunits);
 	}
 
 	inline int GetBlockY(double ypos)
 	{
-		return int((ypos - bmaporgy) / MAPBLOCKUNITS);
+		return int((ypos - bmaporgy) / blockunits);
 	}
 
 	inline bool isValidBlock(int x, int y) const
@@ -61,6 +96,35 @@ struct FBlockmap
 			(unsigned int)y < (unsigned int)bmapheight);
 	}
 
+	// Converts a distance in vanilla sized blocks into this level's blocks.
+	inline int ScaleBlockDistance(int blocks) const
+	{
+		return (blocks * MAPBLOCKUNITS + blockunits - 1) / blockunits;
+	}
+
+	inline int GetCoarseIndex(int x, int y) const
+	{
+		return (y >> COARSESHIFT) * coarsewidth + (x >> COARSESHIFT);
+	}
+
+	// Both of these only return true if the block is known to be empty, never for invalid blocks.
+	inline bool NoThingsInCoarse(int x, int y) const
+	{
+		return coarsewidth > 0 && isValidBlock(x, y) && coarsethings[GetCoarseIndex(x, y)] == 0;
+	}
+
+	inline bool NoLinesInCoarse(int x, int y) const
+	{
+		return coarsewidth > 0 && isValidBlock(x, y) && coarselines[GetCoarseIndex(x, y)] == 0;
+	}
+
+	inline void AddCoarseThing(int blockindex, int amount)
+	{
+		if (coarsewidth > 0) coarsethings[GetCoarseIndex(blockindex % bmapwidth, blockindex / bmapwidth)] += amount;
+	}
+
+	void InitCoarseGrid(bool enable);
+
 	inline int *GetLines(int x, int y) const
 	{
 		// There is an extra entry at the beginning of every block.
@@ -84,6 +148,16 @@ struct FBlockmap
 			delete[] blocklinks;
 			blocklinks = nullptr;
 		}
+		if (blockthings != nullptr)
+		{
+			delete[] blockthings;
+			blockthings = nullptr;
+		}
+		thinggeneration++;
+		blockunits = MAPBLOCKUNITS;
+		coarsewidth = coarseheight = 0;
+		coarsethings.Reset();
+		coarselines.Reset();
 	}
 
 	~FBlockmap()
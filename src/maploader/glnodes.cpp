@@ -58,6 +58,7 @@
 
 EXTERN_CVAR(Bool, gl_cachenodes)
 EXTERN_CVAR(Float, gl_cachetime)
+EXTERN_CVAR(Bool, gl_cachecompress)
 
 // fixed 32 bit gl_vert format v2.0+ (glBsp 1.91)
 struct mapglvertex_t
@@ -1096,17 +1097,26 @@ void MapLoader::CreateCachedNodes(MapData *map)
 	uLongf outlen = ZNodes.Size();
 	TArray<Bytef> compressed;
 	int offset = Level->lines.Size() * 8 + 12 + 16;
-	int r;
-	do
+	if (gl_cachecompress)
 	{
-		compressed.Resize(outlen + offset);
-		r = compress (compressed.Data() + offset, &outlen, &ZNodes[0], ZNodes.Size());
-		if (r == Z_BUF_ERROR)
+		int r;
+		do
 		{
-			outlen += 1024;
-		}
-	} 
-	while (r == Z_BUF_ERROR);
+			compressed.Resize(outlen + offset);
+			r = compress (compressed.Data() + offset, &outlen, &ZNodes[0], ZNodes.Size());
+			if (r == Z_BUF_ERROR)
+			{
+				outlen += 1024;
+			}
+		} 
+		while (r == Z_BUF_ERROR);
+	}
+	else
+	{
+		// Stored as is, so that loading it does not need to inflate anything.
+		compressed.Resize(outlen + offset);
+		memcpy(compressed.Data() + offset, ZNodes.Data(), outlen);
+	}
 
 	memcpy(compressed.Data(), "CACH", 4);
 	uint32_t len = LittleLong(Level->lines.Size());
@@ -1117,7 +1127,7 @@ void MapLoader::CreateCachedNodes(MapData *map)
 		uint32_t ndx[2] = { LittleLong(uint32_t(Index(Level->lines[i].v1))), LittleLong(uint32_t(Index(Level->lines[i].v2))) };
 		memcpy(&compressed[8 + 16 + 8 * i], ndx, 8);
 	}
-	memcpy(&compressed[offset - 4], "ZGL3", 4);
+	memcpy(&compressed[offset - 4], gl_cachecompress ? "ZGL3" : "XGL3", 4);
 
 	FString path = CreateCacheName(map, true);
 	FileWriter *fw = FileWriter::Open(path.GetChars());
@@ -1166,8 +1176,15 @@ bool MapLoader::CheckCachedNodes(MapData *map)
 	if (fr.Read(verts.Data(), 8 * numlin) != 8 * numlin) return false;
 
 	if (fr.Read(magic, 4) != 4) return false;
-	if (memcmp(magic, "ZGL2", 4) && memcmp(magic, "ZGL3", 4))  return false;
+	if (memcmp(magic, "ZGL2", 4) && memcmp(magic, "ZGL3", 4) && memcmp(magic, "XGL2", 4) && memcmp(magic, "XGL3", 4))  return false;
 
+	if (magic[0] == 'X')
+	{
+		// Uncompressed nodes are read in one go and parsed from memory, instead of one value at a time from the file.
+		auto data = fr.Read(fr.GetLength() - fr.Tell());
+		if (data.size() == 0) return false;
+		fr.OpenMemoryArray(data);
+	}
 
 	try
 	{
@@ -85,6 +85,9 @@
 #include "hw_vertexbuilder.h"
 #include "version.h"
 #include "fs_decompress.h"
+#include "ctpl.h"
+
+#include <future>
 
 enum
 {
@@ -92,7 +95,76 @@ enum
 };
 
 CVAR (Bool, genblockmap, false, CVAR_SERVERINFO|CVAR_GLOBALCONFIG);
+CVAR (Int, blockmapcellsize, 0, CVAR_SERVERINFO|CVAR_GLOBALCONFIG);	// 0 uses the map's own setting
+CVAR (Bool, coarseblockmap, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG);
 CVAR (Bool, gennodes, false, CVAR_SERVERINFO|CVAR_GLOBALCONFIG);
+CVAR (Bool, map_parallelload, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG);	// run independent load stages on worker threads
+CVAR (Bool, showloadtimes, false, CVAR_ARCHIVE|CVAR_GLOBALCONFIG);
+
+static ctpl::thread_pool *LoadPool;
+
+//==========================================================================
+//
+// FLoadTask
+//
+// A stage of LoadLevel that runs on a worker thread. The task may only read
+// level data that the main thread no longer changes, and Wait() must be
+// called before anything that depends on its result.
+//
+//==========================================================================
+
+class FLoadTask
+{
+	std::future<void> Future;
+	const char *Name = nullptr;
+	double Msec = 0;
+
+public:
+	~FLoadTask()
+	{
+		// If loading is aborted by an error the worker must not outlive the level data.
+		if (Future.valid()) Future.wait();
+	}
+
+	bool IsLaunched() const
+	{
+		return Name != nullptr;
+	}
+
+	template<typename Func> void Launch(const char *name, Func func)
+	{
+		Name = name;
+		auto run = [this, func](int)
+		{
+			uint64_t start = I_nsTime();
+			func();
+			Msec = (I_nsTime() - start) * 1e-6;
+		};
+
+		if (!map_parallelload)
+		{
+			run(0);
+			return;
+		}
+		if (LoadPool == nullptr)
+		{
+			LoadPool = new ctpl::thread_pool(clamp<int>(int(std::thread::hardware_concurrency()) - 1, 1, 3));
+		}
+		Future = LoadPool->push(run);
+	}
+
+	void Wait(MapLoader *loader)
+	{
+		if (Name == nullptr) return;
+
+		uint64_t start = I_nsTime();
+		bool concurrent = Future.valid();
+		if (concurrent) Future.get();
+		// Time spent waiting is not counted towards the next stage on the main thread.
+		loader->StageStart = I_nsTime();
+		loader->LoadStages.Push({ Name, Msec, (loader->StageStart - start) * 1e-6, concurrent });
+	}
+};
 
 inline bool P_LoadBuildMap(uint8_t *mapdata, size_t len, FMapThing **things, int *numthings)
 {
@@ -2317,13 +2389,10 @@ static void CreatePackedBlockmap (TArray<int> &BlockMap, TArray<int> *blocks, in
 }
 
 
-void MapLoader::CreateBlockMap ()
+void MapLoader::CreateBlockMap (int blockbits)
 {
-	enum
-	{
-		BLOCKBITS = 7,
-		BLOCKSIZE = 128
-	};
+	const int BLOCKBITS = blockbits;
+	const int BLOCKSIZE = 1 << blockbits;
 
 	TArray<int> *block, *endblock;
 	TArray<TArray<int>> BlockLists;
@@ -2489,6 +2558,39 @@ void MapLoader::CreateBlockMap ()
 	{
 		Level->blockmap.blockmaplump[ii] = BlockMap[ii];
 	}
+	Level->blockmap.blockunits = BLOCKSIZE;
+}
+
+//===========================================================================
+//
+// FBlockmap :: InitCoarseGrid
+//
+//===========================================================================
+
+void FBlockmap::InitCoarseGrid(bool enable)
+{
+	coarsethings.Reset();
+	coarselines.Reset();
+	coarsewidth = coarseheight = 0;
+	if (!enable) return;
+
+	coarsewidth = ((bmapwidth - 1) >> COARSESHIFT) + 1;
+	coarseheight = ((bmapheight - 1) >> COARSESHIFT) + 1;
+	coarsethings.Resize(coarsewidth * coarseheight);
+	coarselines.Resize(coarsewidth * coarseheight);
+	memset(coarsethings.Data(), 0, coarsethings.Size() * sizeof(int));
+	memset(coarselines.Data(), 0, coarselines.Size());
+
+	for (int y = 0; y < bmapheight; y++)
+	{
+		for (int x = 0; x < bmapwidth; x++)
+		{
+			if (*GetLines(x, y) != -1)
+			{
+				coarselines[GetCoarseIndex(x, y)] = 1;
+			}
+		}
+	}
 }
 
 
@@ -2576,6 +2678,47 @@ bool FBlockmap::VerifyBlockMap(int count, unsigned numlines)
 	return true;
 }
 
+//===========================================================================
+//
+// MapLoader :: GetBlockMapBits
+//
+// Block size to use for this level, from the blockmapcellsize cvar or
+// the MAPINFO option.
+//
+//===========================================================================
+
+int MapLoader::GetBlockMapBits ()
+{
+	int cellsize = blockmapcellsize > 0 ? *blockmapcellsize : Level->info->blockmapcellsize;
+	int blockbits = 7;
+
+	if (cellsize > 0)
+	{
+		// The block size is rounded down to a power of two between 32 and 2048.
+		cellsize = clamp(cellsize, 32, 2048);
+		blockbits = 5;
+		while ((2 << blockbits) <= cellsize) blockbits++;
+	}
+	return blockbits;
+}
+
+//===========================================================================
+//
+// MapLoader :: MustGenerateBlockMap
+//
+// Checks if the map's BLOCKMAP lump can be used without looking at it.
+// An invalid lump is only detected later by LoadBlockMap.
+//
+//===========================================================================
+
+bool MapLoader::MustGenerateBlockMap (MapData * map, int blockbits)
+{
+	int count = map->Size(ML_BLOCKMAP);
+	return ForceNodeBuild || genblockmap || blockbits != 7 ||
+		count/2 >= 0x10000 || count == 0 ||
+		Args->CheckParm("-blockmap");
+}
+
 //===========================================================================
 //
 // P_LoadBlockMap
@@ -2587,17 +2730,19 @@ bool FBlockmap::VerifyBlockMap(int count, unsigned numlines)
 //
 //===========================================================================
 
-void MapLoader::LoadBlockMap (MapData * map)
+void MapLoader::LoadBlockMap (MapData * map, bool generated)
 {
 	int count = map->Size(ML_BLOCKMAP);
+	int blockbits = GetBlockMapBits();
 
-	if (ForceNodeBuild || genblockmap ||
-		count/2 >= 0x10000 || count == 0 ||
-		Args->CheckParm("-blockmap")
-		)
+	if (generated)
+	{
+		// LoadLevel already ran CreateBlockMap on a worker thread.
+	}
+	else if (MustGenerateBlockMap(map, blockbits))
 	{
 		DPrintf (DMSG_SPAMMY, "Generating BLOCKMAP\n");
-		CreateBlockMap ();
+		CreateBlockMap (blockbits);
 	}
 	else
 	{
@@ -2641,6 +2786,9 @@ void MapLoader::LoadBlockMap (MapData * map)
 	count = Level->blockmap.bmapwidth*Level->blockmap.bmapheight;
 	Level->blockmap.blocklinks = new FBlockNode *[count];
 	memset (Level->blockmap.blocklinks, 0, count*sizeof(*Level->blockmap.blocklinks));
+	Level->blockmap.blockthings = new FBlockThingList[count];
+	Level->blockmap.thinggeneration++;
+	Level->blockmap.InitCoarseGrid(coarseblockmap);
 	Level->blockmap.blockmap = Level->blockmap.blockmaplump+4;
 }
 
@@ -2931,6 +3079,52 @@ void MapLoader::CalcIndices()
 	}
 }
 
+//==========================================================================
+//
+// MapLoader :: StageDone
+//
+// Records the time the main thread spent since the previous stage.
+//
+//==========================================================================
+
+void MapLoader::StageDone(const char *name)
+{
+	uint64_t now = I_nsTime();
+	LoadStages.Push({ name, (now - StageStart) * 1e-6, 0, false });
+	StageStart = now;
+}
+
+//==========================================================================
+//
+// MapLoader :: ReportLoadStages
+//
+//==========================================================================
+
+void MapLoader::ReportLoadStages()
+{
+	FString out;
+	double total = 0;
+
+	out.Format("Load times for %s:\n", Level->MapName.GetChars());
+	for (auto &stage : LoadStages)
+	{
+		if (stage.Concurrent)
+		{
+			out.AppendFormat("  %-14s %9.2f ms  (worker, waited %.2f ms)\n", stage.Name, stage.Msec, stage.Waited);
+			total += stage.Waited;
+		}
+		else
+		{
+			out.AppendFormat("  %-14s %9.2f ms\n", stage.Name, stage.Msec);
+			total += stage.Msec;
+		}
+	}
+	out.AppendFormat("  %-14s %9.2f ms\n", "total", total);
+
+	if (showloadtimes) Printf("%s", out.GetChars());
+	else DPrintf(DMSG_NOTIFY, "%s", out.GetChars());
+}
+
 //==========================================================================
 //
 //
@@ -2943,6 +3137,8 @@ void MapLoader::LoadLevel(MapData *map, const char *lumpname, int position)
 
 	// note: most of this ordering is important 
 	ForceNodeBuild = gennodes;
+	LoadStages.Clear();
+	StageStart = I_nsTime();
 
 	// [RH] Load in the BEHAVIOR lump
 	if (map->HasBehavior)
@@ -3004,6 +3200,7 @@ void MapLoader::LoadLevel(MapData *map, const char *lumpname, int position)
 
 
 	LoadStrifeConversations(map, lumpname);
+	StageDone("scripts");
 
 	FMissingTextureTracker missingtex;
 
@@ -3032,6 +3229,7 @@ void MapLoader::LoadLevel(MapData *map, const char *lumpname, int position)
 	{
 		ParseTextMap(map, missingtex);
 	}
+	StageDone(map->isText ? "textmap" : "geometry");
 
 	CalcIndices();
 	PostProcessLevel(checksum);
@@ -3039,6 +3237,7 @@ void MapLoader::LoadLevel(MapData *map, const char *lumpname, int position)
 	LoopSidedefs(true);
 
 	SummarizeMissingTextures(missingtex);
+	StageDone("postprocess");
 	bool reloop = false;
 
 	if (!ForceNodeBuild)
@@ -3172,8 +3371,18 @@ void MapLoader::LoadLevel(MapData *map, const char *lumpname, int position)
 	
 	// set the head node for gameplay purposes. If the separate gamenodes array is not empty, use that, otherwise use the render nodes.
 	Level->headgamenode = Level->gamenodes.Size() > 0 ? &Level->gamenodes[Level->gamenodes.Size() - 1] : Level->nodes.Size() ? &Level->nodes[Level->nodes.Size() - 1] : nullptr;
+	StageDone("nodes");
 
-	LoadBlockMap(map);
+	// From here on the vertex positions and line endpoints no longer change, which is all
+	// CreateBlockMap looks at. Nothing up to SpawnSlopeMakers needs the blockmap, so it can be
+	// generated while the rest of the level structures are set up.
+	FLoadTask blockmaptask;
+	int blockbits = GetBlockMapBits();
+	if (MustGenerateBlockMap(map, blockbits))
+	{
+		DPrintf (DMSG_SPAMMY, "Generating BLOCKMAP\n");
+		blockmaptask.Launch("blockmap", [=]() { CreateBlockMap(blockbits); });
+	}
 
 	LoadReject(map, false);
 	GroupLines(false);
@@ -3184,6 +3393,7 @@ void MapLoader::LoadLevel(MapData *map, const char *lumpname, int position)
 
 	// Create the item indices, after the last function which may change the data has run.
 	CalcIndices();
+	StageDone("linkage");
 
 	Level->bodyqueslot = 0;
 	// phares 8/10/98: Clear body queue so the corpses from previous games are
@@ -3193,6 +3403,11 @@ void MapLoader::LoadLevel(MapData *map, const char *lumpname, int position)
 		p = nullptr;
 
 	CreateSections(Level);
+	StageDone("sections");
+
+	blockmaptask.Wait(this);
+	LoadBlockMap(map, blockmaptask.IsLaunched());
+	StageDone("blockmap links");
 
 	// [RH] Spawn slope creating things first.
 	SpawnSlopeMakers(&MapThingsConverted[0], &MapThingsConverted[MapThingsConverted.Size()], oldvertextable);
@@ -3216,6 +3431,7 @@ void MapLoader::LoadLevel(MapData *map, const char *lumpname, int position)
 	}
 	if (!map->HasBehavior && !map->isText)
 		TranslateTeleportThings();	// [RH] Assign teleport destination TIDs
+	StageDone("things");
 
 	if (oldvertextable != nullptr)
 	{
@@ -3239,12 +3455,14 @@ void MapLoader::LoadLevel(MapData *map, const char *lumpname, int position)
 		double fdy = FIXED2DBL(node.dy);
 		node.len = (float)g_sqrt(fdx * fdx + fdy * fdy);
 	}
+	StageDone("specials");
 
 	InitRenderInfo();				// create hardware independent renderer resources for the level. This must be done BEFORE the PolyObj Spawn!!!
 	Level->ClearDynamic3DFloorData();	// CreateVBO must be run on the plain 3D floor data.
 	CreateVBO(screen->mVertexData, Level->sectors);
 
 	screen->InitLightmap(Level->LMTextureSize, Level->LMTextureCount, Level->LMTextureData);
+	StageDone("vertex buffer");
 
 	for (auto &sec : Level->sectors)
 	{
@@ -3259,9 +3477,13 @@ void MapLoader::LoadLevel(MapData *map, const char *lumpname, int position)
 	PO_Init();				// Initialize the polyobjs
 	if (!Level->IsReentering())
 		Level->FinalizePortals();	// finalize line portals after polyobjects have been initialized. This info is needed for properly flagging them.
+	StageDone("portals");
 
-	Level->aabbTree = new DoomLevelAABBTree(Level);
-	Level->levelMesh = new DoomLevelMesh(*Level);
+	// Both only read the finished level geometry and are independent of each other
+	// and of the subsector bounding boxes below.
+	FLoadTask aabbtask, meshtask;
+	aabbtask.Launch("aabb tree", [=]() { Level->aabbTree = new DoomLevelAABBTree(Level); });
+	meshtask.Launch("level mesh", [=]() { Level->levelMesh = new DoomLevelMesh(*Level); });
 
 	// [DVR] Populate subsector->bbox for alternative space culling in orthographic projection with no fog of war
 	subsector_t* sub = &Level->subsectors[0];
@@ -3281,6 +3503,11 @@ void MapLoader::LoadLevel(MapData *map, const char *lumpname, int position)
 			seg++;
 		}
 	}
+	StageDone("subsector bbox");
+
+	aabbtask.Wait(this);
+	meshtask.Wait(this);
+	ReportLoadStages();
 }
 
 //==========================================================================
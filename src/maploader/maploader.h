@@ -115,6 +115,18 @@ private:
 	int sidecount = 0;
 	TArray<int>		linemap;
 	TArray<sidei_t> sidetemp;
+
+	// Time spent in the individual stages of LoadLevel.
+	struct FLoadStage
+	{
+		const char *Name;
+		double Msec;
+		double Waited;		// How long the main thread had to wait for a concurrent stage
+		bool Concurrent;	// Ran on a worker while the main thread continued loading.
+	};
+	TArray<FLoadStage> LoadStages;
+	uint64_t StageStart = 0;
+	friend class FLoadTask;
 public:	// for the scripted compatibility system these two members need to be public.
 	TArray<FMapThing> MapThingsConverted;
 	bool ForceNodeBuild = false;
@@ -232,7 +244,11 @@ private:
 	void AllocateSideDefs(MapData *map, int count);
 	void ProcessSideTextures(bool checktranmap, side_t *sd, sector_t *sec, intmapsidedef_t *msd, int special, int tag, short *alpha, FMissingTextureTracker &missingtex);
 	void SetMapThingUserData(AActor *actor, unsigned udi);
-	void CreateBlockMap();
+	void CreateBlockMap(int blockbits = 7);
+	int GetBlockMapBits();
+	bool MustGenerateBlockMap(MapData *map, int blockbits);
+	void StageDone(const char *name);
+	void ReportLoadStages();
 	void PO_Init(void);
 
 	// During map init the items' own Index functions should not be used.
@@ -296,7 +312,7 @@ public:
 	void LoadLineDefs2(MapData * map);
 	void LoopSidedefs(bool firstloop);
 	void LoadSideDefs2(MapData *map, FMissingTextureTracker &missingtex);
-	void LoadBlockMap(MapData * map);
+	void LoadBlockMap(MapData * map, bool generated = false);
 	void LoadReject(MapData * map, bool junk);
 	void LoadBehavior(MapData * map);
 	void GetPolySpots(MapData * map, TArray<FNodeBuilder::FPolyStart> &spots, TArray<FNodeBuilder::FPolyStart> &anchors);
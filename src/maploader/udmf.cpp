@@ -54,6 +54,8 @@
 #include "texturemanager.h"
 #include "a_scroll.h"
 #include "p_spec_thinkers.h"
+#include "c_dispatch.h"
+#include "stats.h"
 
 //===========================================================================
 //
@@ -155,6 +157,263 @@ namespace
 //
 //===========================================================================
 
+//===========================================================================
+//
+// Fast path for the UDMF scanner
+//
+//===========================================================================
+
+enum
+{
+	UC_Space = 1,	// whitespace other than newlines
+	UC_Alpha = 2,	// characters that can start a key
+	UC_Ident = 4,	// characters that can continue a key
+	UC_Digit = 8,
+};
+
+static struct FUDMFCharClasses
+{
+	uint8_t Class[256];
+
+	FUDMFCharClasses()
+	{
+		memset(Class, 0, sizeof(Class));
+		for (int c : { ' ', '\t', '\v', '\f', '\r' }) Class[c] = UC_Space;
+		for (int c = 'a'; c <= 'z'; c++) Class[c] = Class[c - 'a' + 'A'] = UC_Alpha | UC_Ident;
+		for (int c = '0'; c <= '9'; c++) Class[c] = UC_Ident | UC_Digit;
+		Class['_'] = UC_Alpha | UC_Ident;
+	}
+
+	bool Is(char c, int cls) const { return !!(Class[(uint8_t)c] & cls); }
+} UDMFChars;
+
+FUDMFScanner::FUDMFScanner()
+{
+	for (auto &entry : KeyCache) entry.Len = 0;
+}
+
+const char *FUDMFScanner::SkipWhitespace(const char *p, int &line, bool &crossed)
+{
+	for (; p < ScriptEndPtr; p++)
+	{
+		if (*p == '\n')
+		{
+			line++;
+			crossed = true;
+		}
+		else if (!UDMFChars.Is(*p, UC_Space)) break;
+	}
+	return p;
+}
+
+FName FUDMFScanner::LookupKey(const char *text, int len, unsigned hash)
+{
+	if (len >= (int)sizeof(KeyCache[0].Text))
+	{
+		return FName(text, len, false);
+	}
+	auto &entry = KeyCache[hash % KEY_CACHE_SIZE];
+	if (entry.Len != len || memcmp(entry.Text, text, len))
+	{
+		entry.Name = FName(text, len, false);
+		entry.Len = (uint8_t)len;
+		memcpy(entry.Text, text, len);
+	}
+	return entry.Name;
+}
+
+//===========================================================================
+//
+// Sets up the scanner state as if a single character token had been
+// read by GetToken.
+//
+//===========================================================================
+
+void FUDMFScanner::SetToken(int token, const char *start, int startline, const char *end, int line, bool crossed)
+{
+	LastGotPtr = start;
+	LastGotLine = startline;
+	LastGotToken = true;
+	AlreadyGot = false;
+	ParseError = false;
+	ScriptPtr = end;
+	Line = line;
+	Crossed = crossed;
+	TokenType = token;
+	StringBuffer[0] = (char)token;
+	StringBuffer[1] = 0;
+	String = StringBuffer;
+	StringLen = 1;
+}
+
+//===========================================================================
+//
+// Same as CheckToken('}'), but a following key does not need to be
+// scanned twice.
+//
+//===========================================================================
+
+bool FUDMFScanner::CheckBlockEnd()
+{
+	if (CMode && StateMode == 0 && !AlreadyGot)
+	{
+		int line = Line;
+		bool crossed = false;
+		const char *p = SkipWhitespace(ScriptPtr, line, crossed);
+		if (p < ScriptEndPtr)
+		{
+			if (*p == '}')
+			{
+				SetToken('}', ScriptPtr, Line, p + 1, line, crossed);
+				return true;
+			}
+			if (UDMFChars.Is(*p, UC_Alpha))
+			{
+				ScriptPtr = p;
+				Line = line;
+				return false;
+			}
+		}
+	}
+	return CheckToken('}');
+}
+
+//===========================================================================
+//
+// Reads a complete 'key = value;' statement. Returns false without
+// consuming anything if the statement needs the full scanner.
+//
+//===========================================================================
+
+bool FUDMFScanner::GetKeyValue(FName &key, FString &string)
+{
+	if (!CMode || StateMode != 0)
+	{
+		return false;
+	}
+
+	// Restart at the last token if it was put back, just like ScanString does.
+	int line = AlreadyGot ? LastGotLine : Line;
+	bool crossed = false;
+	const char *p = SkipWhitespace(AlreadyGot ? LastGotPtr : ScriptPtr, line, crossed);
+
+	const char *keystart = p;
+	unsigned hash = 0;
+	if (p >= ScriptEndPtr || !UDMFChars.Is(*p, UC_Alpha))
+	{
+		return false;
+	}
+	for (; p < ScriptEndPtr && UDMFChars.Is(*p, UC_Ident); p++)
+	{
+		hash = hash * 31 + (uint8_t)*p;
+	}
+	const int keylen = int(p - keystart);
+
+	p = SkipWhitespace(p, line, crossed);
+	if (p >= ScriptEndPtr || *p != '=')
+	{
+		return false;
+	}
+	p = SkipWhitespace(p + 1, line, crossed);
+	if (p >= ScriptEndPtr)
+	{
+		return false;
+	}
+
+	int token;
+	int number = 0;
+	int64_t bignumber = BigNumber;
+	double flt = 0;
+
+	if (*p == '"')
+	{
+		const char *start = ++p;
+		for (; p < ScriptEndPtr && *p != '"'; p++)
+		{
+			if (*p == '\\' || *p == 0) return false;
+			if (*p == '\n') line++;
+		}
+		if (p >= ScriptEndPtr)
+		{
+			return false;
+		}
+		string = FString(start, p - start);
+		token = TK_StringConst;
+		p++;
+	}
+	else if (UDMFChars.Is(*p, UC_Alpha))
+	{
+		const char *start = p;
+		while (p < ScriptEndPtr && UDMFChars.Is(*p, UC_Ident)) p++;
+		if (p - start == 4 && !strnicmp(start, "true", 4)) token = TK_True;
+		else if (p - start == 5 && !strnicmp(start, "false", 5)) token = TK_False;
+		else return false;
+	}
+	else
+	{
+		bool neg = false;
+		if (*p == '-' || *p == '+')
+		{
+			neg = *p == '-';
+			p++;
+		}
+		const char *start = p;
+		while (p < ScriptEndPtr && UDMFChars.Is(*p, UC_Digit)) p++;
+		const char *intend = p;
+		bool isfloat = false;
+		if (p < ScriptEndPtr && *p == '.')
+		{
+			isfloat = true;
+			for (p++; p < ScriptEndPtr && UDMFChars.Is(*p, UC_Digit); p++);
+		}
+		const int digits = int(p - start) - isfloat;
+
+		// Exponents, suffixes, hex and octal numbers are left to FScanner.
+		if (digits == 0 || p >= ScriptEndPtr || UDMFChars.Is(*p, UC_Ident) || *p == '.')
+		{
+			return false;
+		}
+		if (isfloat)
+		{
+			char *stopper;
+			flt = strtod(start, &stopper);
+			if (stopper != p) return false;
+			token = TK_FloatConst;
+		}
+		else
+		{
+			if (digits > 18 || (*start == '0' && digits > 1)) return false;
+			bignumber = 0;
+			for (const char *d = start; d < intend; d++) bignumber = bignumber * 10 + (*d - '0');
+			number = (int)bignumber;
+			flt = number;
+			token = TK_IntConst;
+		}
+		if (neg)
+		{
+			number = -number;
+			flt = -flt;
+		}
+	}
+
+	const char *valueend = p;
+	const int valueline = line;
+	crossed = false;
+	p = SkipWhitespace(p, line, crossed);
+	if (p >= ScriptEndPtr || *p != ';')
+	{
+		return false;
+	}
+
+	key = LookupKey(keystart, keylen, hash);
+	SetToken(';', valueend, valueline, p + 1, line, crossed);
+	TokenType = token;
+	Number = number;
+	BigNumber = bignumber;
+	Float = flt;
+	return true;
+}
+
 //===========================================================================
 //
 // Skip a key or block
@@ -195,6 +454,17 @@ void UDMFParserBase::Skip()
 	}
 }
 
+//===========================================================================
+//
+// Checks for the end of a block
+//
+//===========================================================================
+
+bool UDMFParserBase::CheckBlockEnd()
+{
+	return FastKeys ? sc.CheckBlockEnd() : sc.CheckToken('}');
+}
+
 //===========================================================================
 //
 // Parses a 'key = value' line of the map
@@ -203,8 +473,15 @@ void UDMFParserBase::Skip()
 
 FName UDMFParserBase::ParseKey(bool checkblock, bool *isblock)
 {
+	FName key;
+	if (FastKeys && sc.GetKeyValue(key, parsedString))
+	{
+		if (checkblock && isblock) *isblock = false;
+		return key;
+	}
+
 	sc.MustGetString();
-	FName key = sc.String;
+	key = sc.String;
 	if (checkblock)
 	{
 		if (sc.CheckToken('{'))
@@ -519,7 +796,7 @@ public:
 		th->Health = 1;
 		th->FloatbobPhase = -1;
 		sc.MustGetToken('{');
-		while (!sc.CheckToken('}'))
+		while (!CheckBlockEnd())
 		{
 			FName key = ParseKey();
 			switch(key.GetIndex())
@@ -871,7 +1148,7 @@ public:
 		if (Level->flags2 & LEVEL2_CHECKSWITCHRANGE) ld->flags |= ML_CHECKSWITCHRANGE;
 
 		sc.MustGetToken('{');
-		while (!sc.CheckToken('}'))
+		while (!CheckBlockEnd())
 		{
 			FName key = ParseKey();
 
@@ -1264,7 +1541,7 @@ public:
 		sd->UDMFIndex = index;
 
 		sc.MustGetToken('{');
-		while (!sc.CheckToken('}'))
+		while (!CheckBlockEnd())
 		{
 			FName key = ParseKey();
 			switch(key.GetIndex())
@@ -1686,7 +1963,7 @@ public:
 		sec->movefactor = ORIG_FRICTION_FACTOR;
 
 		sc.MustGetToken('{');
-		while (!sc.CheckToken('}'))
+		while (!CheckBlockEnd())
 		{
 			FName key = ParseKey();
 			switch(key.GetIndex())
@@ -2330,7 +2607,7 @@ public:
 
 		sc.MustGetToken('{');
 		double x = 0, y = 0;
-		while (!sc.CheckToken('}'))
+		while (!CheckBlockEnd())
 		{
 			FName key = ParseKey();
 			switch (key.GetIndex())
@@ -2666,3 +2943,96 @@ void MapLoader::ParseTextMap(MapData *map, FMissingTextureTracker &missingtex)
 
 	parse.ParseTextMap(map);
 }
+
+//===========================================================================
+//
+// Benchmark for the UDMF scanner
+//
+// Scans a map's TEXTMAP with and without the fast path and reports the
+// time it took. Only the keys are read, so what gets measured is the
+// scanning alone.
+//
+//===========================================================================
+
+class UDMFScanBenchmark : public UDMFParserBase
+{
+public:
+	unsigned Keys;
+	unsigned Checksum;
+
+	void Run(const TArray<uint8_t> &textmap, bool fast)
+	{
+		FastKeys = fast;
+		Keys = 0;
+		Checksum = 0;
+		sc.OpenMem("TEXTMAP", textmap);
+		sc.SetCMode(true);
+		while (sc.GetString())
+		{
+			if (sc.CheckToken('{'))
+			{
+				while (!CheckBlockEnd())
+				{
+					FName key = ParseKey();
+					double value = sc.TokenType == TK_StringConst ? parsedString.Len() : sc.Float;
+					Checksum = Checksum * 31 + key.GetIndex() + sc.TokenType + sc.Number + unsigned(value * 1000);
+					Keys++;
+				}
+			}
+			else
+			{
+				sc.MustGetToken('=');
+				do
+				{
+					sc.MustGetAnyToken();
+				}
+				while (sc.TokenType != ';');
+			}
+		}
+	}
+};
+
+CCMD(udmfbench)
+{
+	if (argv.argc() < 2)
+	{
+		Printf("Usage: udmfbench <map> [passes]\n");
+		return;
+	}
+
+	MapData *map = P_OpenMapData(argv[1], true);
+	if (map == nullptr || !map->isText)
+	{
+		Printf("%s is not a UDMF map\n", argv[1]);
+		delete map;
+		return;
+	}
+	auto textmap = map->Read(ML_TEXTMAP);
+	delete map;
+
+	const int passes = argv.argc() >= 3 ? max(1, atoi(argv[2])) : 10;
+	UDMFScanBenchmark bench;
+	double time[2];
+	unsigned checksum[2];
+	for (int fast = 0; fast < 2; fast++)
+	{
+		cycle_t clock;
+		clock.Reset();
+		clock.Clock();
+		for (int i = 0; i < passes; i++)
+		{
+			bench.Run(textmap, !!fast);
+		}
+		clock.Unclock();
+		time[fast] = clock.TimeMS() / passes;
+		checksum[fast] = bench.Checksum;
+	}
+
+	Printf("%s: %u bytes, %u keys\n", argv[1], textmap.Size(), bench.Keys);
+	Printf("FScanner:  %.3f ms\n", time[0]);
+	Printf("Fast path: %.3f ms (%.2fx)\n", time[1], time[1] > 0 ? time[0] / time[1] : 0.);
+	if (checksum[0] != checksum[1])
+	{
+		Printf(TEXTCOLOR_RED "The results of both scanners differ\n");
+	}
+}
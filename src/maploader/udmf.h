@@ -4,16 +4,51 @@
 #include "sc_man.h"
 #include "m_fixed.h"
 
+//===========================================================================
+//
+// Scanner with a fast path for the 'key = value;' statements that make up
+// almost all of a TEXTMAP. Anything it does not handle itself, like
+// comments, escape sequences or unusual number formats, is left to the
+// regular FScanner code, so both produce the same results.
+//
+//===========================================================================
+
+class FUDMFScanner : public FScanner
+{
+public:
+	FUDMFScanner();
+	bool CheckBlockEnd();
+	bool GetKeyValue(FName &key, FString &string);
+
+private:
+	struct FKeyCacheEntry
+	{
+		FName Name;
+		uint8_t Len;
+		char Text[31];
+	};
+	enum { KEY_CACHE_SIZE = 256 };
+
+	// Maps the spelling of recently seen keys to their names, which saves the lookup in the global name table.
+	FKeyCacheEntry KeyCache[KEY_CACHE_SIZE];
+
+	const char *SkipWhitespace(const char *p, int &line, bool &crossed);
+	FName LookupKey(const char *text, int len, unsigned hash);
+	void SetToken(int token, const char *start, int startline, const char *end, int line, bool crossed);
+};
+
 class UDMFParserBase
 {
 protected:
-	FScanner sc;
+	FUDMFScanner sc;
 	FName namespc = NAME_None;
 	int namespace_bits;
 	FString parsedString;
 	bool BadCoordinates = false;
+	bool FastKeys = true;
 
 	void Skip();
+	bool CheckBlockEnd();
 	FName ParseKey(bool checkblock = false, bool *isblock = NULL);
 	int CheckInt(FName key);
 	double CheckFloat(FName key);
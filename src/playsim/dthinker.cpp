@@ -38,6 +38,7 @@
 #include "serializer_doom.h"
 #include "d_player.h"
 #include "vm.h"
+#include "types.h"
 #include "c_dispatch.h"
 #include "v_text.h"
 #include "g_levellocals.h"
@@ -47,9 +48,22 @@
 #include "d_main.h"
 
 #include "p_visualthinker.h"
+#include "ctpl.h"
 
-static int ThinkCount;
-static cycle_t ThinkCycles;
+#include <atomic>
+#include <future>
+
+// Number of worker threads used for thinkers which can tick independently of each other. 0 disables this.
+// This has no influence on the game state so it is safe to change during demos and netgames.
+enum { MAX_THINKER_THREADS = 16 };
+CUSTOM_CVAR(Int, thinker_threads, 0, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
+{
+	if (self < 0) self = 0;
+	else if (self > MAX_THINKER_THREADS) self = MAX_THINKER_THREADS;
+}
+
+int ThinkCount;
+cycle_t ThinkCycles;
 extern cycle_t BotSupportCycles;
 extern cycle_t ActionCycles;
 extern int BotWTG;
@@ -71,6 +85,10 @@ static TMap<FName, ProfileInfo> Profiles;
 static unsigned int profilethinkers, profilelimit;
 DThinker *NextToThink;
 
+// Below this the overhead of distributing the work is larger than the gain.
+static const unsigned MIN_CONCURRENT_THINKERS = 512;
+static ctpl::thread_pool *ThinkerPool;
+
 //==========================================================================
 //
 //
@@ -146,7 +164,15 @@ void FThinkerCollection::RunThinkers(FLevelLocals *Level)
 		// Tick every thinker left from last time
 		for (i = STAT_FIRST_THINKING; i <= MAX_STATNUM; ++i)
 		{
-			Thinkers[i].TickThinkers(nullptr);
+			// Only the scrollers have a meaningful number of thinkers that can run concurrently.
+			if (i == STAT_SCROLLER && thinker_threads > 0)
+			{
+				Thinkers[i].TickThinkersConcurrent(thinker_threads);
+			}
+			else
+			{
+				Thinkers[i].TickThinkers(nullptr);
+			}
 		}
 
 		// Keep ticking the fresh thinkers until there are no new ones.
@@ -625,6 +651,151 @@ int FThinkerList::TickThinkers(FThinkerList *dest)
 	return count;
 }
 
+//==========================================================================
+//
+// Only thinkers with a native Tick can run on a worker. A scripted Tick
+// override has to go through CallTick and the VM, which is not thread safe.
+//
+//==========================================================================
+
+static bool HasNativeTick(DThinker *thinker)
+{
+	IFVIRTUALPTR(thinker, DThinker, Tick)
+	{
+		return !!(func->VarFlags & VARF_Native);
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// Ticks a run of consecutive thinkers with a TickAffectee. Thinkers sharing
+// an affectee are ticked by the same worker in list order, and thinkers
+// with different affectees do not touch each other's data, so this gives
+// the same result as ticking the run serially.
+//
+//==========================================================================
+
+struct FConcurrentThinker
+{
+	const void *key;
+	DThinker *thinker;
+};
+
+static void TickConcurrentRun(TArray<FConcurrentThinker> &run, int numthreads)
+{
+	static TArray<unsigned> groups;
+
+	if (run.Size() < MIN_CONCURRENT_THINKERS)
+	{
+		for (auto &entry : run)
+		{
+			entry.thinker->Tick();
+		}
+		ThinkCount += run.Size();
+		run.Clear();
+		return;
+	}
+
+	std::stable_sort(run.begin(), run.end(), [](const FConcurrentThinker &a, const FConcurrentThinker &b)
+	{
+		return a.key < b.key;
+	});
+	groups.Clear();
+	for (unsigned i = 0; i < run.Size(); i++)
+	{
+		if (i == 0 || run[i].key != run[i - 1].key) groups.Push(i);
+	}
+	groups.Push(run.Size());
+
+	if (ThinkerPool == nullptr) ThinkerPool = new ctpl::thread_pool(numthreads);
+	else if (ThinkerPool->size() != numthreads) ThinkerPool->resize(numthreads);
+
+	// Groups are handed out in small batches so that a few large groups do not stall a single worker.
+	std::atomic<unsigned> nextgroup{ 0 };
+	const unsigned numgroups = groups.Size() - 1;
+	auto worker = [&](int)
+	{
+		const unsigned batch = 16;
+		for (unsigned first; (first = nextgroup.fetch_add(batch)) < numgroups;)
+		{
+			const unsigned last = groups[min(first + batch, numgroups)];
+			for (unsigned i = groups[first]; i < last; i++)
+			{
+				run[i].thinker->Tick();
+			}
+		}
+	};
+
+	std::future<void> futures[MAX_THINKER_THREADS];
+	for (int i = 0; i < numthreads; i++)
+	{
+		futures[i] = ThinkerPool->push(worker);
+	}
+	worker(0);
+	for (int i = 0; i < numthreads; i++)
+	{
+		futures[i].wait();
+	}
+
+	ThinkCount += run.Size();
+	run.Clear();
+}
+
+//==========================================================================
+//
+// Same as TickThinkers, except that runs of thinkers with a TickAffectee
+// are ticked on a worker pool. Every other thinker still ticks at its
+// place in the list, after the run in front of it has finished, so the
+// order of ticks as seen by the rest of the game is unchanged.
+//
+//==========================================================================
+
+int FThinkerList::TickThinkersConcurrent(int numthreads)
+{
+	static TArray<FConcurrentThinker> run;
+
+	int count = 0;
+	DThinker *node = GetHead();
+
+	if (node == nullptr)
+	{
+		return 0;
+	}
+
+	run.Clear();
+	while (node != Sentinel)
+	{
+		++count;
+		NextToThink = node->NextThinker;
+		if (!(node->ObjectFlags & (OF_JustSpawned | OF_EuthanizeMe)) && HasNativeTick(node))
+		{
+			auto key = node->TickAffectee();
+			if (key != nullptr)
+			{
+				run.Push({ key, node });
+				node = NextToThink;
+				continue;
+			}
+		}
+
+		TickConcurrentRun(run, numthreads);
+		if (node->ObjectFlags & OF_JustSpawned)
+		{
+			node->CallPostBeginPlay();
+		}
+		if (!(node->ObjectFlags & OF_EuthanizeMe))
+		{ // Only tick thinkers not scheduled for destruction
+			ThinkCount++;
+			node->CallTick();
+			node->ObjectFlags &= ~OF_JustSpawned;
+		}
+		node = NextToThink;
+	}
+	TickConcurrentRun(run, numthreads);
+	return count;
+}
+
 //==========================================================================
 //
 //
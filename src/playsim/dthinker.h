@@ -61,6 +61,7 @@ struct FThinkerList
 	void DestroyThinkers();
 	bool DoDestroyThinkers();
 	int TickThinkers(FThinkerList *dest);	// Returns: # of thinkers ticked
+	int TickThinkersConcurrent(int numthreads);
 	int ProfileThinkers(FThinkerList *dest);
 	void SaveList(FSerializer &arc);
 
@@ -106,6 +107,10 @@ public:
 	virtual void PostSerialize();
 	void Serialize(FSerializer &arc) override;
 	size_t PropagateMark();
+
+	// If this returns non-null, Tick() writes nothing but the thinker itself and the returned object,
+	// and only reads data no other thinker in its list writes, so thinkers with different affectees may tick concurrently.
+	virtual const void *TickAffectee() const { return nullptr; }
 	
 	void ChangeStatNum (int statnum);
 
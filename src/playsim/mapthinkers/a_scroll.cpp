@@ -274,6 +274,30 @@ void DScroller::Tick ()
 	}
 }
 
+//-----------------------------------------------------------------------------
+//
+// Texture scrollers only change the offsets of their own side or sector.
+// Carrying scrollers touch actors and the level's scroll table so they
+// always tick serially.
+//
+//-----------------------------------------------------------------------------
+
+const void *DScroller::TickAffectee() const
+{
+	switch (m_Type)
+	{
+	case EScroll::sc_side:
+		return m_Side;
+
+	case EScroll::sc_floor:
+	case EScroll::sc_ceiling:
+		return m_Sector;
+
+	default:
+		return nullptr;
+	}
+}
+
 //-----------------------------------------------------------------------------
 //
 // Add_Scroller()
@@ -78,6 +78,7 @@
 #include "s_music.h"
 #include "v_video.h"
 #include "texturemanager.h"
+#include "vmintern.h"
 
 	// P-codes for ACS scripts
 	enum
@@ -932,8 +933,8 @@ void ACSStringPool::PoolEntry::Unlock(int levelnum)
 
 ACSStringPool::ACSStringPool()
 {
-	memset(PoolBuckets, 0xFF, sizeof(PoolBuckets));
-	FirstFreeEntry = 0;
+	UsedCount = 0;
+	FirstFreeEntry = NO_ENTRY;
 }
 
 //============================================================================
@@ -947,8 +948,9 @@ ACSStringPool::ACSStringPool()
 void ACSStringPool::Clear()
 {
 	Pool.Clear();
-	memset(PoolBuckets, 0xFF, sizeof(PoolBuckets));
-	FirstFreeEntry = 0;
+	Table.Clear();
+	UsedCount = 0;
+	FirstFreeEntry = NO_ENTRY;
 }
 
 //============================================================================
@@ -965,26 +967,24 @@ int ACSStringPool::AddString(const char *str)
 	if (str == nullptr) str = "";
 	size_t len = strlen(str);
 	unsigned int h = SuperFastHash(str, len);
-	unsigned int bucketnum = h % NUM_BUCKETS;
-	int i = FindString(str, len, h, bucketnum);
+	int i = FindString(str, len, h);
 	if (i >= 0)
 	{
 		return i | STRPOOL_LIBRARYID_OR;
 	}
 	FString fstr(str);
-	return InsertString(fstr, h, bucketnum);
+	return InsertString(fstr, h);
 }
 
 int ACSStringPool::AddString(FString &str)
 {
 	unsigned int h = SuperFastHash(str.GetChars(), str.Len());
-	unsigned int bucketnum = h % NUM_BUCKETS;
-	int i = FindString(str.GetChars(), str.Len(), h, bucketnum);
+	int i = FindString(str.GetChars(), str.Len(), h);
 	if (i >= 0)
 	{
 		return i | STRPOOL_LIBRARYID_OR;
 	}
-	return InsertString(str, h, bucketnum);
+	return InsertString(str, h);
 }
 
 //============================================================================
@@ -997,7 +997,7 @@ const char *ACSStringPool::GetString(int strnum)
 {
 	assert((strnum & LIBRARYID_MASK) == STRPOOL_LIBRARYID_OR);
 	strnum &= ~LIBRARYID_MASK;
-	if ((unsigned)strnum < Pool.Size() && Pool[strnum].Next != FREE_ENTRY)
+	if ((unsigned)strnum < Pool.Size() && !Pool[strnum].Free)
 	{
 		return Pool[strnum].Str.GetChars();
 	}
@@ -1144,39 +1144,24 @@ void ACSStringPool::UnlockAll()
 
 void ACSStringPool::PurgeStrings()
 {
-	// Clear the hash buckets. We'll rebuild them as we decide what strings
-	// to keep and which to toss.
-	memset(PoolBuckets, 0xFF, sizeof(PoolBuckets));
-	size_t usedcount = 0, freedcount = 0;
-	for (unsigned int i = 0; i < Pool.Size(); ++i)
+	for (auto &entry : Pool)
 	{
-		PoolEntry *entry = &Pool[i];
-		if (entry->Next != FREE_ENTRY)
+		if (!entry.Free)
 		{
-			if (entry->Locks.Size() == 0 && !entry->Mark)
+			if (entry.Locks.Size() == 0 && !entry.Mark)
 			{
-				freedcount++;
-				// Mark this entry as free.
-				entry->Next = FREE_ENTRY;
-				if (i < FirstFreeEntry)
-				{
-					FirstFreeEntry = i;
-				}
-				// And free the string.
-				entry->Str = "";
+				entry.Free = true;
+				entry.Str = "";
 			}
 			else
 			{
-				usedcount++;
-				// Rehash this entry.
-				unsigned int h = entry->Hash % NUM_BUCKETS;
-				entry->Next = PoolBuckets[h];
-				PoolBuckets[h] = i;
 				// Remove MarkString's mark.
-				entry->Mark = false;
+				entry.Mark = false;
 			}
 		}
 	}
+	RebuildFreeList();
+	RebuildTable();
 }
 
 //============================================================================
@@ -1188,19 +1173,22 @@ void ACSStringPool::PurgeStrings()
 //
 //============================================================================
 
-int ACSStringPool::FindString(const char *str, size_t len, unsigned int h, unsigned int bucketnum)
+int ACSStringPool::FindString(const char *str, size_t len, unsigned int h) const
 {
-	unsigned int i = PoolBuckets[bucketnum];
-	while (i != NO_ENTRY)
+	if (Table.Size() == 0)
 	{
-		PoolEntry *entry = &Pool[i];
-		assert(entry->Next != FREE_ENTRY);
+		return -1;
+	}
+	const unsigned int mask = Table.Size() - 1;
+	for (unsigned int slot = h & mask; Table[slot] != NO_ENTRY; slot = (slot + 1) & mask)
+	{
+		const PoolEntry *entry = &Pool[Table[slot]];
+		assert(!entry->Free);
 		if (entry->Hash == h && entry->Str.Len() == len &&
 			memcmp(entry->Str.GetChars(), str, len) == 0)
 		{
-			return i;
+			return Table[slot];
 		}
-		i = entry->Next;
 	}
 	return -1;
 }
@@ -1213,52 +1201,121 @@ int ACSStringPool::FindString(const char *str, size_t len, unsigned int h, unsig
 //
 //============================================================================
 
-int ACSStringPool::InsertString(FString &str, unsigned int h, unsigned int bucketnum)
+int ACSStringPool::InsertString(FString &str, unsigned int h)
 {
-	unsigned int index = FirstFreeEntry;
-	if (index >= MIN_GC_SIZE && index == Pool.Max())
+	if (FirstFreeEntry == NO_ENTRY && Pool.Size() >= MIN_GC_SIZE && Pool.Size() == Pool.Max())
 	{ // We will need to grow the array. Try a garbage collection first.
 		P_CollectACSGlobalStrings();
-		index = FirstFreeEntry;
 	}
-	if (FirstFreeEntry >= STRPOOL_LIBRARYID_OR)
+	unsigned int index = FirstFreeEntry != NO_ENTRY ? FirstFreeEntry : Pool.Size();
+	if (index >= STRPOOL_LIBRARYID_OR)
 	{ // If we go any higher, we'll collide with the library ID marker.
 		return -1;
 	}
 	if (index == Pool.Size())
 	{ // There were no free entries; make a new one.
-		Pool.Reserve(MIN_GC_SIZE);
-		FirstFreeEntry++;
+		// Grow in proportion to the pool so that the collections it triggers stay rare when lots of strings are in use.
+		Pool.Grow(max<unsigned>(MIN_GC_SIZE, Pool.Size() / 2));
+		Pool.Reserve(1);
 	}
 	else
-	{ // Scan for the next free entry
-		FindFirstFreeEntry(FirstFreeEntry + 1);
+	{
+		FirstFreeEntry = Pool[index].NextFree;
 	}
 	PoolEntry *entry = &Pool[index];
 	entry->Str = str;
 	entry->Hash = h;
-	entry->Next = PoolBuckets[bucketnum];
+	entry->NextFree = NO_ENTRY;
+	entry->Free = false;
 	entry->Mark = false;
 	entry->Locks.Clear();
-	PoolBuckets[bucketnum] = index;
+	UsedCount++;
+	AddToTable(index);
 	return index | STRPOOL_LIBRARYID_OR;
 }
 
 //============================================================================
 //
-// ACSStringPool :: FindFirstFreeEntry
+// ACSStringPool :: AddToTable
 //
-// Finds the first free entry, starting at base.
+// Adds a pool entry to the hash table, which is kept at most half full.
 //
 //============================================================================
 
-void ACSStringPool::FindFirstFreeEntry(unsigned base)
+void ACSStringPool::AddToTable(unsigned int index)
 {
-	while (base < Pool.Size() && Pool[base].Next != FREE_ENTRY)
+	if (UsedCount * 2 > Table.Size())
 	{
-		base++;
+		RebuildTable();
+		return;
+	}
+	const unsigned int mask = Table.Size() - 1;
+	unsigned int slot = Pool[index].Hash & mask;
+	while (Table[slot] != NO_ENTRY)
+	{
+		slot = (slot + 1) & mask;
+	}
+	Table[slot] = index;
+}
+
+//============================================================================
+//
+// ACSStringPool :: RebuildTable
+//
+// Recreates the hash table for all strings in the pool. Entries are never
+// removed from the table individually, so there is no need for tombstones.
+//
+//============================================================================
+
+void ACSStringPool::RebuildTable()
+{
+	unsigned int size = MIN_TABLE_SIZE;
+	while (size < UsedCount * 2)
+	{
+		size <<= 1;
+	}
+	Table.Resize(size);
+	memset(Table.Data(), 0xFF, size * sizeof(unsigned int));
+
+	const unsigned int mask = size - 1;
+	for (unsigned int i = 0; i < Pool.Size(); ++i)
+	{
+		if (!Pool[i].Free)
+		{
+			unsigned int slot = Pool[i].Hash & mask;
+			while (Table[slot] != NO_ENTRY)
+			{
+				slot = (slot + 1) & mask;
+			}
+			Table[slot] = i;
+		}
+	}
+}
+
+//============================================================================
+//
+// ACSStringPool :: RebuildFreeList
+//
+// Links all free entries, lowest index first, and counts the used ones.
+//
+//============================================================================
+
+void ACSStringPool::RebuildFreeList()
+{
+	FirstFreeEntry = NO_ENTRY;
+	UsedCount = 0;
+	for (unsigned int i = Pool.Size(); i-- > 0; )
+	{
+		if (Pool[i].Free)
+		{
+			Pool[i].NextFree = FirstFreeEntry;
+			FirstFreeEntry = i;
+		}
+		else
+		{
+			UsedCount++;
+		}
 	}
-	FirstFreeEntry = base;
 }
 
 //============================================================================
@@ -1281,7 +1338,7 @@ void ACSStringPool::ReadStrings(FSerializer &file, const char *key)
 		Pool.Resize(poolsize);
 		for (auto &p : Pool)
 		{
-			p.Next = FREE_ENTRY;
+			p.Free = true;
 			p.Mark = false;
 			p.Locks.Clear();
 		}
@@ -1299,11 +1356,8 @@ void ACSStringPool::ReadStrings(FSerializer &file, const char *key)
 						file("string", Pool[ii].Str)
 							("locks", Pool[ii].Locks);
 
-						unsigned h = SuperFastHash(Pool[ii].Str.GetChars(), Pool[ii].Str.Len());
-						unsigned bucketnum = h % NUM_BUCKETS;
-						Pool[ii].Hash = h;
-						Pool[ii].Next = PoolBuckets[bucketnum];
-						PoolBuckets[bucketnum] = ii;
+						Pool[ii].Hash = SuperFastHash(Pool[ii].Str.GetChars(), Pool[ii].Str.Len());
+						Pool[ii].Free = false;
 					}
 					file.EndObject();
 				}
@@ -1311,7 +1365,8 @@ void ACSStringPool::ReadStrings(FSerializer &file, const char *key)
 		}
 	}
 
-	FindFirstFreeEntry(FirstFreeEntry);
+	RebuildFreeList();
+	RebuildTable();
 }
 
 //============================================================================
@@ -1338,7 +1393,7 @@ void ACSStringPool::WriteStrings(FSerializer &file, const char *key) const
 			for (i = 0; i < poolsize; ++i)
 			{
 				PoolEntry *entry = &Pool[i];
-				if (entry->Next != FREE_ENTRY)
+				if (!entry->Free)
 				{
 					if (file.BeginObject(nullptr))
 					{
@@ -1367,12 +1422,12 @@ void ACSStringPool::Dump() const
 {
 	for (unsigned int i = 0; i < Pool.Size(); ++i)
 	{
-		if (Pool[i].Next != FREE_ENTRY)
+		if (!Pool[i].Free)
 		{
 			Printf("%4u. (%2d) \"%s\"\n", i, Pool[i].Locks.Size(), Pool[i].Str.GetChars());
 		}
 	}
-	Printf("First free %u\n", FirstFreeEntry);
+	Printf("First free %d\n", FirstFreeEntry == NO_ENTRY ? (int)Pool.Size() : (int)FirstFreeEntry);
 }
 
 
@@ -1380,7 +1435,7 @@ void ACSStringPool::UnlockForLevel(int lnum)
 {
 	for (unsigned int i = 0; i < Pool.Size(); ++i)
 	{
-		if (Pool[i].Next != FREE_ENTRY)
+		if (!Pool[i].Free)
 		{
 			auto ndx = Pool[i].Locks.Find(lnum);
 			if (ndx < Pool[i].Locks.Size())
@@ -6902,6 +6957,842 @@ PClass *DLevelScript::GetClassForIndex(int index) const
 	return PClass::FindActor(Level->Behaviors.LookupString(index));
 }
 
+//==========================================================================
+//
+// Translation of ACS functions to VM code
+//
+// A function that works on nothing but its arguments, its local variables
+// and the stack has no side effects, so instead of interpreting it, it can
+// be translated to VM code and handed to the JIT like any other script
+// function. The translated code returns the function's result, a flag and
+// the number of ACS instructions it executed, which the caller adds to the
+// script's runaway count. The flag is 0 when the code runs into something the
+// interpreter has to deal with, i.e. a division by zero or more instructions
+// than the script has left before it is considered a runaway. Since nothing
+// has been modified at that point, the call is then repeated by the
+// interpreter, which will report the problem exactly as it always did.
+//
+//==========================================================================
+
+CVAR(Bool, acs_jit, true, CVAR_SERVERINFO)
+
+enum
+{
+	ACS_MaxRunaway = 2000000,		// instructions a script may execute in one tic
+	ACSJIT_MaxRegs = 128,			// function locals, stack slots and temporaries
+};
+
+struct FACSTranslation
+{
+	VMFunction *Func;	// cleared by PClass::StaticShutdown
+};
+
+// Keyed by the function's code, so that reloading a map or library reuses the translations.
+static TMap<FString, FACSTranslation *> ACSTranslations;
+
+class FACSTranslator
+{
+public:
+	FACSTranslator(FBehavior *module, ScriptFunction *func)
+		: Module(module), Function(func)
+	{
+	}
+
+	bool Analyze();
+	FString Key() const;
+	VMScriptFunction *Translate();
+
+private:
+	struct FInstr
+	{
+		int Pcd;
+		uint32_t Ofs;
+		uint32_t Next;
+		int Arg;
+		uint32_t Target;
+		const uint8_t *Bytes;		// immediates of the PUSH*BYTES instructions
+		const int *Cases;			// value/target pairs of PCD_CASEGOTOSORTED
+	};
+
+	bool Decode(uint32_t ofs, FInstr &in);
+	bool Visit(uint32_t ofs, int depth, uint32_t from);
+	void Emit(const FInstr &in, int depth);
+	void EmitOp(int op, int a, int b, int c);
+	void EmitLoad(int reg, int value);
+	void EmitJump(uint32_t target);
+	void EmitBail();
+	void EmitBudgetCheck();
+	void EmitCompare(int op, int a, int b, int c, int dest);
+	int Konst(int value);
+
+	// The instruction budget is passed in the first register, the function's arguments follow.
+	int Local(int index) const { return index + 1; }
+	int Slot(int depth) const { return NumLocals + depth; }	// depth counts from 1 at the bottom of the stack
+
+	FBehavior *Module;
+	ScriptFunction *Function;
+	int NumLocals = 0;
+	int MaxDepth = 0;
+	int Temp = 0;
+	int Counter = 0;
+	const int Budget = 0;
+	uint32_t Start = 0, End = 0;			// range of the code that was reached
+
+	TMap<uint32_t, int> Depths;				// stack depth before each instruction
+	TMap<uint32_t, bool> LoopHeads;
+	TArray<uint32_t> Worklist;
+
+	TArray<VMOP> Code;
+	TArray<int> KonstD;
+	TMap<int, int> KonstMap;
+	TMap<uint32_t, int> Labels;				// ACS offset to VM instruction
+	TArray<std::pair<int, uint32_t>> Jumps;	// JMP instructions to patch with a label
+	TArray<int> Bails;						// JMP instructions to the bail out code
+};
+
+//==========================================================================
+//
+// FACSTranslator :: Decode
+//
+// Reads the instruction at the given offset exactly the way RunScript does
+// and returns false if it is one that cannot be translated.
+//
+//==========================================================================
+
+bool FACSTranslator::Decode(uint32_t ofs, FInstr &in)
+{
+	const uint32_t size = Module->GetDataSize();
+	// Enough for the longest fixed size instruction.
+	if (ofs + 16 > size) return false;
+
+	const ACSFormat fmt = Module->GetFormat();
+	int *pc = Module->Ofs2PC(ofs);
+
+	if (fmt == ACS_LittleEnhanced)
+	{
+		in.Pcd = getbyte(pc);
+		if (in.Pcd >= 256-16)
+		{
+			in.Pcd = (256-16) + ((in.Pcd - (256-16)) << 8) + getbyte(pc);
+		}
+	}
+	else
+	{
+		in.Pcd = NEXTWORD;
+	}
+	in.Ofs = ofs;
+	in.Arg = 0;
+	in.Target = 0;
+	in.Bytes = nullptr;
+	in.Cases = nullptr;
+
+	switch (in.Pcd)
+	{
+	case PCD_NOP:
+	case PCD_DUP:
+	case PCD_SWAP:
+	case PCD_DROP:
+	case PCD_ADD:
+	case PCD_SUBTRACT:
+	case PCD_MULTIPLY:
+	case PCD_DIVIDE:
+	case PCD_MODULUS:
+	case PCD_EQ:
+	case PCD_NE:
+	case PCD_LT:
+	case PCD_GT:
+	case PCD_LE:
+	case PCD_GE:
+	case PCD_ANDLOGICAL:
+	case PCD_ORLOGICAL:
+	case PCD_ANDBITWISE:
+	case PCD_ORBITWISE:
+	case PCD_EORBITWISE:
+	case PCD_NEGATELOGICAL:
+	case PCD_NEGATEBINARY:
+	case PCD_LSHIFT:
+	case PCD_RSHIFT:
+	case PCD_UNARYMINUS:
+	case PCD_RETURNVOID:
+	case PCD_RETURNVAL:
+		break;
+
+	case PCD_PUSHNUMBER:
+		in.Arg = uallong(pc[0]);
+		pc++;
+		break;
+
+	case PCD_PUSHBYTE:
+	case PCD_PUSH2BYTES:
+	case PCD_PUSH3BYTES:
+	case PCD_PUSH4BYTES:
+	case PCD_PUSH5BYTES:
+		in.Arg = in.Pcd == PCD_PUSHBYTE ? 1 : in.Pcd - PCD_PUSH2BYTES + 2;
+		in.Bytes = (uint8_t *)pc;
+		pc = (int *)((uint8_t *)pc + in.Arg);
+		break;
+
+	case PCD_PUSHBYTES:
+		in.Arg = *(uint8_t *)pc;
+		in.Bytes = (uint8_t *)pc + 1;
+		pc = (int *)((uint8_t *)pc + in.Arg + 1);
+		break;
+
+	case PCD_PUSHSCRIPTVAR:
+	case PCD_ASSIGNSCRIPTVAR:
+	case PCD_ADDSCRIPTVAR:
+	case PCD_SUBSCRIPTVAR:
+	case PCD_MULSCRIPTVAR:
+	case PCD_DIVSCRIPTVAR:
+	case PCD_MODSCRIPTVAR:
+	case PCD_ANDSCRIPTVAR:
+	case PCD_EORSCRIPTVAR:
+	case PCD_ORSCRIPTVAR:
+	case PCD_LSSCRIPTVAR:
+	case PCD_RSSCRIPTVAR:
+	case PCD_INCSCRIPTVAR:
+	case PCD_DECSCRIPTVAR:
+		in.Arg = NEXTBYTE;
+		// Out of range accesses are a fatal error in the interpreter.
+		if (in.Arg < 0 || in.Arg >= NumLocals) return false;
+		break;
+
+	case PCD_GOTO:
+	case PCD_IFGOTO:
+	case PCD_IFNOTGOTO:
+		in.Target = LittleLong(*pc);
+		pc++;
+		break;
+
+	case PCD_CASEGOTO:
+		in.Arg = uallong(pc[0]);
+		in.Target = uallong(pc[1]);
+		pc += 2;
+		break;
+
+	case PCD_CASEGOTOSORTED:
+		// The count and jump table are 4-byte aligned
+		pc = (int *)(((size_t)pc + 3) & ~3);
+		if (Module->PC2Ofs(pc) + 4 > size) return false;
+		in.Arg = uallong(pc[0]);
+		pc++;
+		if (in.Arg < 0 || Module->PC2Ofs(pc) + in.Arg * 8ull > size) return false;
+		in.Cases = pc;
+		pc += in.Arg * 2;
+		break;
+
+	default:
+		return false;
+	}
+
+	in.Next = Module->PC2Ofs(pc);
+	return in.Next <= size;
+}
+
+//==========================================================================
+//
+// FACSTranslator :: Analyze
+//
+// Follows all paths through the function to find its instructions and the
+// stack depth at each of them, which has to be the same on every path.
+//
+//==========================================================================
+
+bool FACSTranslator::Visit(uint32_t ofs, int depth, uint32_t from)
+{
+	if (ofs <= from)
+	{
+		LoopHeads[ofs] = true;
+	}
+	auto known = Depths.CheckKey(ofs);
+	if (known != nullptr)
+	{
+		return *known == depth;
+	}
+	Depths[ofs] = depth;
+	Worklist.Push(ofs);
+	return true;
+}
+
+bool FACSTranslator::Analyze()
+{
+	NumLocals = Function->ArgCount + Function->LocalCount;
+	if (Function->LocalArrays.Count > 0 || Local(NumLocals) >= ACSJIT_MaxRegs) return false;
+
+	Start = End = Function->Address;
+	Depths[Function->Address] = 0;
+	Worklist.Push(Function->Address);
+	while (Worklist.Size() > 0)
+	{
+		uint32_t ofs;
+		Worklist.Pop(ofs);
+		int depth = Depths[ofs];
+
+		FInstr in;
+		if (!Decode(ofs, in)) return false;
+		Start = min(Start, ofs);
+		End = max(End, in.Next);
+
+		int pops = 0, pushes = 0;
+		bool next = true;
+		switch (in.Pcd)
+		{
+		case PCD_PUSHNUMBER:
+		case PCD_PUSHSCRIPTVAR:
+			pushes = 1;
+			break;
+
+		case PCD_PUSHBYTE:
+		case PCD_PUSH2BYTES:
+		case PCD_PUSH3BYTES:
+		case PCD_PUSH4BYTES:
+		case PCD_PUSH5BYTES:
+		case PCD_PUSHBYTES:
+			pushes = in.Arg;
+			break;
+
+		case PCD_DUP:
+			pops = 1;
+			pushes = 2;
+			break;
+
+		case PCD_SWAP:
+			pops = pushes = 2;
+			break;
+
+		case PCD_NEGATELOGICAL:
+		case PCD_NEGATEBINARY:
+		case PCD_UNARYMINUS:
+			pops = pushes = 1;
+			break;
+
+		case PCD_INCSCRIPTVAR:
+		case PCD_DECSCRIPTVAR:
+		case PCD_NOP:
+		case PCD_RETURNVOID:
+			next = in.Pcd != PCD_RETURNVOID;
+			break;
+
+		case PCD_RETURNVAL:
+			pops = 1;
+			next = false;
+			break;
+
+		case PCD_GOTO:
+			next = false;
+			if (!Visit(in.Target, depth, ofs)) return false;
+			break;
+
+		case PCD_IFGOTO:
+		case PCD_IFNOTGOTO:
+			pops = 1;
+			if (depth < 1 || !Visit(in.Target, depth - 1, ofs)) return false;
+			break;
+
+		case PCD_CASEGOTO:
+			// The value is only dropped when the case matches.
+			if (depth < 1 || !Visit(in.Target, depth - 1, ofs)) return false;
+			break;
+
+		case PCD_CASEGOTOSORTED:
+			if (depth < 1) return false;
+			for (int i = 0; i < in.Arg; i++)
+			{
+				if (!Visit(LittleLong(in.Cases[i * 2 + 1]), depth - 1, ofs)) return false;
+			}
+			break;
+
+		case PCD_DROP:
+		case PCD_ASSIGNSCRIPTVAR:
+		case PCD_ADDSCRIPTVAR:
+		case PCD_SUBSCRIPTVAR:
+		case PCD_MULSCRIPTVAR:
+		case PCD_DIVSCRIPTVAR:
+		case PCD_MODSCRIPTVAR:
+		case PCD_ANDSCRIPTVAR:
+		case PCD_EORSCRIPTVAR:
+		case PCD_ORSCRIPTVAR:
+		case PCD_LSSCRIPTVAR:
+		case PCD_RSSCRIPTVAR:
+			pops = 1;
+			break;
+
+		default:	// all binary operators
+			pops = 2;
+			pushes = 1;
+			break;
+		}
+
+		if (depth < pops) return false;
+		depth += pushes - pops;
+		MaxDepth = max(MaxDepth, depth);
+		if (next && !Visit(in.Next, depth, ofs)) return false;
+	}
+
+	Temp = Slot(MaxDepth + 1);
+	Counter = Temp + 1;
+	return Counter < ACSJIT_MaxRegs;
+}
+
+//==========================================================================
+//
+// FACSTranslator :: Key
+//
+// Identifies the translated code. The jump targets are module offsets,
+// so the function's position is part of it.
+//
+//==========================================================================
+
+FString FACSTranslator::Key() const
+{
+	FString key;
+	key.Format("%u:%d:%d:%d:", Function->Address, Function->ArgCount, Function->LocalCount, Module->GetFormat());
+	const uint8_t *code = (const uint8_t *)Module->Ofs2PC(Start);
+	for (uint32_t i = 0; i < End - Start; i++)
+	{
+		key.AppendFormat("%02x", code[i]);
+	}
+	return key;
+}
+
+//==========================================================================
+//
+// Code generation helpers
+//
+//==========================================================================
+
+void FACSTranslator::EmitOp(int op, int a, int b, int c)
+{
+	VMOP o;
+	o.word = 0;
+	o.op = op;
+	o.a = a;
+	o.b = b;
+	o.c = c;
+	Code.Push(o);
+}
+
+int FACSTranslator::Konst(int value)
+{
+	auto index = KonstMap.CheckKey(value);
+	if (index != nullptr) return *index;
+	return KonstMap[value] = KonstD.Push(value);
+}
+
+void FACSTranslator::EmitLoad(int reg, int value)
+{
+	VMOP o;
+	o.word = 0;
+	o.a = reg;
+	if (value >= -32768 && value <= 32767)
+	{
+		o.op = OP_LI;
+		o.i16 = value;
+	}
+	else
+	{
+		o.op = OP_LK;
+		o.i16u = Konst(value);
+	}
+	Code.Push(o);
+}
+
+void FACSTranslator::EmitJump(uint32_t target)
+{
+	Jumps.Push({ (int)Code.Push({}), target });
+}
+
+void FACSTranslator::EmitBail()
+{
+	Bails.Push(Code.Push({}));
+}
+
+// dest = (b op c) == a
+void FACSTranslator::EmitCompare(int op, int a, int b, int c, int dest)
+{
+	VMOP jmp;
+	jmp.word = 0;
+	jmp.op = OP_JMP;
+
+	EmitOp(op, a, b, c);
+	jmp.i24 = 2;
+	Code.Push(jmp);
+	EmitOp(OP_LI, dest, 0, 0);
+	jmp.i24 = 1;
+	Code.Push(jmp);
+	EmitLoad(dest, 1);
+}
+
+//==========================================================================
+//
+// FACSTranslator :: Emit
+//
+//==========================================================================
+
+static int BinaryOp(int pcd)
+{
+	switch (pcd)
+	{
+	case PCD_ADD:			case PCD_ADDSCRIPTVAR:	return OP_ADD_RR;
+	case PCD_SUBTRACT:		case PCD_SUBSCRIPTVAR:	return OP_SUB_RR;
+	case PCD_MULTIPLY:		case PCD_MULSCRIPTVAR:	return OP_MUL_RR;
+	case PCD_DIVIDE:		case PCD_DIVSCRIPTVAR:	return OP_DIV_RR;
+	case PCD_MODULUS:		case PCD_MODSCRIPTVAR:	return OP_MOD_RR;
+	case PCD_ANDBITWISE:	case PCD_ANDSCRIPTVAR:	return OP_AND_RR;
+	case PCD_ORBITWISE:		case PCD_ORSCRIPTVAR:	return OP_OR_RR;
+	case PCD_EORBITWISE:	case PCD_EORSCRIPTVAR:	return OP_XOR_RR;
+	case PCD_LSHIFT:		case PCD_LSSCRIPTVAR:	return OP_SLL_RR;
+	case PCD_RSHIFT:		case PCD_RSSCRIPTVAR:	return OP_SRA_RR;
+	default:				assert(false);			return OP_NOP;
+	}
+}
+
+void FACSTranslator::EmitBudgetCheck()
+{
+	// Leave the call to the interpreter once it has run out of instructions so that it can catch runaway scripts.
+	EmitOp(OP_LE_RR, 0, Counter, Budget);
+	EmitBail();
+}
+
+void FACSTranslator::Emit(const FInstr &in, int depth)
+{
+	// Count every instruction, just like RunScript does.
+	EmitOp(OP_ADDI, Counter, Counter, 1);
+	if (LoopHeads.CheckKey(in.Ofs) != nullptr || in.Pcd == PCD_RETURNVAL || in.Pcd == PCD_RETURNVOID)
+	{
+		EmitBudgetCheck();
+	}
+
+	const int top = Slot(depth);
+	const int second = Slot(depth - 1);
+
+	switch (in.Pcd)
+	{
+	case PCD_NOP:
+	case PCD_DROP:
+		break;
+
+	case PCD_PUSHNUMBER:
+		EmitLoad(Slot(depth + 1), in.Arg);
+		break;
+
+	case PCD_PUSHBYTE:
+	case PCD_PUSH2BYTES:
+	case PCD_PUSH3BYTES:
+	case PCD_PUSH4BYTES:
+	case PCD_PUSH5BYTES:
+	case PCD_PUSHBYTES:
+		for (int i = 0; i < in.Arg; i++)
+		{
+			EmitLoad(Slot(depth + 1 + i), in.Bytes[i]);
+		}
+		break;
+
+	case PCD_DUP:
+		EmitOp(OP_MOVE, Slot(depth + 1), top, 0);
+		break;
+
+	case PCD_SWAP:
+		EmitOp(OP_MOVE, Temp, top, 0);
+		EmitOp(OP_MOVE, top, second, 0);
+		EmitOp(OP_MOVE, second, Temp, 0);
+		break;
+
+	case PCD_DIVIDE:
+	case PCD_MODULUS:
+		EmitOp(OP_EQ_K, 1, top, Konst(0));
+		EmitBail();
+		EmitOp(BinaryOp(in.Pcd), second, second, top);
+		break;
+
+	case PCD_DIVSCRIPTVAR:
+	case PCD_MODSCRIPTVAR:
+		EmitOp(OP_EQ_K, 1, top, Konst(0));
+		EmitBail();
+		EmitOp(BinaryOp(in.Pcd), Local(in.Arg), Local(in.Arg), top);
+		break;
+
+	case PCD_ADD:
+	case PCD_SUBTRACT:
+	case PCD_MULTIPLY:
+	case PCD_ANDBITWISE:
+	case PCD_ORBITWISE:
+	case PCD_EORBITWISE:
+	case PCD_LSHIFT:
+	case PCD_RSHIFT:
+		EmitOp(BinaryOp(in.Pcd), second, second, top);
+		break;
+
+	case PCD_ADDSCRIPTVAR:
+	case PCD_SUBSCRIPTVAR:
+	case PCD_MULSCRIPTVAR:
+	case PCD_ANDSCRIPTVAR:
+	case PCD_ORSCRIPTVAR:
+	case PCD_EORSCRIPTVAR:
+	case PCD_LSSCRIPTVAR:
+	case PCD_RSSCRIPTVAR:
+		EmitOp(BinaryOp(in.Pcd), Local(in.Arg), Local(in.Arg), top);
+		break;
+
+	case PCD_EQ:
+		EmitCompare(OP_EQ_R, 1, second, top, second);
+		break;
+
+	case PCD_NE:
+		EmitCompare(OP_EQ_R, 0, second, top, second);
+		break;
+
+	case PCD_LT:
+		EmitCompare(OP_LT_RR, 1, second, top, second);
+		break;
+
+	case PCD_GT:
+		EmitCompare(OP_LT_RR, 1, top, second, second);
+		break;
+
+	case PCD_LE:
+		EmitCompare(OP_LE_RR, 1, second, top, second);
+		break;
+
+	case PCD_GE:
+		EmitCompare(OP_LE_RR, 1, top, second, second);
+		break;
+
+	case PCD_ANDLOGICAL:
+		EmitCompare(OP_EQ_K, 0, second, Konst(0), second);
+		EmitCompare(OP_EQ_K, 0, top, Konst(0), top);
+		EmitOp(OP_AND_RR, second, second, top);
+		break;
+
+	case PCD_ORLOGICAL:
+		EmitOp(OP_OR_RR, second, second, top);
+		EmitCompare(OP_EQ_K, 0, second, Konst(0), second);
+		break;
+
+	case PCD_NEGATELOGICAL:
+		EmitCompare(OP_EQ_K, 1, top, Konst(0), top);
+		break;
+
+	case PCD_NEGATEBINARY:
+		EmitOp(OP_NOT, top, top, 0);
+		break;
+
+	case PCD_UNARYMINUS:
+		EmitOp(OP_NEG, top, top, 0);
+		break;
+
+	case PCD_PUSHSCRIPTVAR:
+		EmitOp(OP_MOVE, Slot(depth + 1), Local(in.Arg), 0);
+		break;
+
+	case PCD_ASSIGNSCRIPTVAR:
+		EmitOp(OP_MOVE, Local(in.Arg), top, 0);
+		break;
+
+	case PCD_INCSCRIPTVAR:
+	case PCD_DECSCRIPTVAR:
+		EmitOp(OP_ADDI, Local(in.Arg), Local(in.Arg), in.Pcd == PCD_INCSCRIPTVAR ? 1 : 0xff);
+		break;
+
+	case PCD_GOTO:
+		EmitJump(in.Target);
+		break;
+
+	case PCD_IFGOTO:
+	case PCD_IFNOTGOTO:
+		// The jump gets skipped if the value is 0 for IFGOTO or not 0 for IFNOTGOTO.
+		EmitOp(OP_EQ_K, in.Pcd == PCD_IFNOTGOTO, top, Konst(0));
+		EmitJump(in.Target);
+		break;
+
+	case PCD_CASEGOTO:
+		EmitLoad(Temp, in.Arg);
+		EmitOp(OP_EQ_R, 1, top, Temp);
+		EmitJump(in.Target);
+		break;
+
+	case PCD_CASEGOTOSORTED:
+		for (int i = 0; i < in.Arg; i++)
+		{
+			EmitLoad(Temp, LittleLong(in.Cases[i * 2]));
+			EmitOp(OP_EQ_R, 1, top, Temp);
+			EmitJump(LittleLong(in.Cases[i * 2 + 1]));
+		}
+		break;
+
+	case PCD_RETURNVAL:
+		EmitOp(OP_RET, 0, REGT_INT, top);
+		EmitOp(OP_RETI, 1, 0, 0);
+		Code.Last().i16 = 1;
+		EmitOp(OP_RET, 2 | RET_FINAL, REGT_INT, Counter);
+		break;
+
+	case PCD_RETURNVOID:
+		EmitOp(OP_RETI, 0, 0, 0);
+		EmitOp(OP_RETI, 1, 0, 0);
+		Code.Last().i16 = 1;
+		EmitOp(OP_RET, 2 | RET_FINAL, REGT_INT, Counter);
+		break;
+	}
+}
+
+//==========================================================================
+//
+// FACSTranslator :: Translate
+//
+//==========================================================================
+
+VMScriptFunction *FACSTranslator::Translate()
+{
+	// The compare instructions can only address the first 256 constants.
+	Konst(0);
+
+	TArray<uint32_t> order;
+	TMap<uint32_t, int>::Iterator it(Depths);
+	TMap<uint32_t, int>::Pair *pair;
+	while (it.NextPair(pair))
+	{
+		order.Push(pair->Key);
+	}
+	std::sort(order.begin(), order.end());
+
+	// Arguments are passed in the first registers, the other locals start out as 0.
+	for (int i = Function->ArgCount; i < NumLocals; i++)
+	{
+		EmitLoad(Local(i), 0);
+	}
+	EmitLoad(Counter, 0);
+	if (order[0] != Function->Address)
+	{
+		EmitJump(Function->Address);
+	}
+
+	for (unsigned i = 0; i < order.Size(); i++)
+	{
+		FInstr in;
+		Decode(order[i], in);
+		// Instructions that overlap cannot be translated.
+		if (i + 1 < order.Size() && order[i + 1] < in.Next) return nullptr;
+
+		Labels[in.Ofs] = Code.Size();
+		Emit(in, Depths[in.Ofs]);
+
+		const bool next = in.Pcd != PCD_GOTO && in.Pcd != PCD_RETURNVAL && in.Pcd != PCD_RETURNVOID;
+		if (next && (i + 1 == order.Size() || order[i + 1] != in.Next))
+		{
+			EmitJump(in.Next);
+		}
+	}
+
+	const int bail = Code.Size();
+	EmitOp(OP_RETI, 0, 0, 0);
+	EmitOp(OP_RETI, 1 | RET_FINAL, 0, 0);
+
+	for (auto &jump : Jumps)
+	{
+		VMOP &op = Code[jump.first];
+		op.word = 0;
+		op.op = OP_JMP;
+		op.i24 = Labels[jump.second] - jump.first - 1;
+	}
+	for (auto index : Bails)
+	{
+		VMOP &op = Code[index];
+		op.word = 0;
+		op.op = OP_JMP;
+		op.i24 = bail - index - 1;
+	}
+
+	if (KonstD.Size() > 65535) return nullptr;
+
+	auto sfunc = new VMScriptFunction(NAME_None);
+	sfunc->Alloc(Code.Size(), KonstD.Size(), 0, 0, 0, 0);
+	memcpy(sfunc->Code, Code.Data(), Code.Size() * sizeof(VMOP));
+	if (KonstD.Size() > 0) memcpy(sfunc->KonstD, KonstD.Data(), KonstD.Size() * sizeof(int));
+	sfunc->NumRegD = Counter + 1;
+	sfunc->NumArgs = Function->ArgCount + 1;
+	sfunc->StackSize = VMFrame::FrameSize(sfunc->NumRegD, 0, 0, 0, 0, 0);
+
+	FString name;
+	name.Format("ACS.%s@%u", Module->GetModuleName(), Function->Address);
+	sfunc->QualifiedName = sfunc->PrintableName = ClassDataAllocator.Strdup(name.GetChars());
+
+	TArray<PType *> args, rets;
+	for (int i = 0; i <= Function->ArgCount; i++)
+	{
+		args.Push(TypeSInt32);
+	}
+	rets.Push(TypeSInt32);
+	rets.Push(TypeSInt32);
+	rets.Push(TypeSInt32);
+	sfunc->Proto = NewPrototype(rets, args);
+	auto regtypes = (uint8_t *)ClassDataAllocator.Alloc(Function->ArgCount + 1);
+	memset(regtypes, REGT_INT, Function->ArgCount + 1);
+	sfunc->RegTypes = regtypes;
+	return sfunc;
+}
+
+//==========================================================================
+//
+// CallTranslatedFunction
+//
+// Runs an ACS function through its VM translation. Returns false if the
+// function has to be interpreted instead. The executed instructions are
+// added to runaway, so a runaway script gets terminated at the same point
+// as if the function had been interpreted.
+//
+//==========================================================================
+
+static bool CallTranslatedFunction(FBehavior *module, ScriptFunction *func, FACSStackMemory &Stack, int &sp, bool discard, unsigned int &runaway)
+{
+	if (!func->TranslationTried)
+	{
+		func->TranslationTried = true;
+		FACSTranslator translator(module, func);
+		if (translator.Analyze())
+		{
+			FString key = translator.Key();
+			auto translation = ACSTranslations.CheckKey(key);
+			if (translation == nullptr)
+			{
+				translation = &ACSTranslations.Insert(key, new FACSTranslation{ nullptr });
+			}
+			if ((*translation)->Func == nullptr)
+			{
+				(*translation)->Func = translator.Translate();
+				if ((*translation)->Func != nullptr) PClass::FunctionPtrList.Push(&(*translation)->Func);
+			}
+			func->Translation = *translation;
+		}
+	}
+	if (func->Translation == nullptr || func->Translation->Func == nullptr)
+	{
+		return false;
+	}
+
+	VMValue params[ACSJIT_MaxRegs];
+	params[0] = int(ACS_MaxRunaway - runaway);
+	for (int i = 0; i < func->ArgCount; i++)
+	{
+		params[i + 1] = Stack[sp - func->ArgCount + i];
+	}
+	int result = 0, success = 0, count = 0;
+	VMReturn rets[]{ &result, &success, &count };
+	VMCall(func->Translation->Func, params, func->ArgCount + 1, rets, 3);
+	if (!success)
+	{
+		return false;
+	}
+
+	runaway += count;
+	sp -= func->ArgCount;
+	if (!discard)
+	{
+		Stack[sp++] = result;
+	}
+	return true;
+}
+
 int DLevelScript::RunScript()
 {
 	DACSThinker *controller = Level->ACSThinker;
@@ -6995,7 +7886,7 @@ int DLevelScript::RunScript()
 
 	while (state == SCRIPT_Running)
 	{
-		if (++runaway > 2000000)
+		if (++runaway > ACS_MaxRunaway)
 		{
 			Printf ("Runaway %s terminated\n", ScriptPresentation(script).GetChars());
 			state = SCRIPT_PleaseRemove;
@@ -7307,6 +8198,10 @@ int DLevelScript::RunScript()
 					state = SCRIPT_PleaseRemove;
 					break;
 				}
+				if (acs_jit && CallTranslatedFunction(module, func, Stack, sp, pcd == PCD_CALLDISCARD, runaway))
+				{
+					break;
+				}
 				const ACSLocalVariables mylocals = locals;
 				// The function's first argument is also its first local variable.
 				locals.Reset(&Stack[sp - func->ArgCount], func->ArgCount + func->LocalCount);
@@ -9083,6 +9978,7 @@ scriptwait:
 						break;
 					}
 				}
+				P_InvalidateSightCache();
 
 				sp -= 2;
 			}
@@ -118,19 +118,21 @@ public:
 	void WriteStrings(FSerializer &file, const char *key) const;
 
 private:
-	int FindString(const char *str, size_t len, unsigned int h, unsigned int bucketnum);
-	int InsertString(FString &str, unsigned int h, unsigned int bucketnum);
-	void FindFirstFreeEntry(unsigned int base);
+	int FindString(const char *str, size_t len, unsigned int h) const;
+	int InsertString(FString &str, unsigned int h);
+	void AddToTable(unsigned int index);
+	void RebuildTable();
+	void RebuildFreeList();
 
-	enum { NUM_BUCKETS = 251 };
-	enum { FREE_ENTRY = 0xFFFFFFFE };	// Stored in PoolEntry's Next field
 	enum { NO_ENTRY = 0xFFFFFFFF };
 	enum { MIN_GC_SIZE = 100 };			// Don't auto-collect until there are this many strings
+	enum { MIN_TABLE_SIZE = 256 };
 	struct PoolEntry
 	{
 		FString Str;
 		unsigned int Hash;
-		unsigned int Next = FREE_ENTRY;
+		unsigned int NextFree = NO_ENTRY;
+		bool Free = true;
 		bool Mark;
 		TArray<int> Locks;
 
@@ -138,8 +140,9 @@ private:
 		void Unlock(int levelnum);
 	};
 	TArray<PoolEntry> Pool;
-	unsigned int PoolBuckets[NUM_BUCKETS];
-	unsigned int FirstFreeEntry;
+	TArray<unsigned int> Table;			// open addressed, holds pool indices or NO_ENTRY
+	unsigned int UsedCount;
+	unsigned int FirstFreeEntry;		// head of the free list, NO_ENTRY if Pool has no free entries
 };
 extern ACSStringPool GlobalACSStrings;
 
@@ -313,6 +316,8 @@ struct ScriptFunction
 	int  LocalCount;
 	uint32_t Address;
 	ACSLocalArrays LocalArrays;
+	struct FACSTranslation *Translation = nullptr;	// VM code for the function, if it could be translated
+	bool TranslationTried = false;
 };
 
 // Script types
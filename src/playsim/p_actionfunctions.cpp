@@ -1784,25 +1784,25 @@ DEFINE_ACTION_FUNCTION(AActor, CheckIfSeen)
 	PARAM_SELF_PROLOGUE(AActor);
 
 	auto Level = self->Level;
+	AActor *viewers[MAXPLAYERS * 2];
+	unsigned numviewers = 0;
 	for (int i = 0; i < MAXPLAYERS; i++) 
 	{
 		if (Level->PlayerInGame(i))
 		{
 			auto p = Level->Players[i];
 			// Always check sight from each player.
-			if (P_CheckSight(p->mo, self, SF_IGNOREVISIBILITY))
-			{
-				ACTION_RETURN_BOOL(false);
-			}
+			viewers[numviewers++] = p->mo;
 			// If a player is viewing from a non-player, then check that too.
-			if (p->camera != nullptr && p->camera->player == NULL &&
-				P_CheckSight(p->camera, self, SF_IGNOREVISIBILITY))
+			if (p->camera != nullptr && p->camera->player == NULL)
 			{
-				ACTION_RETURN_BOOL(false);
+				viewers[numviewers++] = p->camera;
 			}
 		}
 	}
-	ACTION_RETURN_BOOL(true);
+	// One viewer that can see it is enough.
+	static TArray<uint32_t> visible;
+	ACTION_RETURN_BOOL(!P_CheckSightBatch(viewers, numviewers, self, SF_IGNOREVISIBILITY, visible, true));
 }
 
 //===========================================================================
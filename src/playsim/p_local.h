@@ -272,6 +272,7 @@ bool	P_BounceWall (AActor *mo);
 bool	P_BounceActor (AActor *mo, AActor *BlockingMobj, bool ontop);
 bool    P_ReflectOffActor(AActor* mo, AActor* blocking);
 int	P_CheckSight (AActor *t1, AActor *t2, int flags=0);
+bool	P_CheckSightBatch (AActor *const *sources, unsigned count, AActor *target, int flags, TArray<uint32_t> &visible, bool stopatfirst = false);
 
 enum ESightFlags
 {
@@ -282,6 +283,7 @@ enum ESightFlags
 };
 
 void	P_ResetSightCounters (bool full);
+void	P_InvalidateSightCache ();
 bool	P_TalkFacing (AActor *player);
 void	P_UseLines (player_t* player);
 int	P_UsePuzzleItem (AActor *actor, int itemType);
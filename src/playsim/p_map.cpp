@@ -7280,6 +7280,9 @@ bool P_ChangeSector(sector_t *sector, int crunch, double amt, int floorOrCeil, b
 	cpos.sector = sector;
 	cpos.instant = instant;
 
+	// Moving planes can open or close lines of sight.
+	P_InvalidateSightCache();
+
 	// Also process all sectors that have 3D floors transferred from the
 	// changed sector.
 	if (sector->e->XFloor.attached.Size() && floorOrCeil != 2)
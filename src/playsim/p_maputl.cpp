@@ -79,6 +79,7 @@
 // State.
 #include "po_man.h"
 #include "vm.h"
+#include "stats.h"
 
 int P_VanillaPointOnDivlineSide(double x, double y, const divline_t* line);
 
@@ -340,6 +341,8 @@ void AActor::UnlinkFromWorld (FLinkContext *ctx)
 				block->NextActor->PrevActor = block->PrevActor;
 			}
 			*(block->PrevActor) = block->NextActor;
+			Level->blockmap.blockthings[block->BlockIndex].Remove(block);
+			Level->blockmap.AddCoarseThing(block->BlockIndex, -1);
 			FBlockNode *next = block->NextBlock;
 			block->Release ();
 			block = next;
@@ -551,10 +554,20 @@ void AActor::LinkToWorld(FLinkContext *ctx, bool spawningmapthing, sector_t *sec
 						node->NextBlock = NULL;
 						(*alink) = node;
 						alink = &node->NextBlock;
+
+						Level->blockmap.blockthings[node->BlockIndex].Add(node);
+						Level->blockmap.AddCoarseThing(node->BlockIndex, 1);
 					}
 				}
 			}
 		}
+		if (BlockNode != nullptr && BlockNode->NextBlock != nullptr)
+		{
+			for (auto node = BlockNode; node != nullptr; node = node->NextBlock)
+			{
+				Level->blockmap.blockthings[node->BlockIndex].Spans[node->ThingIndex] = 1;
+			}
+		}
 	}
 	// Portal links cannot be done unless the level is fully initialized.
 	if (!spawningmapthing) UpdateRenderSectorList();
@@ -700,10 +713,17 @@ line_t *FBlockLinesIterator::Next()
 			}
 		}
 
-		if (++curx > maxx)
+		for (;;)
 		{
-			curx = minx;
-			if (++cury > maxy) return NULL;
+			if (++curx > maxx)
+			{
+				curx = minx;
+				if (++cury > maxy) return NULL;
+			}
+			// Polyobjects are not part of the coarse grid so it can only be used without them.
+			if (Level->Polyobjects.Size() > 0 || !Level->blockmap.NoLinesInCoarse(curx, cury)) break;
+			// Nothing in the rest of this coarse cell's row.
+			curx = min(maxx, curx | (FBlockmap::COARSEMASK));
 		}
 		StartBlock(curx, cury);
 	}
@@ -896,6 +916,7 @@ FBlockThingsIterator::FBlockThingsIterator(FLevelLocals *l)
 	miny = maxy = 0;
 	ClearHash();
 	block = NULL;
+	blockpos = 0;
 }
 
 FBlockThingsIterator::FBlockThingsIterator(FLevelLocals *l, int _minx, int _miny, int _maxx, int _maxy)
@@ -910,6 +931,17 @@ FBlockThingsIterator::FBlockThingsIterator(FLevelLocals *l, int _minx, int _miny
 	Reset();
 }
 
+FBlockThingsIterator::FBlockThingsIterator(FLevelLocals *l, const FBoundingBox &box)
+{
+	Level = l;
+	init(box);
+}
+
+FBlockThingsIterator::~FBlockThingsIterator()
+{
+	ReleaseBlock();
+}
+
 void FBlockThingsIterator::init(const FBoundingBox &box, bool clearhash)
 {
 	maxy = Level->blockmap.GetBlockY(box.Top());
@@ -941,19 +973,72 @@ void FBlockThingsIterator::ClearHash()
 
 void FBlockThingsIterator::StartBlock(int x, int y)
 {
+	ReleaseBlock();
 	curx = x;
 	cury = y;
 	if (Level->blockmap.isValidBlock(x, y))
 	{
-		block = Level->blockmap.blocklinks[y*Level->blockmap.bmapwidth + x];
+		// Things that get linked into this block while iterating are appended and therefore never visited,
+		// just like the head insertion into blocklinks does it.
+		block = &Level->blockmap.blockthings[y*Level->blockmap.bmapwidth + x];
+		generation = Level->blockmap.thinggeneration;
+		blockpos = block->Size();
+		if (detached)
+		{
+			nodes = block->Nodes;
+			actors = block->Actors;
+		}
+		else block->Iterators++;
 	}
 	else
 	{
 		// invalid block
 		block = NULL;
+		blockpos = 0;
 	}
 }
 
+//===========================================================================
+//
+// FBlockThingsIterator :: ReleaseBlock
+//
+// Allows the current block to be compacted again.
+//
+//===========================================================================
+
+void FBlockThingsIterator::ReleaseBlock()
+{
+	// Detached iterators never hold a block, so they do not need a valid level here.
+	if (block != nullptr && !detached && generation == Level->blockmap.thinggeneration)
+	{
+		block->Iterators--;
+	}
+	block = nullptr;
+	blockpos = 0;
+}
+
+//===========================================================================
+//
+// FBlockThingsIterator :: Detach
+//
+// For iterators whose lifetime is not bound to the caller's scope, i.e.
+// the script side ones. Instead of keeping the current block from being
+// compacted, such an iterator works on a copy of the block's nodes.
+// Must be called before the first call to Next.
+//
+//===========================================================================
+
+void FBlockThingsIterator::Detach()
+{
+	if (!detached && block != nullptr)
+	{
+		block->Iterators--;
+		nodes = block->Nodes;
+		actors = block->Actors;
+	}
+	detached = true;
+}
+
 //===========================================================================
 //
 // FBlockThingsIterator :: SwitchBlock
@@ -975,28 +1060,51 @@ void FBlockThingsIterator::SwitchBlock(int x, int y)
 
 AActor *FBlockThingsIterator::Next(bool centeronly)
 {
+	if (block != nullptr && generation != Level->blockmap.thinggeneration)
+	{ // The blockmap was rebuilt since this iterator started.
+		block = nullptr;
+		blockpos = 0;
+		curx = maxx;
+		cury = maxy;
+		return nullptr;
+	}
 	for (;;)
 	{
-		while (block != NULL)
+		while (blockpos > 0)
 		{
-			AActor *me = block->Me;
-			FBlockNode *mynode = block;
+			int index = --blockpos;
 			HashEntry *entry;
 			int i;
 
-			block = block->NextActor;
+			if (detached)
+			{ // Skip nodes that were unlinked from this block since it was copied.
+				// Nodes get recycled, so the actor has to be checked as well.
+				auto node = nodes[index];
+				if (node == nullptr || node->ThingIndex >= (int)block->Size() || block->Nodes[node->ThingIndex] != node
+					|| block->Actors[node->ThingIndex] != actors[index])
+				{
+					continue;
+				}
+				index = node->ThingIndex;
+			}
+			AActor *me = block->Actors[index];
+			if (me == nullptr)
+			{ // Unlinked after this iterator started.
+				continue;
+			}
 			// Don't recheck things that were already checked
-			if (mynode->NextBlock == NULL && mynode->PrevBlock == &me->BlockNode)
+			if (!block->Spans[index])
 			{ // This actor doesn't span blocks, so we know it can only ever be checked once.
 				return me;
 			}
 			if (centeronly)
 			{
 				// Block boundaries for compatibility mode
-				double blockleft = (curx * FBlockmap::MAPBLOCKUNITS) + Level->blockmap.bmaporgx;
-				double blockright = blockleft + FBlockmap::MAPBLOCKUNITS;
-				double blockbottom = (cury * FBlockmap::MAPBLOCKUNITS) + Level->blockmap.bmaporgy;
-				double blocktop = blockbottom + FBlockmap::MAPBLOCKUNITS;
+				const int blockunits = Level->blockmap.blockunits;
+				double blockleft = (curx * blockunits) + Level->blockmap.bmaporgx;
+				double blockright = blockleft + blockunits;
+				double blockbottom = (cury * blockunits) + Level->blockmap.bmaporgy;
+				double blocktop = blockbottom + blockunits;
 
 				// only return actors with the center in this block
 				if (me->X() >= blockleft && me->X() < blockright &&
@@ -1042,10 +1150,20 @@ AActor *FBlockThingsIterator::Next(bool centeronly)
 			}
 		}
 
-		if (++curx > maxx)
+		for (;;)
 		{
-			curx = minx;
-			if (++cury > maxy) return NULL;
+			if (++curx > maxx)
+			{
+				curx = minx;
+				if (++cury > maxy)
+				{
+					ReleaseBlock();
+					return NULL;
+				}
+			}
+			if (!Level->blockmap.NoThingsInCoarse(curx, cury)) break;
+			// Nothing in the rest of this coarse cell's row.
+			curx = min(maxx, curx | (FBlockmap::COARSEMASK));
 		}
 		StartBlock(curx, cury);
 	}
@@ -1471,13 +1589,13 @@ void FPathTraverse::init(double x1, double y1, double x2, double y2, int flags,
 
 	x1 -= Level->blockmap.bmaporgx;
 	y1 -= Level->blockmap.bmaporgy;
-	xt1 = x1 / FBlockmap::MAPBLOCKUNITS;
-	yt1 = y1 / FBlockmap::MAPBLOCKUNITS;
+	xt1 = x1 / Level->blockmap.blockunits;
+	yt1 = y1 / Level->blockmap.blockunits;
 
 	x2 -= Level->blockmap.bmaporgx;
 	y2 -= Level->blockmap.bmaporgy;
-	xt2 = x2 / FBlockmap::MAPBLOCKUNITS;
-	yt2 = y2 / FBlockmap::MAPBLOCKUNITS;
+	xt2 = x2 / Level->blockmap.blockunits;
+	yt2 = y2 / Level->blockmap.blockunits;
 
 	mapx = xs_FloorToInt(xt1);
 	mapy = xs_FloorToInt(yt1);
@@ -1552,16 +1670,21 @@ void FPathTraverse::init(double x1, double y1, double x2, double y2, int flags,
 
 	bool compatible = (flags & PT_COMPATIBLE) && (Level->i_compatflags & COMPATF_HITSCAN);
 		
+	// Smaller blocks need more steps to cover the same distance.
+	const int maxcount = Level->blockmap.ScaleBlockDistance(1000);
+	// Polyobjects are not part of the coarse grid so it can only be used without them.
+	const bool coarselines = Level->Polyobjects.Size() == 0;
+
 	// we want to use one list of checked actors for the entire operation
 	FBlockThingsIterator btit(Level);
-	for (count = 0 ; count < 1000 ; count++)
+	for (count = 0 ; count < maxcount ; count++)
 	{
-		if (flags & PT_ADDLINES)
+		if ((flags & PT_ADDLINES) && !(coarselines && Level->blockmap.NoLinesInCoarse(mapx, mapy)))
 		{
 			AddLineIntercepts(mapx, mapy);
 		}
 		
-		if (flags & PT_ADDTHINGS)
+		if ((flags & PT_ADDTHINGS) && !Level->blockmap.NoThingsInCoarse(mapx, mapy))
 		{
 			AddThingIntercepts(mapx, mapy, btit, compatible);
 		}
@@ -1575,7 +1698,7 @@ void FPathTraverse::init(double x1, double y1, double x2, double y2, int flags,
 		switch (((xs_FloorToInt(yintercept) == mapy) << 1) | (xs_FloorToInt(xintercept) == mapx))
 		{
 		case 0:		// neither xintercept nor yintercept match!
-			count = 1000;	// Stop traversing, because somebody screwed up.
+			count = maxcount;	// Stop traversing, because somebody screwed up.
 			break;
 
 		case 1:		// xintercept matches
@@ -1602,14 +1725,14 @@ void FPathTraverse::init(double x1, double y1, double x2, double y2, int flags,
 			{
 				if (flags & PT_ADDLINES)
 				{
-					AddLineIntercepts(mapx + mapxstep, mapy);
-					AddLineIntercepts(mapx, mapy + mapystep);
+					if (!(coarselines && Level->blockmap.NoLinesInCoarse(mapx + mapxstep, mapy))) AddLineIntercepts(mapx + mapxstep, mapy);
+					if (!(coarselines && Level->blockmap.NoLinesInCoarse(mapx, mapy + mapystep))) AddLineIntercepts(mapx, mapy + mapystep);
 				}
 				
 				if (flags & PT_ADDTHINGS)
 				{
-					AddThingIntercepts(mapx + mapxstep, mapy, btit, false);
-					AddThingIntercepts(mapx, mapy + mapystep, btit, false);
+					if (!Level->blockmap.NoThingsInCoarse(mapx + mapxstep, mapy)) AddThingIntercepts(mapx + mapxstep, mapy, btit, false);
+					if (!Level->blockmap.NoThingsInCoarse(mapx, mapy + mapystep)) AddThingIntercepts(mapx, mapy + mapystep, btit, false);
 				}
 				xintercept += xstep;
 				yintercept += ystep;
@@ -1622,7 +1745,7 @@ void FPathTraverse::init(double x1, double y1, double x2, double y2, int flags,
 			}
 			else
 			{
-				count = 1000; //	Doom originally did not handle this case so do the same in compatibility mode.
+				count = maxcount; //	Doom originally did not handle this case so do the same in compatibility mode.
 			}
 			break;
 		}
@@ -1702,7 +1825,7 @@ DEFINE_ACTION_FUNCTION_NATIVE(AActor, CheckFov, P_CheckFov)
 // P_RoughMonsterSearch
 //
 // Searches though the surrounding mapblocks for monsters/players
-//		distance is in FBlockmap::MAPBLOCKUNITS
+//		distance is in FBlockmap::MAPBLOCKUNITS, regardless of the level's actual block size
 //===========================================================================
 
 AActor *P_BlockmapSearch (AActor *mo, int distance, AActor *(*check)(AActor*, int, void *), void *params)
@@ -1723,6 +1846,7 @@ AActor *P_BlockmapSearch (AActor *mo, int distance, AActor *(*check)(AActor*, in
 
 	startX = Level->blockmap.GetBlockX(mo->X());
 	startY = Level->blockmap.GetBlockY(mo->Y());
+	distance = Level->blockmap.ScaleBlockDistance(distance);
 	validcount++;
 	
 	if (Level->blockmap.isValidBlock(startX, startY))
@@ -2131,3 +2255,47 @@ DEFINE_ACTION_FUNCTION(FLevelLocals, BoxOnLineSide)
 	ACTION_RETURN_INT(BoxOnLineSide(box, l));
 }
 
+
+//===========================================================================
+//
+// Blockmap occupancy, to help picking a block size for a map
+//
+//===========================================================================
+
+ADD_STAT(blockmap)
+{
+	FString out;
+	auto &bmap = primaryLevel->blockmap;
+	if (bmap.blockmap == nullptr || bmap.blockthings == nullptr)
+	{
+		out = "No blockmap";
+		return out;
+	}
+
+	int linecells = 0, maxlines = 0, totallines = 0;
+	int thingcells = 0, maxthings = 0, totalthings = 0;
+	for (int y = 0; y < bmap.bmapheight; y++)
+	{
+		for (int x = 0; x < bmap.bmapwidth; x++)
+		{
+			int lines = 0;
+			for (int *list = bmap.GetLines(x, y); *list != -1; list++) lines++;
+			if (lines > 0) linecells++;
+			totallines += lines;
+			maxlines = max(maxlines, lines);
+
+			auto &block = bmap.blockthings[y * bmap.bmapwidth + x];
+			int things = block.Size() - block.Dead;
+			if (things > 0) thingcells++;
+			totalthings += things;
+			maxthings = max(maxthings, things);
+		}
+	}
+	out.Format("Block size %d, %dx%d blocks, coarse grid %s\n"
+		"Lines: %d blocks used, %.2f avg, %d max\n"
+		"Things: %d blocks used, %.2f avg, %d max",
+		bmap.blockunits, bmap.bmapwidth, bmap.bmapheight, bmap.coarsewidth > 0 ? "on" : "off",
+		linecells, linecells > 0 ? double(totallines) / linecells : 0., maxlines,
+		thingcells, thingcells > 0 ? double(totalthings) / thingcells : 0., maxthings);
+	return out;
+}
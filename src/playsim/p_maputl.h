@@ -10,6 +10,7 @@
 
 extern int validcount;
 struct FBlockNode;
+struct FBlockThingList;
 
 struct divline_t
 {
@@ -291,7 +292,12 @@ class FBlockThingsIterator
 
 	int curx, cury;
 
-	FBlockNode *block;
+	FBlockThingList *block = nullptr;
+	int blockpos = 0;
+	int generation = 0;
+	bool detached = false;
+	TArray<FBlockNode *> nodes;	// copy of the current block's nodes and actors for detached iterators
+	TArray<AActor *> actors;
 
 	int Buckets[32];
 
@@ -308,6 +314,7 @@ class FBlockThingsIterator
 
 	void StartBlock(int x, int y);
 	void SwitchBlock(int x, int y);
+	void ReleaseBlock();
 	void ClearHash();
 
 	// The following is only for use in the path traverser 
@@ -319,14 +326,14 @@ class FBlockThingsIterator
 
 public:
 	FBlockThingsIterator(FLevelLocals *Level, int minx, int miny, int maxx, int maxy);
-	FBlockThingsIterator(FLevelLocals *l, const FBoundingBox &box)
-	{
-		Level = l;
-		init(box);
-	}
+	FBlockThingsIterator(FLevelLocals *l, const FBoundingBox &box);
+	~FBlockThingsIterator();
+	FBlockThingsIterator(const FBlockThingsIterator &) = delete;
+	FBlockThingsIterator &operator=(const FBlockThingsIterator &) = delete;
 	void init(const FBoundingBox &box, bool clearhash = true);
 	AActor *Next(bool centeronly = false);
 	void Reset() { StartBlock(minx, miny); }
+	void Detach();
 };
 
 class FMultiBlockThingsIterator
@@ -356,6 +363,7 @@ public:
 	FMultiBlockThingsIterator(FPortalGroupArray &check, FLevelLocals *Level, double checkx, double checky, double checkz, double checkh, double checkradius, bool ignorerestricted, sector_t *newsec);
 	bool Next(CheckResult *item);
 	void Reset();
+	void Detach() { blockIterator.Detach(); }
 	const FBoundingBox &Box() const
 	{
 		return bbox;
@@ -480,3 +480,58 @@ void FBlockNode::Release()
 	NextBlock = FreeBlocks;
 	FreeBlocks = this;
 }
+
+//===========================================================================
+//
+// FBlockThingList - flat per-block copy of the blocklinks chains
+//
+//===========================================================================
+
+void FBlockThingList::Add(FBlockNode *node)
+{
+	CompactIfSparse();
+	node->ThingIndex = Actors.Push(node->Me);
+	Nodes.Push(node);
+	Spans.Push(0);
+}
+
+void FBlockThingList::Remove(FBlockNode *node)
+{
+	unsigned index = node->ThingIndex;
+	assert(index < Actors.Size() && Nodes[index] == node);
+	Actors[index] = nullptr;
+	Nodes[index] = nullptr;
+	Dead++;
+	CompactIfSparse();
+}
+
+// Removing an entry only leaves a hole, so that removal is O(1) and the order
+// is kept. The holes are squeezed out once they make up half of the list,
+// which keeps the cost of that amortized constant as well.
+void FBlockThingList::CompactIfSparse()
+{
+	if (Iterators == 0 && Dead * 2 > Size())
+	{
+		Compact();
+	}
+}
+
+void FBlockThingList::Compact()
+{
+	unsigned dest = 0;
+	for (unsigned i = 0; i < Actors.Size(); i++)
+	{
+		if (Actors[i] != nullptr)
+		{
+			Actors[dest] = Actors[i];
+			Nodes[dest] = Nodes[i];
+			Spans[dest] = Spans[i];
+			Nodes[dest]->ThingIndex = dest;
+			dest++;
+		}
+	}
+	Actors.Resize(dest);
+	Nodes.Resize(dest);
+	Spans.Resize(dest);
+	Dead = 0;
+}
@@ -36,6 +36,12 @@
 
 #include "g_levellocals.h"
 #include "actorinlines.h"
+#include "c_cvars.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define USE_SSE2
+#endif
 
 static FRandom pr_botchecksight ("BotCheckSight");
 static FRandom pr_checksight ("CheckSight");
@@ -52,9 +58,72 @@ This uses specialized forms of the maputils routines for optimized performance
 
 // Performance meters
 static int sightcounts[6];
-static cycle_t SightCycles;
+static int sightcachehits, sightcachemisses;
+cycle_t SightCycles;
 static cycle_t MaxSightCycles;
 
+// Not every script write to the level geometry invalidates the cache, so it is
+// opt-in and has to be the same for all players to keep netgames in sync.
+CVAR(Bool, sightcache, false, CVAR_SERVERINFO)
+
+//==========================================================================
+//
+// Sight cache
+//
+// Monsters tend to check sight to the same target several times per tic
+// (A_Look, A_Chase, missile range checks...). The result of the expensive
+// part, the trace through the blockmap, only depends on the positions of
+// both actors and on the level geometry, so it is remembered until the
+// next tic or until some geometry moves, whatever comes first.
+//
+//==========================================================================
+
+struct SightCacheEntry
+{
+	AActor *t1, *t2;
+	DVector3 pos1, pos2;
+	double height1, height2;
+	int flags;
+	int generation;
+	bool result;
+};
+
+enum { SIGHTCACHE_SIZE = 1024 };	// must be a power of 2
+static SightCacheEntry SightCache[SIGHTCACHE_SIZE];
+static int SightCacheGeneration = 1;
+
+static SightCacheEntry *P_GetSightCacheEntry(AActor *t1, AActor *t2)
+{
+	size_t hash = ((size_t)t1 >> 4) * 31 + ((size_t)t2 >> 4);
+	return &SightCache[(hash ^ (hash >> 10)) & (SIGHTCACHE_SIZE - 1)];
+}
+
+static bool P_MatchSightCache(const SightCacheEntry *entry, AActor *t1, AActor *t2, int flags)
+{
+	return entry->generation == SightCacheGeneration &&
+		entry->t1 == t1 && entry->t2 == t2 && entry->flags == flags &&
+		entry->pos1 == t1->Pos() && entry->pos2 == t2->Pos() &&
+		entry->height1 == t1->Height && entry->height2 == t2->Height;
+}
+
+//==========================================================================
+//
+// P_InvalidateSightCache
+//
+// Called by the native code that changes what a sight trace sees: moving
+// sector planes and polyobjects, line blocking flags and line portals.
+// Scripts writing map data fields directly (e.g. Line.flags) are not
+// tracked. Such a change can only make a pair of actors that was already
+// checked in this tic at the exact same positions get the old result
+// until the next tic starts, when the whole cache is discarded.
+//
+//==========================================================================
+
+void P_InvalidateSightCache()
+{
+	SightCacheGeneration++;
+}
+
 enum
 {
 	SO_TOPFRONT = 1,
@@ -430,6 +499,30 @@ bool SightCheck::LineBlocksSight(line_t *ld)
 ===================
 */
 
+//==========================================================================
+//
+// PointsOnDifferentSides
+//
+// Classifies two points against a divline at once. Each point undergoes
+// exactly the same arithmetic as in P_PointOnDivlineSide.
+//
+//==========================================================================
+
+static inline bool PointsOnDifferentSides(double x1, double y1, double x2, double y2, const divline_t *line)
+{
+#ifdef USE_SSE2
+	__m128d x = _mm_set_pd(x2, x1);
+	__m128d y = _mm_set_pd(y2, y1);
+	__m128d side = _mm_add_pd(
+		_mm_mul_pd(_mm_sub_pd(y, _mm_set1_pd(line->y)), _mm_set1_pd(line->dx)),
+		_mm_mul_pd(_mm_sub_pd(_mm_set1_pd(line->x), x), _mm_set1_pd(line->dy)));
+	int mask = _mm_movemask_pd(_mm_cmpgt_pd(side, _mm_set1_pd(EQUAL_EPSILON)));
+	return mask == 1 || mask == 2;
+#else
+	return P_PointOnDivlineSide(x1, y1, line) != P_PointOnDivlineSide(x2, y2, line);
+#endif
+}
+
 bool SightCheck::P_SightCheckLine (line_t *ld)
 {
 	divline_t dl;
@@ -439,14 +532,12 @@ bool SightCheck::P_SightCheckLine (line_t *ld)
 		return true;
 	}
 	ld->validcount = validcount;
-	if (P_PointOnDivlineSide (ld->v1->fPos(), &Trace) ==
-		P_PointOnDivlineSide (ld->v2->fPos(), &Trace))
+	if (!PointsOnDifferentSides (ld->v1->fX(), ld->v1->fY(), ld->v2->fX(), ld->v2->fY(), &Trace))
 	{
 		return true;		// line isn't crossed
 	}
 	P_MakeDivline (ld, &dl);
-	if (P_PointOnDivlineSide (Trace.x, Trace.y, &dl) ==
-		P_PointOnDivlineSide (Trace.x+Trace.dx, Trace.y+Trace.dy, &dl))
+	if (!PointsOnDifferentSides (Trace.x, Trace.y, Trace.x+Trace.dx, Trace.y+Trace.dy, &dl))
 	{
 		return true;		// line isn't crossed
 	}
@@ -669,13 +760,13 @@ bool SightCheck::P_SightPathTraverse ()
 
 	x1 -= Level->blockmap.bmaporgx;
 	y1 -= Level->blockmap.bmaporgy;
-	xt1 = x1 / FBlockmap::MAPBLOCKUNITS;
-	yt1 = y1 / FBlockmap::MAPBLOCKUNITS;
+	xt1 = x1 / Level->blockmap.blockunits;
+	yt1 = y1 / Level->blockmap.blockunits;
 
 	x2 -= Level->blockmap.bmaporgx;
 	y2 -= Level->blockmap.bmaporgy;
-	xt2 = x2 / FBlockmap::MAPBLOCKUNITS;
-	yt2 = y2 / FBlockmap::MAPBLOCKUNITS;
+	xt2 = x2 / Level->blockmap.blockunits;
+	yt2 = y2 / Level->blockmap.blockunits;
 
 	mapx = xs_FloorToInt(xt1);
 	mapy = xs_FloorToInt(yt1);
@@ -749,7 +840,8 @@ bool SightCheck::P_SightPathTraverse ()
 // Count is present to prevent a round off error from skipping the break
 
 	int itres = -1;
-	for (count = 0 ; count < 1000 ; count++)
+	const int maxcount = Level->blockmap.ScaleBlockDistance(1000);
+	for (count = 0 ; count < maxcount ; count++)
 	{
 		// end traversing when reaching the end of the blockmap
 		// an early out is not possible because with portals a trace can easily land outside the map's bounds.
@@ -825,6 +917,89 @@ sightcounts[2]++;
 	return traverseres;
 }
 
+//==========================================================================
+//
+// P_SightBlockedByWater
+//
+// killough 4/19/98: make fake floors and ceilings block monster view
+//
+//==========================================================================
+
+static bool P_SightBlockedByWater(AActor *t1, AActor *t2, sector_t *s1, sector_t *s2)
+{
+	return (s1->GetHeightSec() &&
+		((t1->Top() <= s1->heightsec->floorplane.ZatPoint(t1) &&
+		  t2->Z() >= s1->heightsec->floorplane.ZatPoint(t2)) ||
+		 (t1->Z() >= s1->heightsec->ceilingplane.ZatPoint(t1) &&
+		  t2->Top() <= s1->heightsec->ceilingplane.ZatPoint(t2))))
+		||
+		(s2->GetHeightSec() &&
+		 ((t2->Top() <= s2->heightsec->floorplane.ZatPoint(t2) &&
+		   t1->Z() >= s2->heightsec->floorplane.ZatPoint(t1)) ||
+		  (t2->Z() >= s2->heightsec->ceilingplane.ZatPoint(t2) &&
+		   t1->Top() <= s2->heightsec->ceilingplane.ZatPoint(t1))));
+}
+
+//==========================================================================
+//
+// P_SightTrace
+//
+// Looks from the eyes of t1 to any part of t2 through the blockmap.
+//
+//==========================================================================
+
+static bool P_SightTrace(AActor *t1, AActor *t2, int flags)
+{
+	bool res;
+	SightCacheEntry *cached = sightcache ? P_GetSightCacheEntry(t1, t2) : nullptr;
+	if (cached != nullptr)
+	{
+		if (P_MatchSightCache(cached, t1, t2, flags))
+		{
+			sightcachehits++;
+			return cached->result;
+		}
+		sightcachemisses++;
+	}
+
+	validcount++;
+	portals.Clear();
+	{
+		sector_t *sec;
+		double lookheight = t1->Z() + t1->Height*0.75;
+		t1->GetPortalTransition(lookheight, &sec);
+
+		double bottomslope = t2->Z() - lookheight;
+		double topslope = bottomslope + t2->Height;
+		SightTask task = { 0, topslope, bottomslope, -1, sec->PortalGroup };
+
+
+		SightCheck s(t1->Level);
+		s.init(t1, t2, sec, &task, flags);
+		res = s.P_SightPathTraverse ();
+		if (!res)
+		{
+			double dist = t1->Distance2D(t2);
+			for (unsigned i = 0; i < portals.Size(); i++)
+			{
+				portals[i].Frac += 1 / dist;
+				s.init(t1, t2, NULL, &portals[i], flags);
+				if (s.P_SightPathTraverse())
+				{
+					res = true;
+					break;
+				}
+			}
+		}
+	}
+
+	if (cached != nullptr)
+	{
+		*cached = { t1, t2, t1->Pos(), t2->Pos(), t1->Height, t2->Height, flags, SightCacheGeneration, res };
+	}
+	return res;
+}
+
 /*
 =====================
 =
@@ -883,72 +1058,94 @@ sightcounts[0]++;
 		}
 	}
 
-	// killough 4/19/98: make fake floors and ceilings block monster view
-
-	if (!(flags & SF_IGNOREWATERBOUNDARY))
+	if (!(flags & SF_IGNOREWATERBOUNDARY) && P_SightBlockedByWater(t1, t2, s1, s2))
 	{
-		if ((s1->GetHeightSec() &&
-			((t1->Top() <= s1->heightsec->floorplane.ZatPoint(t1) &&
-			  t2->Z() >= s1->heightsec->floorplane.ZatPoint(t2)) ||
-			 (t1->Z() >= s1->heightsec->ceilingplane.ZatPoint(t1) &&
-			  t2->Top() <= s1->heightsec->ceilingplane.ZatPoint(t2))))
-			||
-			(s2->GetHeightSec() &&
-			 ((t2->Top() <= s2->heightsec->floorplane.ZatPoint(t2) &&
-			   t1->Z() >= s2->heightsec->floorplane.ZatPoint(t1)) ||
-			  (t2->Z() >= s2->heightsec->ceilingplane.ZatPoint(t2) &&
-			   t1->Top() <= s2->heightsec->ceilingplane.ZatPoint(t1)))))
-		{
-			res = false;
-			goto done;
-		}
+		res = false;
+		goto done;
 	}
 
 	// An unobstructed LOS is possible.
 	// Now look from eyes of t1 to any part of t2.
+	res = P_SightTrace(t1, t2, flags);
 
-	validcount++;
-	portals.Clear();
+done:
+	SightCycles.Unclock();
+	return res;
+}
+
+//==========================================================================
+//
+// P_CheckSightBatch
+//
+// Checks which of the given sources can see a single target. Bit i of
+// 'visible' is set if sources[i] can see it. The target side of the check
+// is only set up once and all trace results go into the sight cache, so
+// later P_CheckSight calls for the same pairs are free.
+//
+// Unlike P_CheckSight this never rolls the random 'attack anyway' chance
+// against invisible targets, which would make the result depend on the
+// order of evaluation. Such targets are reported as not visible unless
+// SF_IGNOREVISIBILITY is passed.
+//
+// Returns true if any source can see the target. With stopatfirst, the
+// remaining sources are not checked once one of them can.
+//
+//==========================================================================
+
+bool P_CheckSightBatch (AActor *const *sources, unsigned count, AActor *target, int flags, TArray<uint32_t> &visible, bool stopatfirst)
+{
+	visible.Resize((count + 31) / 32);
+	memset(visible.Data(), 0, visible.Size() * sizeof(uint32_t));
+	if (target == nullptr || count == 0) return false;
+
+	if ((flags & SF_IGNOREVISIBILITY) == 0 &&
+		((target->flags8 & MF8_MVISBLOCKED) ||
+		(target->renderflags & RF_INVISIBLE) ||
+		(target->flags8 & MF8_MINVISIBLE) ||
+		!target->RenderStyle.IsVisible(target->Alpha)))
 	{
-		sector_t *sec;
-		double lookheight = t1->Z() + t1->Height*0.75;
-		t1->GetPortalTransition(lookheight, &sec);
+		return false;
+	}
 
-		double bottomslope = t2->Z() - lookheight;
-		double topslope = bottomslope + t2->Height;
-		SightTask task = { 0, topslope, bottomslope, -1, sec->PortalGroup };
+	bool seen = false;
+	SightCycles.Clock();
+	auto Level = target->Level;
+	auto s2 = target->Sector;
+	const bool checkwater = !(flags & SF_IGNOREWATERBOUNDARY);
 
+	for (unsigned i = 0; i < count; i++)
+	{
+		AActor *t1 = sources[i];
+		if (t1 == nullptr || t1->Level != Level) continue;
 
-		SightCheck s(t1->Level);
-		s.init(t1, t2, sec, &task, flags);
-		res = s.P_SightPathTraverse ();
-		if (!res)
+		auto s1 = t1->Sector;
+		if (!Level->CheckReject(s1, s2))
 		{
-			double dist = t1->Distance2D(t2);
-			for (unsigned i = 0; i < portals.Size(); i++)
-			{
-				portals[i].Frac += 1 / dist;
-				s.init(t1, t2, NULL, &portals[i], flags);
-				if (s.P_SightPathTraverse())
-				{
-					res = true;
-					break;
-				}
-			}
+			sightcounts[0]++;
+			continue;
+		}
+		if (checkwater && P_SightBlockedByWater(t1, target, s1, s2))
+		{
+			continue;
+		}
+		if (P_SightTrace(t1, target, flags))
+		{
+			visible[i >> 5] |= 1u << (i & 31);
+			seen = true;
+			if (stopatfirst) break;
 		}
 	}
-
-done:
 	SightCycles.Unclock();
-	return res;
+	return seen;
 }
 
 ADD_STAT (sight)
 {
 	FString out;
-	out.Format ("%04.1f ms (%04.1f max), %5d %2d%4d%4d%4d%4d\n",
+	out.Format ("%04.1f ms (%04.1f max), %5d %2d%4d%4d%4d%4d, cache %d hits %d misses\n",
 		SightCycles.TimeMS(), MaxSightCycles.TimeMS(),
-		sightcounts[3], sightcounts[0], sightcounts[1], sightcounts[2], sightcounts[4], sightcounts[5]);
+		sightcounts[3], sightcounts[0], sightcounts[1], sightcounts[2], sightcounts[4], sightcounts[5],
+		sightcachehits, sightcachemisses);
 	return out;
 }
 
@@ -964,4 +1161,7 @@ void P_ResetSightCounters (bool full)
 	}
 	SightCycles.Reset();
 	memset (sightcounts, 0, sizeof(sightcounts));
+	sightcachehits = sightcachemisses = 0;
+	// Everything may have moved since the last tic.
+	P_InvalidateSightCache();
 }
@@ -40,6 +40,7 @@
 #include "hwrenderer/scene/hw_drawinfo.h"
 #include "hwrenderer/scene/hw_portal.h"
 #include "hw_clock.h"
+#include "hw_dynlightdata.h"
 #include "flatvertices.h"
 #include "hw_vertexbuilder.h"
 #include "hw_walldispatcher.h"
@@ -52,11 +53,21 @@
 
 CVAR(Bool, gl_multithread, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
 
+const int MAX_BSP_WORKERS = 8;
+
+// 0 picks the number of worker threads from the number of available cores.
+CUSTOM_CVAR(Int, gl_bspthreads, 0, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
+{
+	if (self < 0) self = 0;
+	else if (self > MAX_BSP_WORKERS) self = MAX_BSP_WORKERS;
+}
+
 EXTERN_CVAR(Float, r_actorspriteshadowdist)
 EXTERN_CVAR(Bool, r_radarclipper)
 EXTERN_CVAR(Bool, r_dithertransparency)
 
 thread_local bool isWorkerThread;
+thread_local HWWorkerOutput *workerOutput;
 ctpl::thread_pool renderPool(1);
 bool inited = false;
 
@@ -80,10 +91,10 @@ struct RenderJob
 		SpriteJob,
 		ParticleJob,
 		PortalJob,
-		TerminateJob	// inserted when all work is done so that the worker can return.
 	};
 	
 	int type;
+	int index;	// position in the BSP traversal, used to merge the workers' output.
 	subsector_t *sub;
 	seg_t *seg;
 };
@@ -95,17 +106,22 @@ class RenderJobQueue
 	std::atomic<int> readindex{};
 	std::atomic<int> writeindex{};
 public:
-	void AddJob(int type, subsector_t *sub, seg_t *seg = nullptr)
+	void AddJob(int type, int index, subsector_t *sub, seg_t *seg)
 	{
 		// This does not check for array overflows. The pool should be large enough that it never hits the limit.
 
-		pool[writeindex] = { type, sub, seg };
+		pool[writeindex] = { type, index, sub, seg };
 		writeindex++;	// update index only after the value has been written.
 	}
 
 	RenderJob *GetJob()
 	{
-		if (readindex < writeindex) return &pool[readindex++];
+		// Multiple workers can read from the same queue.
+		int index = readindex;
+		while (index < writeindex)
+		{
+			if (readindex.compare_exchange_weak(index, index + 1)) return &pool[index];
+		}
 		return nullptr;
 	}
 	
@@ -116,20 +132,161 @@ public:
 	}
 };
 
-static RenderJobQueue jobQueue;	// One static queue is sufficient here. This code will never be called recursively.
+// Two static queues are sufficient here. This code will never be called recursively.
+static RenderJobQueue jobQueue;		// walls, flats and portals, which can be processed by any worker.
+static RenderJobQueue spriteQueue;	// sprites and particles use the actors' validcount and must all be done by the first worker.
+static int jobCount;
+static std::atomic<bool> jobsDone;
+static HWWorkerOutput workerOutputs[MAX_BSP_WORKERS];
 
-void HWDrawInfo::WorkerThread()
+static void AddRenderJob(int type, subsector_t *sub, seg_t *seg = nullptr)
+{
+	auto &queue = (type == RenderJob::SpriteJob || type == RenderJob::ParticleJob) ? spriteQueue : jobQueue;
+	queue.AddJob(type, jobCount++, sub, seg);
+}
+
+static int GetNumBSPWorkers()
+{
+	if (gl_bspthreads > 0) return gl_bspthreads;
+	// Leave one core for the main thread's BSP traversal and one for everything else.
+	return clamp((int)std::thread::hardware_concurrency() - 2, 1, 4);
+}
+
+//==========================================================================
+//
+// HWWorkerOutput
+//
+//==========================================================================
+
+void HWWorkerOutput::Clear(FMemArena *allocator)
+{
+	Allocator = allocator;
+	for (auto &list : drawlists)
+	{
+		list.Reset();
+		list.Allocator = allocator;
+	}
+	Decals[0].Clear();
+	Decals[1].Clear();
+	Calls.Clear();
+	Jobs.Clear();
+	Lines = Flats = TexSplits = 0;
+}
+
+//==========================================================================
+//
+// Everything recorded from here on belongs to the given job.
+//
+//==========================================================================
+
+void HWWorkerOutput::MarkJob(int job)
+{
+	auto &range = Jobs[Jobs.Reserve(1)];
+	range.job = job;
+	for (int i = 0; i < GLDL_TYPES; i++) range.drawitems[i] = drawlists[i].drawitems.Size();
+	range.decals[0] = Decals[0].Size();
+	range.decals[1] = Decals[1].Size();
+	range.calls = Calls.Size();
+}
+
+void HWWorkerOutput::AddPortal(HWWall *wall, int ptype, int plane)
+{
+	// The wall and the horizon or sky info it points to only live on the worker's stack.
+	auto copy = (HWWall*)Allocator->Alloc(sizeof(HWWall));
+	*copy = *wall;
+	if (ptype == PORTALTYPE_HORIZON)
+	{
+		copy->horizon = (HWHorizonInfo*)Allocator->Alloc(sizeof(HWHorizonInfo));
+		*copy->horizon = *wall->horizon;
+	}
+	else if (ptype == PORTALTYPE_SKY)
+	{
+		copy->sky = (HWSkyInfo*)Allocator->Alloc(sizeof(HWSkyInfo));
+		*copy->sky = *wall->sky;
+	}
+
+	auto &call = Calls[Calls.Reserve(1)];
+	call.type = DeferredCall::WallPortal;
+	call.wall = copy;
+	call.portaltype = ptype;
+	call.portalplane = plane;
+}
+
+void HWWorkerOutput::AddSubsectorToPortal(FSectorPortalGroup *portal, subsector_t *sub)
+{
+	auto &call = Calls[Calls.Reserve(1)];
+	call.type = DeferredCall::SubsectorPortal;
+	call.portal = portal;
+	call.sub = sub;
+}
+
+void HWWorkerOutput::AddMissingTexture(int type, side_t *side, subsector_t *sub, float backheight)
+{
+	auto &call = Calls[Calls.Reserve(1)];
+	call.type = type;
+	call.side = side;
+	call.sub = sub;
+	call.height = backheight;
+}
+
+//==========================================================================
+//
+// Dynamic lights are set up during the merge. The per-eye light limits
+// depend on how many lights the surfaces before this one already got,
+// which a worker cannot know.
+//
+//==========================================================================
+
+void HWWorkerOutput::AddLights(HWWall *wall, const unsigned *firstdecal)
+{
+	auto &call = Calls[Calls.Reserve(1)];
+	call.type = DeferredCall::WallLights;
+	call.wall = wall;
+	for (int i = 0; i < 2; i++)
+	{
+		call.firstdecal[i] = firstdecal[i];
+		call.lastdecal[i] = Decals[i].Size();
+	}
+}
+
+void HWWorkerOutput::AddLights(HWFlat *flat)
+{
+	auto &call = Calls[Calls.Reserve(1)];
+	call.type = DeferredCall::FlatLights;
+	call.flat = flat;
+}
+
+//==========================================================================
+//
+// 
+//
+//==========================================================================
+
+void HWDrawInfo::WorkerThread(int worker)
 {
 	sector_t *front, *back;
 	HWWallDispatcher disp(this);
+	auto &output = workerOutputs[worker];
+
+	// The timers are not thread safe so only the first worker's time gets recorded.
+	glcycle_t unused;
+	auto &wtTotal = worker == 0 ? WTTotal : unused;
+	auto &setupWall = worker == 0 ? SetupWall : unused;
+	auto &setupFlat = worker == 0 ? SetupFlat : unused;
+	auto &setupSprite = worker == 0 ? SetupSprite : unused;
 
-	WTTotal.Clock();
+	wtTotal.Clock();
 	isWorkerThread = true;	// for adding asserts in GL API code. The worker thread may never call any GL API.
+	workerOutput = &output;
 	while (true)
 	{
-		auto job = jobQueue.GetJob();
+		// Only when this was set before the queues were found empty can the worker be sure that there's no more work.
+		bool done = jobsDone;
+		RenderJob *job = worker == 0 ? spriteQueue.GetJob() : nullptr;
+		if (job == nullptr) job = jobQueue.GetJob();
 		if (job == nullptr)
 		{
+			if (done) break;
 #ifdef ARCH_IA32
 			// The queue is empty. But yielding would be too costly here and possibly cause further delays down the line if the thread is halted.
 			// So instead add a few pause instructions and retry immediately.
@@ -144,19 +301,19 @@ void HWDrawInfo::WorkerThread()
 			_mm_pause();
 			_mm_pause();
 #endif // ARCH_IA32
+			continue;
 		}
+
+		output.MarkJob(job->index);
+
 		// Note that the main thread MUST have prepared the fake sectors that get used below!
 		// This worker thread cannot prepare them itself without costly synchronization.
-		else switch (job->type)
+		switch (job->type)
 		{
-		case RenderJob::TerminateJob:
-			WTTotal.Unclock();
-			return;
-
 		case RenderJob::WallJob:
 		{
 			HWWall wall;
-			SetupWall.Clock();
+			setupWall.Clock();
 			wall.sub = job->sub;
 
 			front = hw_FakeFlat(job->sub->sector, in_area, false);
@@ -187,34 +344,34 @@ void HWDrawInfo::WorkerThread()
 			else back = nullptr;
 
 			wall.Process(&disp, job->seg, front, back);
-			rendered_lines++;
-			SetupWall.Unclock();
+			output.Lines++;
+			setupWall.Unclock();
 			break;
 		}
 
 		case RenderJob::FlatJob:
 		{
 			HWFlat flat;
-			SetupFlat.Clock();
+			setupFlat.Clock();
 			flat.section = job->sub->section;
 			front = hw_FakeFlat(job->sub->render_sector, in_area, false);
 			flat.ProcessSector(this, front);
-			SetupFlat.Unclock();
+			setupFlat.Unclock();
 			break;
 		}
 
 		case RenderJob::SpriteJob:
-			SetupSprite.Clock();
+			setupSprite.Clock();
 			front = hw_FakeFlat(job->sub->sector, in_area, false);
 			RenderThings(job->sub, front);
-			SetupSprite.Unclock();
+			setupSprite.Unclock();
 			break;
 
 		case RenderJob::ParticleJob:
-			SetupSprite.Clock();
+			setupSprite.Clock();
 			front = hw_FakeFlat(job->sub->sector, in_area, false);
 			RenderParticles(job->sub, front);
-			SetupSprite.Unclock();
+			setupSprite.Unclock();
 			break;
 
 		case RenderJob::PortalJob:
@@ -223,6 +380,94 @@ void HWDrawInfo::WorkerThread()
 		}
 
 	}
+	output.MarkJob(INT_MAX);	// terminates the last job's range.
+	workerOutput = nullptr;
+	wtTotal.Unclock();
+}
+
+//==========================================================================
+//
+// Appends the workers' output to the draw lists in the order the jobs
+// were issued, so that the result is the same as if a single thread had
+// processed them, regardless of which worker got which job.
+//
+//==========================================================================
+
+void HWDrawInfo::MergeWorkerOutput(int numworkers)
+{
+	struct JobRef
+	{
+		HWWorkerOutput *output;
+		unsigned range;
+	};
+
+	TArray<JobRef> order(jobCount, true);
+	for (int i = 0; i < numworkers; i++)
+	{
+		auto &output = workerOutputs[i];
+		for (unsigned j = 0; j + 1 < output.Jobs.Size(); j++)
+		{
+			order[output.Jobs[j].job] = { &output, j };
+		}
+		rendered_lines += output.Lines;
+		rendered_flats += output.Flats;
+		render_texsplit += output.TexSplits;
+	}
+
+	for (auto &ref : order)
+	{
+		auto &output = *ref.output;
+		auto &start = output.Jobs[ref.range];
+		auto &end = output.Jobs[ref.range + 1];
+
+		for (int i = 0; i < GLDL_TYPES; i++)
+		{
+			drawlists[i].AddItems(output.drawlists[i], start.drawitems[i], end.drawitems[i]);
+		}
+		for (int i = 0; i < 2; i++)
+		{
+			for (unsigned j = start.decals[i]; j < end.decals[i]; j++) Decals[i].Push(output.Decals[i][j]);
+		}
+		for (unsigned j = start.calls; j < end.calls; j++)
+		{
+			auto &call = output.Calls[j];
+			switch (call.type)
+			{
+			case HWWorkerOutput::DeferredCall::WallPortal:
+				call.wall->AddPortal(this, call.portaltype, call.portalplane);
+				break;
+
+			case HWWorkerOutput::DeferredCall::SubsectorPortal:
+				AddSubsectorToPortal(call.portal, call.sub);
+				break;
+
+			case HWWorkerOutput::DeferredCall::UpperMissingTexture:
+				AddUpperMissingTexture(call.side, call.sub, call.height);
+				break;
+
+			case HWWorkerOutput::DeferredCall::LowerMissingTexture:
+				AddLowerMissingTexture(call.side, call.sub, call.height);
+				break;
+
+			case HWWorkerOutput::DeferredCall::WallLights:
+				call.wall->SetupLights(this, lightdata);
+				for (int i = 0; i < 2; i++)
+				{
+					for (unsigned k = call.firstdecal[i]; k < call.lastdecal[i]; k++)
+					{
+						// fullbright decals never get lights, see HWWall::ProcessDecal.
+						auto decal = output.Decals[i][k];
+						if (!(decal->decal->RenderFlags & RF_FULLBRIGHT)) decal->dynlightindex = call.wall->dynlightindex;
+					}
+				}
+				break;
+
+			case HWWorkerOutput::DeferredCall::FlatLights:
+				call.flat->SetupLights(this, call.flat->section->lighthead, lightdata, call.flat->sector->PortalGroup);
+				break;
+			}
+		}
+	}
 }
 
 
@@ -374,7 +619,7 @@ void HWDrawInfo::AddLine (seg_t *seg, bool portalclip)
 	{
 		if (multithread)
 		{
-			jobQueue.AddJob(RenderJob::WallJob, currentsubsector, seg);
+			AddRenderJob(RenderJob::WallJob, currentsubsector, seg);
 		}
 		else
 		{
@@ -438,7 +683,7 @@ void HWDrawInfo::AddLine (seg_t *seg, bool portalclip)
 		{
 			if (multithread)
 			{
-				jobQueue.AddJob(RenderJob::WallJob, seg->Subsector, seg);
+				AddRenderJob(RenderJob::WallJob, seg->Subsector, seg);
 			}
 			else
 			{
@@ -832,7 +1077,7 @@ void HWDrawInfo::DoSubsector(subsector_t * sub)
 	{
 		if (multithread)
 		{
-			jobQueue.AddJob(RenderJob::ParticleJob, sub, nullptr);
+			AddRenderJob(RenderJob::ParticleJob, sub);
 		}
 		else
 		{
@@ -858,7 +1103,7 @@ void HWDrawInfo::DoSubsector(subsector_t * sub)
 		{
 			if (multithread)
 			{
-				jobQueue.AddJob(RenderJob::SpriteJob, sub, nullptr);
+				AddRenderJob(RenderJob::SpriteJob, sub);
 			}
 			else
 			{
@@ -909,7 +1154,7 @@ void HWDrawInfo::DoSubsector(subsector_t * sub)
 
 					if (multithread)
 					{
-						jobQueue.AddJob(RenderJob::FlatJob, sub);
+						AddRenderJob(RenderJob::FlatJob, sub);
 					}
 					else
 					{
@@ -938,7 +1183,7 @@ void HWDrawInfo::DoSubsector(subsector_t * sub)
 				{
 					if (multithread)
 					{
-						jobQueue.AddJob(RenderJob::PortalJob, sub, (seg_t *)portal);
+						AddRenderJob(RenderJob::PortalJob, sub, (seg_t *)portal);
 					}
 					else
 					{
@@ -951,7 +1196,7 @@ void HWDrawInfo::DoSubsector(subsector_t * sub)
 				{
 					if (multithread)
 					{
-						jobQueue.AddJob(RenderJob::PortalJob, sub, (seg_t *)portal);
+						AddRenderJob(RenderJob::PortalJob, sub, (seg_t *)portal);
 					}
 					else
 					{
@@ -1063,17 +1308,30 @@ void HWDrawInfo::RenderBSP(void *node, bool drawpsprites)
 	multithread = gl_multithread;
 	if (multithread)
 	{
+		int numworkers = GetNumBSPWorkers();
+		if (renderPool.size() != numworkers) renderPool.resize(numworkers);
+
 		jobQueue.ReleaseAll();
-		auto future = renderPool.push([&](int id) {
-			WorkerThread();
-		});
+		spriteQueue.ReleaseAll();
+		jobCount = 0;
+		jobsDone = false;
+
+		std::future<void> futures[MAX_BSP_WORKERS];
+		for (int i = 0; i < numworkers; i++)
+		{
+			workerOutputs[i].Clear(GetWorkerDataAllocator(i));
+			futures[i] = renderPool.push([this, i](int id) {
+				WorkerThread(i);
+			});
+		}
 		if (Viewpoint.IsOrtho() && ((Level->flags3 & LEVEL3_NOFOGOFWAR) || !r_radarclipper)) RenderOrthoNoFog();
 		else RenderBSPNode(node);
 
-		jobQueue.AddJob(RenderJob::TerminateJob, nullptr, nullptr);
+		jobsDone = true;
 		Bsp.Unclock();
 		MTWait.Clock();
-		future.wait();
+		for (int i = 0; i < numworkers; i++) futures[i].wait();
+		MergeWorkerOutput(numworkers);
 		MTWait.Unclock();
 	}
 	else
@@ -446,6 +446,12 @@ HWPortal * HWDrawInfo::FindPortal(const void * src)
 
 HWDecal *HWDrawInfo::AddDecal(bool onmirror)
 {
+	if (workerOutput)
+	{
+		auto decal = (HWDecal*)workerOutput->Allocator->Alloc(sizeof(HWDecal));
+		workerOutput->Decals[onmirror ? 1 : 0].Push(decal);
+		return decal;
+	}
 	auto decal = (HWDecal*)RenderDataAllocator.Alloc(sizeof(HWDecal));
 	Decals[onmirror ? 1 : 0].Push(decal);
 	return decal;
@@ -1015,6 +1021,11 @@ void HWDrawInfo::ProcessScene(bool toscreen)
 
 void HWDrawInfo::AddSubsectorToPortal(FSectorPortalGroup *ptg, subsector_t *sub)
 {
+	if (workerOutput)
+	{
+		workerOutput->AddSubsectorToPortal(ptg, sub);
+		return;
+	}
 	auto portal = FindPortal(ptg);
 	if (!portal)
 	{
@@ -95,6 +95,69 @@ enum DrawListType
 	GLDL_TYPES,
 };
 
+//==========================================================================
+//
+// Output of one BSP worker thread. Everything a job produces is recorded
+// per job, so that the main thread can merge the workers' output back into
+// the order of the BSP traversal. Calls that need shared state are deferred
+// and replayed on the main thread during the merge.
+//
+//==========================================================================
+
+struct HWWorkerOutput
+{
+	struct DeferredCall
+	{
+		enum
+		{
+			WallPortal,
+			SubsectorPortal,
+			UpperMissingTexture,
+			LowerMissingTexture,
+			WallLights,
+			FlatLights,
+		};
+
+		int type;
+		int portaltype;
+		int portalplane;
+		HWWall *wall;
+		HWFlat *flat;
+		FSectorPortalGroup *portal;
+		side_t *side;
+		subsector_t *sub;
+		float height;
+		unsigned firstdecal[2], lastdecal[2];	// decals that take the wall's light index
+	};
+
+	struct JobRange
+	{
+		int job;
+		unsigned drawitems[GLDL_TYPES];
+		unsigned decals[2];
+		unsigned calls;
+	};
+
+	FMemArena *Allocator;
+	HWDrawList drawlists[GLDL_TYPES];
+	TArray<HWDecal *> Decals[2];
+	TArray<DeferredCall> Calls;
+	TArray<JobRange> Jobs;
+
+	// Stat counters the workers cannot update directly. They get added up after the merge.
+	int Lines, Flats, TexSplits;
+
+	void Clear(FMemArena *allocator);
+	void MarkJob(int job);
+	void AddPortal(HWWall *wall, int ptype, int plane);
+	void AddSubsectorToPortal(FSectorPortalGroup *portal, subsector_t *sub);
+	void AddMissingTexture(int type, side_t *side, subsector_t *sub, float backheight);
+	void AddLights(HWWall *wall, const unsigned *firstdecal);
+	void AddLights(HWFlat *flat);
+};
+
+extern thread_local HWWorkerOutput *workerOutput;
+
 
 struct HWDrawInfo
 {
@@ -193,7 +256,8 @@ private:
 	subsector_t *currentsubsector;	// used by the line processing code.
 	sector_t *currentsector;
 
-	void WorkerThread();
+	void WorkerThread(int worker);
+	void MergeWorkerOutput(int numworkers);
 
 	void UnclipSubsector(subsector_t *sub);
 	
@@ -310,9 +374,9 @@ public:
 	void ProcessLowerMinisegs(TArray<seg_t *> &lowersegs);
     void AddSubsectorToPortal(FSectorPortalGroup *portal, subsector_t *sub);
     
-    void AddWall(HWWall *w);
+    HWWall *AddWall(HWWall *w);
     void AddMirrorSurface(HWWall *w);
-	void AddFlat(HWFlat *flat, bool fog);
+	HWFlat *AddFlat(HWFlat *flat, bool fog);
 	void AddSprite(HWSprite *sprite, bool translucent);
 
 
@@ -40,10 +40,24 @@
 #include "hw_walldispatcher.h"
 
 FMemArena RenderDataAllocator(1024*1024);	// Use large blocks to reduce allocation time.
+static TDeletingArray<FMemArena *> WorkerDataAllocators;	// the BSP worker threads cannot share the allocator above.
+
+FMemArena *GetWorkerDataAllocator(int worker)
+{
+	while (WorkerDataAllocators.Size() <= (unsigned)worker)
+	{
+		WorkerDataAllocators.Push(new FMemArena(1024*1024));
+	}
+	return WorkerDataAllocators[worker];
+}
 
 void ResetRenderDataAllocator()
 {
 	RenderDataAllocator.FreeAll();
+	for (auto allocator : WorkerDataAllocators)
+	{
+		allocator->FreeAll();
+	}
 }
 
 //==========================================================================
@@ -763,7 +777,7 @@ void HWDrawList::SortFlats()
 
 HWWall *HWDrawList::NewWall()
 {
-	auto wall = (HWWall*)RenderDataAllocator.Alloc(sizeof(HWWall));
+	auto wall = (HWWall*)Allocator->Alloc(sizeof(HWWall));
 	drawitems.Push(HWDrawItem(DrawType_WALL, walls.Push(wall)));
 	return wall;
 }
@@ -775,7 +789,7 @@ HWWall *HWDrawList::NewWall()
 //==========================================================================
 HWFlat *HWDrawList::NewFlat()
 {
-	auto flat = (HWFlat*)RenderDataAllocator.Alloc(sizeof(HWFlat));
+	auto flat = (HWFlat*)Allocator->Alloc(sizeof(HWFlat));
 	drawitems.Push(HWDrawItem(DrawType_FLAT,flats.Push(flat)));
 	return flat;
 }
@@ -787,11 +801,38 @@ HWFlat *HWDrawList::NewFlat()
 //==========================================================================
 HWSprite *HWDrawList::NewSprite()
 {	
-	auto sprite = (HWSprite*)RenderDataAllocator.Alloc(sizeof(HWSprite));
+	auto sprite = (HWSprite*)Allocator->Alloc(sizeof(HWSprite));
 	drawitems.Push(HWDrawItem(DrawType_SPRITE, sprites.Push(sprite)));
 	return sprite;
 }
 
+//==========================================================================
+//
+// Appends a range of another list's items
+//
+//==========================================================================
+void HWDrawList::AddItems(HWDrawList &other, unsigned first, unsigned last)
+{
+	for (unsigned i = first; i < last; i++)
+	{
+		auto &item = other.drawitems[i];
+		switch (item.rendertype)
+		{
+		case DrawType_WALL:
+			drawitems.Push(HWDrawItem(DrawType_WALL, walls.Push(other.walls[item.index])));
+			break;
+
+		case DrawType_FLAT:
+			drawitems.Push(HWDrawItem(DrawType_FLAT, flats.Push(other.flats[item.index])));
+			break;
+
+		case DrawType_SPRITE:
+			drawitems.Push(HWDrawItem(DrawType_SPRITE, sprites.Push(other.sprites[item.index])));
+			break;
+		}
+	}
+}
+
 //==========================================================================
 //
 //
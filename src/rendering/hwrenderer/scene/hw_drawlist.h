@@ -3,6 +3,7 @@
 #include "memarena.h"
 
 extern FMemArena RenderDataAllocator;
+FMemArena *GetWorkerDataAllocator(int worker);
 void ResetRenderDataAllocator();
 struct HWDrawInfo;
 class HWWall;
@@ -69,6 +70,7 @@ struct HWDrawList
     float SortZ;
 	SortNode * sorted;
 	bool reverseSort;
+	FMemArena *Allocator = &RenderDataAllocator;
 	
 public:
 	HWDrawList()
@@ -91,6 +93,7 @@ public:
 	HWWall *NewWall();
 	HWFlat *NewFlat();
 	HWSprite *NewSprite();
+	void AddItems(HWDrawList &other, unsigned first, unsigned last);
 	void Reset();
 	void SortWalls();
 	void SortFlats();
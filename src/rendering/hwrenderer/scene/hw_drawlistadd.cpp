@@ -35,12 +35,14 @@
 //
 //==========================================================================
 
-void HWDrawInfo::AddWall(HWWall *wall)
+HWWall *HWDrawInfo::AddWall(HWWall *wall)
 {
+	HWDrawList *lists = workerOutput ? workerOutput->drawlists : drawlists;
 	if (wall->flags & HWWall::HWF_TRANSLUCENT)
 	{
-		auto newwall = drawlists[GLDL_TRANSLUCENT].NewWall();
+		auto newwall = lists[GLDL_TRANSLUCENT].NewWall();
 		*newwall = *wall;
+		return newwall;
 	}
 	else
 	{
@@ -55,8 +57,9 @@ void HWDrawInfo::AddWall(HWWall *wall)
 		{
 			list = masked ? GLDL_MASKEDWALLS : GLDL_PLAINWALLS;
 		}
-		auto newwall = drawlists[list].NewWall();
+		auto newwall = lists[list].NewWall();
 		*newwall = *wall;
+		return newwall;
 	}
 }
 
@@ -99,8 +102,9 @@ void HWDrawInfo::AddMirrorSurface(HWWall *w)
 //
 //==========================================================================
 
-void HWDrawInfo::AddFlat(HWFlat *flat, bool fog)
+HWFlat *HWDrawInfo::AddFlat(HWFlat *flat, bool fog)
 {
+	HWDrawList *lists = workerOutput ? workerOutput->drawlists : drawlists;
 	int list;
 
 	if (flat->renderstyle != STYLE_Translucent || flat->alpha < 1.f - FLT_EPSILON || fog || flat->texture == nullptr)
@@ -128,8 +132,9 @@ void HWDrawInfo::AddFlat(HWFlat *flat, bool fog)
 		bool masked = flat->texture->isMasked() && ((flat->renderflags&SSRF_RENDER3DPLANES) || flat->stack);
 		list = masked ? GLDL_MASKEDFLATS : GLDL_PLAINFLATS;
 	}
-	auto newflat = drawlists[list].NewFlat();
+	auto newflat = lists[list].NewFlat();
 	*newflat = *flat;
+	return newflat;
 }
 
 
@@ -140,6 +145,7 @@ void HWDrawInfo::AddFlat(HWFlat *flat, bool fog)
 //==========================================================================
 void HWDrawInfo::AddSprite(HWSprite *sprite, bool translucent)
 {
+	HWDrawList *lists = workerOutput ? workerOutput->drawlists : drawlists;
 	int list;
 	// [BB] Allow models to be drawn in the GLDL_TRANSLUCENT pass.
 	if (translucent || sprite->actor == nullptr || (!sprite->modelframe && (sprite->actor->renderflags & RF_SPRITETYPEMASK) != RF_WALLSPRITE))
@@ -151,7 +157,7 @@ void HWDrawInfo::AddSprite(HWSprite *sprite, bool translucent)
 		list = GLDL_MODELS;
 	}
 
-	auto newsprt = drawlists[list].NewSprite();
+	auto newsprt = lists[list].NewSprite();
 	*newsprt = *sprite;
 }
 
@@ -218,6 +218,7 @@ public:
 
 	void PutWall(HWWallDispatcher* di, bool translucent);
 	void PutPortal(HWWallDispatcher* di, int ptype, int plane);
+	void AddPortal(HWDrawInfo* di, int ptype, int plane);
 	void CheckTexturePosition(FTexCoordInfo* tci);
 
 	void Put3DWall(HWWallDispatcher* di, lightlist_t* lightlist, bool translucent);
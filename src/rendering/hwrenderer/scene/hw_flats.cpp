@@ -400,6 +400,7 @@ void HWFlat::DrawFlat(HWDrawInfo *di, FRenderState &state, bool translucent)
 
 inline void HWFlat::PutFlat(HWDrawInfo *di, bool fog)
 {
+	bool deferlights = false;
 	if (di->isFullbrightScene())
 	{
 		Colormap.Clear();
@@ -408,10 +409,13 @@ inline void HWFlat::PutFlat(HWDrawInfo *di, bool fog)
 	{
 		if (di->Level->HasDynamicLights && texture != nullptr && !di->isFullbrightScene() && !(hacktype & (SSRF_PLANEHACK|SSRF_FLOODHACK)) )
 		{
-			SetupLights(di, section->lighthead, lightdata, sector->PortalGroup);
+			// a worker leaves this to the merge, see HWWorkerOutput::AddLights.
+			if (workerOutput) deferlights = true;
+			else SetupLights(di, section->lighthead, lightdata, sector->PortalGroup);
 		}
 	}
-	di->AddFlat(this, fog);
+	auto newflat = di->AddFlat(this, fog);
+	if (deferlights) workerOutput->AddLights(newflat);
 }
 
 //==========================================================================
@@ -458,7 +462,8 @@ void HWFlat::Process(HWDrawInfo *di, sector_t * model, int whichplane, bool fog)
 
 	// For hacks this won't go into a render list.
 	PutFlat(di, fog);
-	rendered_flats++;
+	if (workerOutput) workerOutput->Flats++;
+	else rendered_flats++;
 }
 
 //==========================================================================
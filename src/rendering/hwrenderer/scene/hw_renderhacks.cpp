@@ -198,6 +198,11 @@ void HWDrawInfo::AddOtherCeilingPlane(int sector, gl_subsectorrendernode * node)
 //==========================================================================
 void HWDrawInfo::AddUpperMissingTexture(side_t * side, subsector_t *sub, float Backheight)
 {
+	if (workerOutput)
+	{
+		workerOutput->AddMissingTexture(HWWorkerOutput::DeferredCall::UpperMissingTexture, side, sub, Backheight);
+		return;
+	}
 	if (!side->segs[0]->backsector) return;
 
 	for (int i = 0; i < side->numsegs; i++)
@@ -250,6 +255,11 @@ void HWDrawInfo::AddUpperMissingTexture(side_t * side, subsector_t *sub, float B
 //==========================================================================
 void HWDrawInfo::AddLowerMissingTexture(side_t * side, subsector_t *sub, float Backheight)
 {
+	if (workerOutput)
+	{
+		workerOutput->AddMissingTexture(HWWorkerOutput::DeferredCall::LowerMissingTexture, side, sub, Backheight);
+		return;
+	}
 	sector_t *backsec = side->segs[0]->backsector;
 	if (!backsec) return;
 	if (backsec->transdoor)
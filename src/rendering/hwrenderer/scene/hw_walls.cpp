@@ -526,6 +526,8 @@ void HWWall::PutWall(HWWallDispatcher *di, bool translucent)
 	}
 
 	auto ddi = di->di;
+	bool deferlights = false;
+	unsigned firstdecal[2] = {};
 	if (translucent)
 	{
 		flags |= HWF_TRANSLUCENT;
@@ -554,7 +556,9 @@ void HWWall::PutWall(HWWallDispatcher *di, bool translucent)
 		{
 			if (ddi->Level->HasDynamicLights && !ddi->isFullbrightScene() && texture != nullptr)
 			{
-				SetupLights(ddi, lightdata);
+				// a worker leaves this to the merge, see HWWorkerOutput::AddLights.
+				if (workerOutput) deferlights = true;
+				else SetupLights(ddi, lightdata);
 			}
 			MakeVertices(translucent);
 		}
@@ -574,15 +578,22 @@ void HWWall::PutWall(HWWallDispatcher *di, bool translucent)
 			{
 				if (ddi->Level->HasDynamicLights && !ddi->isFullbrightScene() && texture != nullptr)
 				{
-					SetupLights(ddi, lightdata);
+					if (workerOutput) deferlights = true;
+					else SetupLights(ddi, lightdata);
 				}
 			}
+			if (workerOutput)
+			{
+				firstdecal[0] = workerOutput->Decals[0].Size();
+				firstdecal[1] = workerOutput->Decals[1].Size();
+			}
 			ProcessDecals(ddi);
 		}
 	}
 
 
-	di->AddWall(this);
+	if (deferlights) workerOutput->AddLights(ddi->AddWall(this), firstdecal);
+	else di->AddWall(this);
 
 	lightlist = nullptr;
 	// make sure that following parts of the same linedef do not get this one's vertex and lighting info.
@@ -599,121 +610,135 @@ void HWWall::PutWall(HWWallDispatcher *di, bool translucent)
 
 void HWWall::PutPortal(HWWallDispatcher *di, int ptype, int plane)
 {
-	HWPortal * portal = nullptr;
-
 	auto ddi = di->di;
 	if (ddi)
 	{
 		MakeVertices(false);
-		switch (ptype)
-		{
-			// portals don't go into the draw list.
-			// Instead they are added to the portal manager
-		case PORTALTYPE_HORIZON:
-			horizon = portalState.UniqueHorizons.Get(horizon);
-			portal = ddi->FindPortal(horizon);
-			if (!portal)
-			{
-				portal = new HWHorizonPortal(&portalState, horizon, ddi->Viewpoint);
-				ddi->Portals.Push(portal);
-			}
-			portal->AddLine(this);
-			break;
+		if (ptype == PORTALTYPE_LINETOLINE && !lineportal)
+			return;
 
-		case PORTALTYPE_SKYBOX:
-			portal = ddi->FindPortal(secportal);
-			if (!portal)
-			{
-				// either a regular skybox or an Eternity-style horizon
-				if (secportal->mType != PORTS_SKYVIEWPOINT) portal = new HWEEHorizonPortal(&portalState, secportal);
-				else
-				{
-					portal = new HWSkyboxPortal(&portalState, secportal);
-					ddi->Portals.Push(portal);
-				}
-			}
-			portal->AddLine(this);
-			break;
+		// The portal lists are shared, so the BSP worker threads leave this to the main thread.
+		if (workerOutput) workerOutput->AddPortal(this, ptype, plane);
+		else AddPortal(ddi, ptype, plane);
+		vertcount = 0;
+	}
+	else
+	{
+		portaltype = ptype;
+		portalplane = plane;
+		di->AddPortal(this);
+	}
+}
 
-		case PORTALTYPE_SECTORSTACK:
-			portal = ddi->FindPortal(this->portal);
-			if (!portal)
-			{
-				portal = new HWSectorStackPortal(&portalState, this->portal);
-				ddi->Portals.Push(portal);
-			}
-			portal->AddLine(this);
-			break;
+//==========================================================================
+//
+// 
+//
+//==========================================================================
 
-		case PORTALTYPE_PLANEMIRROR:
-			if (portalState.PlaneMirrorMode * planemirror->fC() <= 0)
-			{
-				planemirror = portalState.UniquePlaneMirrors.Get(planemirror);
-				portal = ddi->FindPortal(planemirror);
-				if (!portal)
-				{
-					portal = new HWPlaneMirrorPortal(&portalState, planemirror);
-					ddi->Portals.Push(portal);
-				}
-				portal->AddLine(this);
-			}
-			break;
+void HWWall::AddPortal(HWDrawInfo *di, int ptype, int plane)
+{
+	HWPortal * portal = nullptr;
 
-		case PORTALTYPE_MIRROR:
-			portal = ddi->FindPortal(seg->linedef);
-			if (!portal)
-			{
-				portal = new HWMirrorPortal(&portalState, seg->linedef);
-				ddi->Portals.Push(portal);
-			}
-			portal->AddLine(this);
-			if (gl_mirror_envmap)
+	switch (ptype)
+	{
+		// portals don't go into the draw list.
+		// Instead they are added to the portal manager
+	case PORTALTYPE_HORIZON:
+		horizon = portalState.UniqueHorizons.Get(horizon);
+		portal = di->FindPortal(horizon);
+		if (!portal)
+		{
+			portal = new HWHorizonPortal(&portalState, horizon, di->Viewpoint);
+			di->Portals.Push(portal);
+		}
+		portal->AddLine(this);
+		break;
+
+	case PORTALTYPE_SKYBOX:
+		portal = di->FindPortal(secportal);
+		if (!portal)
+		{
+			// either a regular skybox or an Eternity-style horizon
+			if (secportal->mType != PORTS_SKYVIEWPOINT) portal = new HWEEHorizonPortal(&portalState, secportal);
+			else
 			{
-				// draw a reflective layer over the mirror
-				ddi->AddMirrorSurface(this);
+				portal = new HWSkyboxPortal(&portalState, secportal);
+				di->Portals.Push(portal);
 			}
-			break;
+		}
+		portal->AddLine(this);
+		break;
 
-		case PORTALTYPE_LINETOLINE:
-			if (!lineportal)
-				return;
-			portal = ddi->FindPortal(lineportal);
+	case PORTALTYPE_SECTORSTACK:
+		portal = di->FindPortal(this->portal);
+		if (!portal)
+		{
+			portal = new HWSectorStackPortal(&portalState, this->portal);
+			di->Portals.Push(portal);
+		}
+		portal->AddLine(this);
+		break;
+
+	case PORTALTYPE_PLANEMIRROR:
+		if (portalState.PlaneMirrorMode * planemirror->fC() <= 0)
+		{
+			planemirror = portalState.UniquePlaneMirrors.Get(planemirror);
+			portal = di->FindPortal(planemirror);
 			if (!portal)
 			{
-				line_t* otherside = lineportal->lines[0]->mDestination;
-				if (otherside != nullptr && otherside->portalindex < ddi->Level->linePortals.Size())
-				{
-					ddi->ProcessActorsInPortal(otherside->getPortal()->mGroup, ddi->in_area);
-				}
-				portal = new HWLineToLinePortal(&portalState, lineportal);
-				ddi->Portals.Push(portal);
+				portal = new HWPlaneMirrorPortal(&portalState, planemirror);
+				di->Portals.Push(portal);
 			}
 			portal->AddLine(this);
-			break;
+		}
+		break;
 
-		case PORTALTYPE_SKY:
-			sky = portalState.UniqueSkies.Get(sky);
-			portal = ddi->FindPortal(sky);
-			if (!portal)
+	case PORTALTYPE_MIRROR:
+		portal = di->FindPortal(seg->linedef);
+		if (!portal)
+		{
+			portal = new HWMirrorPortal(&portalState, seg->linedef);
+			di->Portals.Push(portal);
+		}
+		portal->AddLine(this);
+		if (gl_mirror_envmap)
+		{
+			// draw a reflective layer over the mirror
+			di->AddMirrorSurface(this);
+		}
+		break;
+
+	case PORTALTYPE_LINETOLINE:
+		portal = di->FindPortal(lineportal);
+		if (!portal)
+		{
+			line_t* otherside = lineportal->lines[0]->mDestination;
+			if (otherside != nullptr && otherside->portalindex < di->Level->linePortals.Size())
 			{
-				portal = new HWSkyPortal(screen->mSkyData, &portalState, sky);
-				ddi->Portals.Push(portal);
+				di->ProcessActorsInPortal(otherside->getPortal()->mGroup, di->in_area);
 			}
-			portal->AddLine(this);
-			break;
+			portal = new HWLineToLinePortal(&portalState, lineportal);
+			di->Portals.Push(portal);
 		}
-		vertcount = 0;
+		portal->AddLine(this);
+		break;
 
-		if (plane != -1 && portal)
+	case PORTALTYPE_SKY:
+		sky = portalState.UniqueSkies.Get(sky);
+		portal = di->FindPortal(sky);
+		if (!portal)
 		{
-			portal->planesused |= (1 << plane);
+			portal = new HWSkyPortal(screen->mSkyData, &portalState, sky);
+			di->Portals.Push(portal);
 		}
+		portal->AddLine(this);
+		break;
 	}
-	else
+
+	if (plane != -1 && portal)
 	{
-		portaltype = ptype;
-		portalplane = plane;
-		di->AddPortal(this);
+		portal->planesused |= (1 << plane);
 	}
 }
 
@@ -1663,7 +1688,8 @@ void HWWall::DoMidTexture(HWWallDispatcher *di, seg_t * seg, bool drawfogboundar
 
 				t=1;
 			}
-			render_texsplit+=t;
+			if (workerOutput) workerOutput->TexSplits += t;
+			else render_texsplit+=t;
 		}
 		else
 		{
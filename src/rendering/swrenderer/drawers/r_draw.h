@@ -105,4 +105,7 @@ namespace swrenderer
 
 	void R_UpdateFuzzPosFrameStart();
 	void R_UpdateFuzzPos(const SpriteDrawerArgs &args);
+
+	// True when the CPU can run the AVX2 drawers and r_avx2drawers is enabled
+	bool R_UseAVX2Drawers();
 }
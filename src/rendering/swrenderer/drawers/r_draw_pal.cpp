@@ -46,6 +46,10 @@
 #include "swrenderer/viewport/r_viewport.h"
 #include "swrenderer/scene/r_light.h"
 
+#ifndef NO_SSE
+#include "r_draw_pal_avx2.h"
+#endif
+
 // [SP] r_blendmethod - false = rgb555 matching (ZDoom classic), true = rgb666 (refactored)
 CVAR(Bool, r_blendmethod, false, CVAR_GLOBALCONFIG | CVAR_ARCHIVE)
 EXTERN_CVAR(Int, gl_particles_style)
@@ -1883,6 +1887,14 @@ namespace swrenderer
 
 	void SWPalDrawers::DrawSpan(const SpanDrawerArgs& args)
 	{
+#ifndef NO_SSE
+		if (args.dc_num_lights == 0 && R_UseAVX2Drawers())
+		{
+			PalAVX2::DrawSpan<PalAVX2::SpanBlend::Opaque, false>(args);
+			return;
+		}
+#endif
+
 		const uint8_t* _source = args.TexturePixels();
 		const uint8_t* _colormap = args.Colormap(args.Viewport());
 		uint32_t _xfrac = args.TextureUPos();
@@ -1989,6 +2001,14 @@ namespace swrenderer
 
 	void SWPalDrawers::DrawSpanMasked(const SpanDrawerArgs& args)
 	{
+#ifndef NO_SSE
+		if (args.dc_num_lights == 0 && R_UseAVX2Drawers())
+		{
+			PalAVX2::DrawSpan<PalAVX2::SpanBlend::Opaque, true>(args);
+			return;
+		}
+#endif
+
 		const uint8_t* _source = args.TexturePixels();
 		const uint8_t* _colormap = args.Colormap(args.Viewport());
 		uint32_t _xfrac = args.TextureUPos();
@@ -2080,6 +2100,15 @@ namespace swrenderer
 
 	void SWPalDrawers::DrawSpanTranslucent(const SpanDrawerArgs& args)
 	{
+#ifndef NO_SSE
+		// The scalar RGB32k blend is as fast as the gathers when every pixel is drawn
+		if (args.dc_num_lights == 0 && r_blendmethod && R_UseAVX2Drawers())
+		{
+			PalAVX2::DrawSpan<PalAVX2::SpanBlend::Translucent, false>(args);
+			return;
+		}
+#endif
+
 		const uint8_t* _source = args.TexturePixels();
 		const uint8_t* _colormap = args.Colormap(args.Viewport());
 		uint32_t _xfrac = args.TextureUPos();
@@ -2215,6 +2244,14 @@ namespace swrenderer
 
 	void SWPalDrawers::DrawSpanMaskedTranslucent(const SpanDrawerArgs& args)
 	{
+#ifndef NO_SSE
+		if (args.dc_num_lights == 0 && R_UseAVX2Drawers())
+		{
+			PalAVX2::DrawSpan<PalAVX2::SpanBlend::Translucent, true>(args);
+			return;
+		}
+#endif
+
 		const uint8_t* _source = args.TexturePixels();
 		const uint8_t* _colormap = args.Colormap(args.Viewport());
 		uint32_t _xfrac = args.TextureUPos();
@@ -2376,6 +2413,15 @@ namespace swrenderer
 
 	void SWPalDrawers::DrawSpanAddClamp(const SpanDrawerArgs& args)
 	{
+#ifndef NO_SSE
+		// The scalar RGB32k blend is as fast as the gathers when every pixel is drawn
+		if (args.dc_num_lights == 0 && r_blendmethod && R_UseAVX2Drawers())
+		{
+			PalAVX2::DrawSpan<PalAVX2::SpanBlend::AddClamp, false>(args);
+			return;
+		}
+#endif
+
 		const uint8_t* _source = args.TexturePixels();
 		const uint8_t* _colormap = args.Colormap(args.Viewport());
 		uint32_t _xfrac = args.TextureUPos();
@@ -2518,6 +2564,14 @@ namespace swrenderer
 
 	void SWPalDrawers::DrawSpanMaskedAddClamp(const SpanDrawerArgs& args)
 	{
+#ifndef NO_SSE
+		if (args.dc_num_lights == 0 && R_UseAVX2Drawers())
+		{
+			PalAVX2::DrawSpan<PalAVX2::SpanBlend::AddClamp, true>(args);
+			return;
+		}
+#endif
+
 		const uint8_t* _source = args.TexturePixels();
 		const uint8_t* _colormap = args.Colormap(args.Viewport());
 		uint32_t _xfrac = args.TextureUPos();
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "r_draw_pal.h"
+#include "r_draw_rgba.h"
+#include "v_colortables.h"
+#include "swrenderer/viewport/r_spandrawer.h"
+#include "swrenderer/viewport/r_viewport.h"
+
+EXTERN_CVAR(Bool, r_blendmethod)
+
+// AVX2 versions of the paletted span drawers. Eight pixels are processed at a time: the texture
+// coordinates and blend arithmetic are vectorized and the table lookups are done with gathers,
+// so the output is identical to the scalar drawers in r_draw_pal.cpp. Dynamic lights are not
+// handled here.
+
+namespace swrenderer
+{
+	namespace PalAVX2
+	{
+		// Looks up eight bytes. Each lane reads the aligned 32-bit word containing its byte,
+		// so no read can cross into a page that the table does not touch.
+		AVX2_TARGET FORCEINLINE __m256i VECTORCALL GatherBytes(const uint8_t *table, __m256i index)
+		{
+			uintptr_t misalign = (uintptr_t)table & 3;
+			index = _mm256_add_epi32(index, _mm256_set1_epi32((int)misalign));
+			__m256i words = _mm256_i32gather_epi32((const int*)(table - misalign), _mm256_srli_epi32(index, 2), 4);
+			__m256i shift = _mm256_slli_epi32(_mm256_and_si256(index, _mm256_set1_epi32(3)), 3);
+			return _mm256_and_si256(_mm256_srlv_epi32(words, shift), _mm256_set1_epi32(0xff));
+		}
+
+		AVX2_TARGET FORCEINLINE __m256i VECTORCALL GatherWords(const uint32_t *table, __m256i index)
+		{
+			return _mm256_i32gather_epi32((const int*)table, index, 4);
+		}
+
+		// Packs the low byte of each 32-bit lane into the low eight bytes of the result
+		AVX2_TARGET FORCEINLINE __m128i VECTORCALL PackBytes(__m256i values)
+		{
+			__m256i shuffle = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+			values = _mm256_shuffle_epi8(values, shuffle);
+			return _mm_unpacklo_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+		}
+
+		AVX2_TARGET FORCEINLINE __m256i VECTORCALL Steps(uint32_t start, uint32_t step)
+		{
+			return _mm256_add_epi32(_mm256_set1_epi32(start), _mm256_mullo_epi32(_mm256_set1_epi32(step), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+		}
+
+		// fg2rgb[fg] + bg2rgb[bg] converted back to a palette index through RGB32k
+		template<bool Clamp>
+		AVX2_TARGET FORCEINLINE __m256i VECTORCALL Blend32k(__m256i fg, __m256i bg, const uint32_t *fg2rgb, const uint32_t *bg2rgb)
+		{
+			__m256i a = _mm256_add_epi32(GatherWords(fg2rgb, fg), GatherWords(bg2rgb, bg));
+			if (Clamp)
+			{
+				__m256i b = _mm256_and_si256(a, _mm256_set1_epi32(0x40100400));
+				a = _mm256_and_si256(_mm256_or_si256(a, _mm256_set1_epi32(0x01f07c1f)), _mm256_set1_epi32(0x3fffffff));
+				b = _mm256_sub_epi32(b, _mm256_srli_epi32(b, 5));
+				a = _mm256_or_si256(a, b);
+			}
+			else
+			{
+				a = _mm256_or_si256(a, _mm256_set1_epi32(0x1f07c1f));
+			}
+			return GatherBytes(RGB32k.All, _mm256_and_si256(a, _mm256_srli_epi32(a, 15)));
+		}
+
+		// (palette[fg] * srcalpha + palette[bg] * destalpha) >> 18 converted back to a palette index through RGB256k
+		AVX2_TARGET FORCEINLINE __m256i VECTORCALL Blend256k(__m256i fg, __m256i bg, __m256i srcalpha, __m256i destalpha)
+		{
+			const uint32_t *palette = (const uint32_t*)GPalette.BaseColors;
+			__m256i fgcolor = GatherWords(palette, fg);
+			__m256i bgcolor = GatherWords(palette, bg);
+			__m256i byte = _mm256_set1_epi32(0xff);
+
+			__m256i index = _mm256_setzero_si256();
+			for (int shift = 16; shift >= 0; shift -= 8)
+			{
+				__m256i f = _mm256_and_si256(_mm256_srli_epi32(fgcolor, shift), byte);
+				__m256i b = _mm256_and_si256(_mm256_srli_epi32(bgcolor, shift), byte);
+				__m256i c = _mm256_add_epi32(_mm256_mullo_epi32(f, srcalpha), _mm256_mullo_epi32(b, destalpha));
+				c = _mm256_max_epi32(_mm256_srai_epi32(c, 18), _mm256_setzero_si256());
+				index = _mm256_add_epi32(_mm256_slli_epi32(index, 6), c);
+			}
+			return GatherBytes(RGB256k.All, index);
+		}
+
+		enum class SpanBlend
+		{
+			Opaque,
+			Translucent,
+			AddClamp
+		};
+
+		template<SpanBlend Blend, bool Masked>
+		AVX2_TARGET void DrawSpan(const SpanDrawerArgs& args)
+		{
+			const uint8_t *source = args.TexturePixels();
+			const uint8_t *colormap = args.Colormap(args.Viewport());
+			uint32_t xfrac = args.TextureUPos();
+			uint32_t yfrac = args.TextureVPos();
+			uint32_t xstep = args.TextureUStep();
+			uint32_t ystep = args.TextureVStep();
+			uint32_t srcwidth = args.TextureWidth();
+			uint32_t srcheight = args.TextureHeight();
+			uint8_t *dest = args.Viewport()->GetDest(args.DestX1(), args.DestY());
+			int count = args.DestX2() - args.DestX1() + 1;
+
+			const uint32_t *fg2rgb = args.SrcBlend();
+			const uint32_t *bg2rgb = args.DestBlend();
+			__m256i srcalpha = _mm256_set1_epi32(args.SrcAlpha());
+			__m256i destalpha = _mm256_set1_epi32(args.DestAlpha());
+			bool blend256k = r_blendmethod;
+
+			bool is_64x64 = srcwidth == 64 && srcheight == 64;
+			__m256i width = _mm256_set1_epi32(srcwidth);
+			__m256i height = _mm256_set1_epi32(srcheight);
+
+			for (int offset = 0; offset < count; offset += 8)
+			{
+				int n = min(count - offset, 8);
+
+				__m256i x = Steps(xfrac, xstep);
+				__m256i y = Steps(yfrac, ystep);
+				xfrac += xstep * 8;
+				yfrac += ystep * 8;
+
+				__m256i spot;
+				if (is_64x64)
+				{
+					spot = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(x, 32 - 6 - 6), _mm256_set1_epi32(63 * 64)), _mm256_srli_epi32(y, 32 - 6));
+				}
+				else
+				{
+					x = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(x, 16), width), 16);
+					y = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(y, 16), height), 16);
+					spot = _mm256_add_epi32(_mm256_mullo_epi32(x, height), y);
+				}
+
+				__m256i texdata = GatherBytes(source, spot);
+				__m256i fg = GatherBytes(colormap, texdata);
+
+				uint64_t destbytes = 0;
+				if (Blend != SpanBlend::Opaque || Masked)
+					memcpy(&destbytes, dest + offset, n);
+				__m256i bg = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&destbytes));
+
+				__m256i out;
+				if (Blend == SpanBlend::Opaque)
+					out = fg;
+				else if (blend256k)
+					out = Blend256k(fg, bg, srcalpha, destalpha);
+				else
+					out = Blend32k<Blend == SpanBlend::AddClamp>(fg, bg, fg2rgb, bg2rgb);
+
+				if (Masked)
+					out = _mm256_blendv_epi8(out, bg, _mm256_cmpeq_epi32(texdata, _mm256_setzero_si256()));
+
+				_mm_storel_epi64((__m128i*)&destbytes, PackBytes(out));
+				memcpy(dest + offset, &destbytes, n);
+			}
+		}
+	}
+}
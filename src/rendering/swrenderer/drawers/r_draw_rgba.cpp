@@ -59,10 +59,18 @@
 #include "r_draw_sprite32_sse2.h"
 #include "r_draw_span32_sse2.h"
 #include "r_draw_sky32_sse2.h"
+#include "r_draw_span32_avx2.h"
+#include "x86.h"
 #endif
 
 #include "gi.h"
 #include "stats.h"
+#include "c_dispatch.h"
+#include "g_levellocals.h"
+#include "texturemanager.h"
+#include "swrenderer/r_renderthread.h"
+#include "swrenderer/r_swcolormaps.h"
+#include "swrenderer/textures/r_swtexture.h"
 #include <vector>
 
 ;
@@ -78,8 +86,46 @@ CVAR(Bool, r_mipmap, false, CVAR_ARCHIVE | CVAR_GLOBALCONFIG);
 // Level of detail texture bias
 CVAR(Float, r_lod_bias, -1.5, 0); // To do: add CVAR_ARCHIVE | CVAR_GLOBALCONFIG when a good default has been decided
 
+// Use the AVX2 drawers when the CPU supports them
+CVAR(Bool, r_avx2drawers, true, 0);
+
 namespace swrenderer
 {
+#ifndef NO_SSE
+	//==========================================================================
+	//
+	// The AVX2 drawers are compiled into every SSE2 build, so the CPU and
+	// the operating system (which must save the YMM registers) are checked
+	// before using them.
+	//
+	//==========================================================================
+
+	static bool CheckAVX2Support()
+	{
+		if (!CPU.bAVX2 || !CPU.bAVX || !CPU.bOSXSAVE)
+			return false;
+
+#if defined(_MSC_VER)
+		uint64_t xcr0 = _xgetbv(0);
+#else
+		uint32_t eax, edx;
+		__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		uint64_t xcr0 = ((uint64_t)edx << 32) | eax;
+#endif
+		return (xcr0 & 6) == 6;
+	}
+#endif
+
+	bool R_UseAVX2Drawers()
+	{
+#ifndef NO_SSE
+		static bool supported = CheckAVX2Support();
+		return supported && r_avx2drawers;
+#else
+		return false;
+#endif
+	}
+
 	void SWTruecolorDrawers::DrawWall(const WallDrawerArgs &args)
 	{
 		DrawWallColumns<DrawWall32Command>(args);
@@ -206,31 +252,61 @@ namespace swrenderer
 
 	void SWTruecolorDrawers::DrawSpan(const SpanDrawerArgs &args)
 	{
+#ifndef NO_SSE
+		if (R_UseAVX2Drawers())
+			DrawSpan32AVX2Command::DrawColumn(args);
+		else
+#endif
 		DrawSpan32Command::DrawColumn(args);
 	}
 	
 	void SWTruecolorDrawers::DrawSpanMasked(const SpanDrawerArgs &args)
 	{
+#ifndef NO_SSE
+		if (R_UseAVX2Drawers())
+			DrawSpanMasked32AVX2Command::DrawColumn(args);
+		else
+#endif
 		DrawSpanMasked32Command::DrawColumn(args);
 	}
 	
 	void SWTruecolorDrawers::DrawSpanTranslucent(const SpanDrawerArgs &args)
 	{
+#ifndef NO_SSE
+		if (R_UseAVX2Drawers())
+			DrawSpanTranslucent32AVX2Command::DrawColumn(args);
+		else
+#endif
 		DrawSpanTranslucent32Command::DrawColumn(args);
 	}
 	
 	void SWTruecolorDrawers::DrawSpanMaskedTranslucent(const SpanDrawerArgs &args)
 	{
+#ifndef NO_SSE
+		if (R_UseAVX2Drawers())
+			DrawSpanAddClamp32AVX2Command::DrawColumn(args);
+		else
+#endif
 		DrawSpanAddClamp32Command::DrawColumn(args);
 	}
 	
 	void SWTruecolorDrawers::DrawSpanAddClamp(const SpanDrawerArgs &args)
 	{
+#ifndef NO_SSE
+		if (R_UseAVX2Drawers())
+			DrawSpanTranslucent32AVX2Command::DrawColumn(args);
+		else
+#endif
 		DrawSpanTranslucent32Command::DrawColumn(args);
 	}
 	
 	void SWTruecolorDrawers::DrawSpanMaskedAddClamp(const SpanDrawerArgs &args)
 	{
+#ifndef NO_SSE
+		if (R_UseAVX2Drawers())
+			DrawSpanAddClamp32AVX2Command::DrawColumn(args);
+		else
+#endif
 		DrawSpanAddClamp32Command::DrawColumn(args);
 	}
 	
@@ -1171,3 +1247,156 @@ namespace swrenderer
 		DrawerT::DrawColumn(drawerargs);
 	}
 }
+
+#ifndef NO_SSE
+
+//==========================================================================
+//
+// CCMD bench_spandrawers
+//
+// Draws the floor texture of the first sector with the SSE2 and the AVX2
+// span drawers, then prints how many pixels differ between the two and
+// the fill rate of each.
+//
+//==========================================================================
+
+namespace swrenderer
+{
+	namespace
+	{
+		enum { BenchWidth = 1024, BenchHeight = 256 };
+
+		struct SpanBenchCase
+		{
+			const char *Name;
+			void (*SSE2)(const SpanDrawerArgs &);
+			void (*AVX2)(const SpanDrawerArgs &);
+			bool Masked;
+			bool Additive;
+			fixed_t Alpha;
+		};
+
+		const SpanBenchCase SpanBenchCases[] =
+		{
+			{ "opaque", &DrawSpan32Command::DrawColumn, &DrawSpan32AVX2Command::DrawColumn, false, false, OPAQUE },
+			{ "masked", &DrawSpanMasked32Command::DrawColumn, &DrawSpanMasked32AVX2Command::DrawColumn, true, false, OPAQUE },
+			{ "translucent", &DrawSpanTranslucent32Command::DrawColumn, &DrawSpanTranslucent32AVX2Command::DrawColumn, false, false, OPAQUE / 2 },
+			{ "addclamp", &DrawSpanAddClamp32Command::DrawColumn, &DrawSpanAddClamp32AVX2Command::DrawColumn, true, true, OPAQUE / 2 },
+			{ "subclamp", &DrawSpanSubClamp32Command::DrawColumn, &DrawSpanSubClamp32AVX2Command::DrawColumn, true, true, OPAQUE / 2 },
+			{ "revsubclamp", &DrawSpanRevSubClamp32Command::DrawColumn, &DrawSpanRevSubClamp32AVX2Command::DrawColumn, true, true, OPAQUE / 2 },
+		};
+
+		void FillBenchCanvas(DCanvas &canvas)
+		{
+			uint32_t *pixels = (uint32_t *)canvas.GetPixels();
+			for (int i = 0; i < canvas.GetPitch() * canvas.GetHeight(); i++)
+				pixels[i] = 0xff000000 | (i * 2654435761u >> 8);
+		}
+
+		double RunSpanBench(RenderThread *thread, FSoftwareTexture *tex, const SpanBenchCase &test, void (*drawer)(const SpanDrawerArgs &), bool linear, FDynamicColormap *colormap, int passes)
+		{
+			SpanDrawerArgs args;
+			args.SetStyle(test.Masked, test.Additive, test.Alpha, colormap);
+			args.SetLight(0.0f, 8 << FRACBITS);
+			args.SetTexture(thread, tex);
+			args.SetTextureLOD(linear ? 0.5 : -1.0);
+			args.dc_viewpos = { 0.0f, 0.0f, 0.0f };
+			args.dc_viewpos_step = { 0.0f, 0.0f, 0.0f };
+
+			FillBenchCanvas(*thread->Viewport->RenderTarget);
+
+			cycle_t timer;
+			timer.Reset();
+			timer.Clock();
+			for (int pass = 0; pass < passes; pass++)
+			{
+				for (int y = 0; y < BenchHeight; y++)
+				{
+					// Spans of varying length and start so that the partial blocks at the end get drawn too
+					int x1 = (y * 7) % 13;
+					args.SetDestY(thread->Viewport.get(), y);
+					args.SetDestX1(x1);
+					args.SetDestX2(BenchWidth - 1 - (y % 11));
+					args.SetTextureUPos(y / 61.0);
+					args.SetTextureVPos(y / 37.0);
+					args.SetTextureUStep(1.0 / (48.0 + y % 32));
+					args.SetTextureVStep(1.0 / (160.0 + y));
+					drawer(args);
+				}
+			}
+			timer.Unclock();
+			return timer.TimeMS();
+		}
+	}
+}
+
+CCMD(bench_spandrawers)
+{
+	using namespace swrenderer;
+
+	if (!CheckAVX2Support())
+	{
+		Printf("This CPU does not support AVX2\n");
+		return;
+	}
+	if (primaryLevel == nullptr || primaryLevel->sectors.Size() == 0)
+	{
+		Printf("A level must be loaded\n");
+		return;
+	}
+
+	int passes = argv.argc() > 1 ? max(atoi(argv[1]), 1) : 20;
+
+	auto gametex = TexMan.GetGameTexture(primaryLevel->sectors[0].GetTexture(sector_t::floor), true);
+	if (gametex == nullptr || !gametex->isValid())
+	{
+		Printf("The first sector has no floor texture\n");
+		return;
+	}
+	FSoftwareTexture *tex = GetSoftwareTexture(gametex);
+
+	RenderThread thread(nullptr);
+	DCanvas canvas(BenchWidth, BenchHeight, true);
+	thread.Viewport->RenderTarget = &canvas;
+	int savedx = viewwindowx, savedy = viewwindowy;
+	viewwindowx = viewwindowy = 0;
+
+	TArray<uint32_t> reference;
+	FDynamicColormap *tinted = GetSpecialLights(PalEntry(255, 255, 224, 160), PalEntry(0, 32, 16, 48), 128);
+	const double mpixels = double(BenchWidth) * BenchHeight * passes / 1000000.0;
+
+	Printf("%-12s %-7s %-8s %10s %10s %8s\n", "blend", "filter", "shade", "SSE2 MP/s", "AVX2 MP/s", "diff");
+	for (const auto &test : SpanBenchCases)
+	{
+		for (int linear = 0; linear < 2; linear++)
+		{
+			for (int advanced = 0; advanced < 2; advanced++)
+			{
+				FDynamicColormap *colormap = advanced ? tinted : &NormalLight;
+
+				double sse2time = RunSpanBench(&thread, tex, test, test.SSE2, linear, colormap, passes);
+				RunSpanBench(&thread, tex, test, test.SSE2, linear, colormap, 1);
+				reference.Resize(canvas.GetPitch() * BenchHeight);
+				memcpy(reference.Data(), canvas.GetPixels(), reference.Size() * sizeof(uint32_t));
+
+				double avx2time = RunSpanBench(&thread, tex, test, test.AVX2, linear, colormap, passes);
+				RunSpanBench(&thread, tex, test, test.AVX2, linear, colormap, 1);
+				const uint32_t *pixels = (const uint32_t *)canvas.GetPixels();
+				unsigned diff = 0;
+				for (unsigned i = 0; i < reference.Size(); i++)
+				{
+					if (pixels[i] != reference[i]) diff++;
+				}
+
+				Printf("%-12s %-7s %-8s %10.1f %10.1f %s%8u\n", test.Name, linear ? "linear" : "nearest", advanced ? "advanced" : "simple",
+					mpixels * 1000.0 / max(sse2time, 0.001), mpixels * 1000.0 / max(avx2time, 0.001), diff ? TEXTCOLOR_RED : "", diff);
+			}
+		}
+	}
+
+	viewwindowx = savedx;
+	viewwindowy = savedy;
+	thread.Viewport->RenderTarget = nullptr;
+}
+
+#endif
@@ -71,6 +71,13 @@ namespace swrenderer
 	#define VECTORCALL
 	#endif
 
+	// Allow AVX2 instructions in a function without requiring them for the whole program
+	#if defined(_MSC_VER) && !defined(__clang__)
+	#define AVX2_TARGET
+	#else
+	#define AVX2_TARGET __attribute__((target("avx2")))
+	#endif
+
 	template<typename CommandType, typename BlendMode>
 	class DrawerBlendCommand : public CommandType
 	{
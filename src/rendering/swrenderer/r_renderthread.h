@@ -24,6 +24,7 @@
 
 #include <memory>
 #include <thread>
+#include "stats.h"
 
 class RenderMemory;
 struct FDynamicLight;
@@ -78,6 +79,12 @@ namespace swrenderer
 
 		std::thread thread;
 
+		// Time spent rendering the last slice
+		cycle_t SliceCycles;
+
+		// Time spent in each pass of the last slice. The drawers run inline, so these include the drawing.
+		cycle_t OpaquePassCycles, PlanePassCycles, PortalPassCycles, TranslucentPassCycles;
+
 		// VisibleSprite working buffers
 		short clipbot[MAXWIDTH];
 		short cliptop[MAXWIDTH];
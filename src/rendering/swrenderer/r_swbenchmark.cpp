@@ -0,0 +1,266 @@
+/*
+** r_swbenchmark.cpp
+** Software renderer benchmark
+**
+**---------------------------------------------------------------------------
+**
+** This program is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** This program is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/
+**
+**---------------------------------------------------------------------------
+**
+** Renders the current level from a list of fixed viewpoints into a memory
+** canvas, the same way savegame pictures are made, so nothing is presented
+** and no GPU work is involved. For each viewpoint the time spent in every
+** pass of the scene is printed together with a CRC of the final image,
+** which makes it usable both for performance and for regression tests.
+**
+** Usage: swbench [frames] [viewpoint file]
+**
+** The viewpoint file contains one "x y z yaw pitch" entry per view, with
+** z being the eye height. Without a file the level's player starts are
+** used. To run it from the command line:
+**
+**   +map MAP01 +wait 1 +swbench 100 +quit
+**
+*/
+
+#include "c_dispatch.h"
+#include "gamestate.h"
+#include "doomstat.h"
+#include "v_text.h"
+#include "sc_man.h"
+#include "m_crc32.h"
+#include "printf.h"
+#include "d_main.h"
+#include "g_levellocals.h"
+#include "actorinlines.h"
+#include "r_utility.h"
+#include "r_swrenderer.h"
+#include "swrenderer/scene/r_scene.h"
+#include "swrenderer/r_renderthread.h"
+#include "swrenderer/viewport/r_viewport.h"
+
+namespace
+{
+	struct FBenchViewpoint
+	{
+		DVector3 Pos;
+		double Yaw, Pitch;
+	};
+
+	struct FBenchTimes
+	{
+		double Frame = 0, Opaque = 0, Planes = 0, Portals = 0, Translucent = 0;
+		double OpaqueMax = 0, PlanesMax = 0, PortalsMax = 0, TranslucentMax = 0;
+
+		void Add(const FBenchTimes &other)
+		{
+			Frame += other.Frame;
+			Opaque += other.Opaque;
+			Planes += other.Planes;
+			Portals += other.Portals;
+			Translucent += other.Translucent;
+			OpaqueMax += other.OpaqueMax;
+			PlanesMax += other.PlanesMax;
+			PortalsMax += other.PortalsMax;
+			TranslucentMax += other.TranslucentMax;
+		}
+
+		void Print(const char *name, int frames, const char *crc) const
+		{
+			double f = 1. / frames;
+			Printf("%-8s %8.3f  %8.3f %8.3f  %8.3f %8.3f  %8.3f %8.3f  %8.3f %8.3f  %s\n", name, Frame * f,
+				OpaqueMax * f, Opaque * f, PlanesMax * f, Planes * f, PortalsMax * f, Portals * f, TranslucentMax * f, Translucent * f, crc);
+		}
+	};
+}
+
+//==========================================================================
+//
+// Viewpoints
+//
+//==========================================================================
+
+static bool ReadViewpoints(const char *filename, TArray<FBenchViewpoint> &views)
+{
+	FScanner sc;
+	if (!sc.OpenFile(filename))
+	{
+		Printf("Unable to read %s\n", filename);
+		return false;
+	}
+
+	while (sc.GetFloat())
+	{
+		FBenchViewpoint view;
+		view.Pos.X = sc.Float;
+		sc.MustGetFloat();
+		view.Pos.Y = sc.Float;
+		sc.MustGetFloat();
+		view.Pos.Z = sc.Float;
+		sc.MustGetFloat();
+		view.Yaw = sc.Float;
+		sc.MustGetFloat();
+		view.Pitch = sc.Float;
+		views.Push(view);
+	}
+	return true;
+}
+
+static void GetStartViewpoints(FLevelLocals *Level, TArray<FBenchViewpoint> &views)
+{
+	for (auto &start : Level->AllPlayerStarts)
+	{
+		FBenchViewpoint view;
+		auto sector = Level->PointInSector(start.pos.XY());
+		view.Pos = { start.pos.XY(), sector->floorplane.ZatPoint(start.pos) + start.pos.Z + 41 };
+		view.Yaw = start.angle;
+		view.Pitch = 0;
+		views.Push(view);
+	}
+}
+
+//==========================================================================
+//
+// RenderBenchFrame
+//
+//==========================================================================
+
+static FBenchTimes RenderBenchFrame(swrenderer::RenderScene &scene, AActor *camera, DCanvas *canvas)
+{
+	FBenchTimes times;
+	cycle_t frame;
+
+	// Same setup as for savegame pictures
+	scene.MainThread()->Viewport->viewpoint = r_viewpoint;
+	scene.MainThread()->Viewport->viewwindow = r_viewwindow;
+	frame.ResetAndClock();
+	scene.RenderViewToCanvas(camera, canvas, 0, 0, canvas->GetWidth(), canvas->GetHeight());
+	frame.Unclock();
+	r_viewpoint = scene.MainThread()->Viewport->viewpoint;
+	r_viewwindow = scene.MainThread()->Viewport->viewwindow;
+
+	// The sums are the CPU time spent in each pass, the maximums the time the slowest thread held up the frame.
+	times.Frame = frame.TimeMS();
+	for (size_t i = 0; i < scene.NumThreads(); i++)
+	{
+		auto thread = scene.Thread(i);
+		double opaque = thread->OpaquePassCycles.TimeMS();
+		double planes = thread->PlanePassCycles.TimeMS();
+		double portals = thread->PortalPassCycles.TimeMS();
+		double translucent = thread->TranslucentPassCycles.TimeMS();
+		times.Opaque += opaque;
+		times.Planes += planes;
+		times.Portals += portals;
+		times.Translucent += translucent;
+		times.OpaqueMax = max(times.OpaqueMax, opaque);
+		times.PlanesMax = max(times.PlanesMax, planes);
+		times.PortalsMax = max(times.PortalsMax, portals);
+		times.TranslucentMax = max(times.TranslucentMax, translucent);
+	}
+	return times;
+}
+
+static uint32_t CanvasCRC(DCanvas *canvas)
+{
+	int pixelsize = canvas->IsBgra() ? 4 : 1;
+	const uint8_t *line = canvas->GetPixels();
+	uint32_t crc = 0;
+	for (int y = 0; y < canvas->GetHeight(); y++)
+	{
+		crc = AddCRC32(crc, line, canvas->GetWidth() * pixelsize);
+		line += canvas->GetPitch() * pixelsize;
+	}
+	return crc;
+}
+
+//==========================================================================
+//
+// CCMD swbench
+//
+//==========================================================================
+
+CCMD(swbench)
+{
+	if (gamestate != GS_LEVEL || primaryLevel == nullptr || SWRenderer == nullptr)
+	{
+		Printf("swbench can only be used in a level\n");
+		return;
+	}
+	// The camera is spawned into the playsim, which other nodes and demos know nothing about.
+	if (netgame || demorecording || demoplayback)
+	{
+		Printf("swbench cannot be used in netgames or while a demo is recorded or played\n");
+		return;
+	}
+
+	int frames = argv.argc() >= 2 ? max(atoi(argv[1]), 1) : 10;
+
+	TArray<FBenchViewpoint> views;
+	if (argv.argc() >= 3)
+	{
+		if (!ReadViewpoints(argv[2], views)) return;
+	}
+	else
+	{
+		GetStartViewpoints(primaryLevel, views);
+	}
+	if (views.Size() == 0)
+	{
+		Printf("No viewpoints to render\n");
+		return;
+	}
+
+	auto &scene = static_cast<FSoftwareRenderer *>(SWRenderer)->Scene();
+	DCanvas canvas(SCREENWIDTH, SCREENHEIGHT, V_IsTrueColor());
+
+	// The camera is a plain map spot, so that the view is not affected by player bobbing and interpolation.
+	AActor *camera = Spawn(primaryLevel, NAME_MapSpot);
+	camera->CameraHeight = 0;
+	bool savedNoInterpolate = r_NoInterpolate;
+	r_NoInterpolate = true;
+
+	Printf("Rendering %u viewpoints at %dx%d, %s, %d frames each\n", views.Size(), canvas.GetWidth(), canvas.GetHeight(),
+		canvas.IsBgra() ? "truecolor" : "paletted", frames);
+	Printf(TEXTCOLOR_YELLOW "Times in ms per frame, each pass as slowest thread / sum of all threads\n");
+	Printf(TEXTCOLOR_YELLOW "View        Frame    Opaque             Planes             Portals            Translucent        CRC\n");
+
+	FBenchTimes total;
+	for (unsigned i = 0; i < views.Size(); i++)
+	{
+		camera->SetXYZ(views[i].Pos);
+		camera->Angles.Yaw = DAngle::fromDeg(views[i].Yaw);
+		camera->Angles.Pitch = DAngle::fromDeg(views[i].Pitch);
+		camera->ClearInterpolation();
+
+		// The first frame is not counted, it makes sure all textures used by the view are loaded.
+		RenderBenchFrame(scene, camera, &canvas);
+
+		FBenchTimes times;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			times.Add(RenderBenchFrame(scene, camera, &canvas));
+		}
+		total.Add(times);
+
+		FString name, crc;
+		name.Format("%u", i);
+		crc.Format("%08x", CanvasCRC(&canvas));
+		times.Print(name.GetChars(), frames, crc.GetChars());
+	}
+	total.Print("Average", frames * views.Size(), "");
+
+	r_NoInterpolate = savedNoInterpolate;
+	camera->Destroy();
+}
@@ -26,6 +26,8 @@ struct FSoftwareRenderer : public FRenderer
 	void SetColormap(FLevelLocals *Level) override;
 	void Init() override;
 
+	swrenderer::RenderScene &Scene() { return mScene; }
+
 private:
 	void PreparePrecache(FGameTexture *tex, int cache);
 	void PrecacheTexture(FGameTexture *tex, int cache);
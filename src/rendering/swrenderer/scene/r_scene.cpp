@@ -63,11 +63,15 @@ EXTERN_CVAR(Int, r_clearbuffer)
 EXTERN_CVAR(Int, r_debug_draw)
 
 CVAR(Int, r_scene_multithreaded, 1, 0);
+CVAR(Bool, r_scene_balance, true, 0);
 CVAR(Bool, r_models, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG);
 
 namespace swrenderer
 {
 	cycle_t WallCycles, PlaneCycles, MaskedCycles;
+
+	static std::vector<int> StatSliceWidths;
+	static std::vector<double> StatSliceTimes;
 	
 	RenderScene::RenderScene()
 	{
@@ -186,14 +190,26 @@ namespace swrenderer
 			StartThreads(numThreads);
 		}
 
+		// Camera textures are rendered in between and must not disturb the balance of the main view
+		bool mainview = !MainThread()->Viewport->RenderingToCanvas;
+		bool balance = r_scene_balance && numThreads > 1;
+		if (mainview)
+		{
+			if (balance)
+				BalanceSlices(numThreads);
+			else
+				SliceBounds.clear();
+		}
+		balance = balance && mainview;
+
 		// Setup threads:
 		std::unique_lock<std::mutex> start_lock(start_mutex);
 		for (int i = 0; i < numThreads; i++)
 		{
 			*Threads[i]->Viewport = *MainThread()->Viewport;
 			*Threads[i]->Light = *MainThread()->Light;
-			Threads[i]->X1 = viewwidth * i / numThreads;
-			Threads[i]->X2 = viewwidth * (i + 1) / numThreads;
+			Threads[i]->X1 = balance ? SliceBounds[i] : viewwidth * i / numThreads;
+			Threads[i]->X2 = balance ? SliceBounds[i + 1] : viewwidth * (i + 1) / numThreads;
 		}
 		run_id++;
 		FSoftwareTexture::CurrentUpdate = run_id;
@@ -221,13 +237,69 @@ namespace swrenderer
 			finished_threads = 0;
 		}
 
+		if (mainview)
+		{
+			SliceTimes.resize(numThreads);
+			StatSliceWidths.resize(numThreads);
+			StatSliceTimes.resize(numThreads);
+			for (int i = 0; i < numThreads; i++)
+			{
+				SliceTimes[i] = Threads[i]->SliceCycles.TimeMS();
+				StatSliceWidths[i] = Threads[i]->X2 - Threads[i]->X1;
+				StatSliceTimes[i] = SliceTimes[i];
+			}
+		}
+
 		// Change main thread back to covering the whole screen for player sprites
 		MainThread()->X1 = 0;
 		MainThread()->X2 = viewwidth;
 	}
 
+	void RenderScene::BalanceSlices(int numThreads)
+	{
+		int minwidth = max(viewwidth / (numThreads * 8), 1);
+
+		// Start over with equal slices if the view or the number of threads changed
+		if (SliceBounds.size() != (size_t)numThreads + 1 || SliceBounds.back() != viewwidth || SliceTimes.size() != (size_t)numThreads || viewwidth < numThreads * minwidth)
+		{
+			SliceBounds.resize(numThreads + 1);
+			for (int i = 0; i <= numThreads; i++)
+				SliceBounds[i] = viewwidth * i / numThreads;
+			SliceTimes.assign(numThreads, 0.0);
+			return;
+		}
+
+		double total = 0.0;
+		for (double time : SliceTimes)
+			total += time;
+		if (total <= 0.0)
+			return;
+
+		// Assume the time of each slice was spread evenly over its columns and move each boundary
+		// halfway towards where every thread gets the same share. Going all the way makes the
+		// slices oscillate from frame to frame.
+		std::vector<int> bounds = SliceBounds;
+		int slice = 0;
+		double slicestart = 0.0;
+		for (int i = 1; i < numThreads; i++)
+		{
+			double target = total * i / numThreads;
+			while (slice < numThreads - 1 && slicestart + SliceTimes[slice] < target)
+			{
+				slicestart += SliceTimes[slice];
+				slice++;
+			}
+
+			double fraction = SliceTimes[slice] > 0.0 ? clamp((target - slicestart) / SliceTimes[slice], 0.0, 1.0) : 0.5;
+			double x = bounds[slice] + (bounds[slice + 1] - bounds[slice]) * fraction;
+			int newx = xs_RoundToInt((bounds[i] + x) * 0.5);
+			SliceBounds[i] = clamp(newx, SliceBounds[i - 1] + minwidth, viewwidth - (numThreads - i) * minwidth);
+		}
+	}
+
 	void RenderScene::RenderThreadSlice(RenderThread *thread)
 	{
+		thread->SliceCycles.ResetAndClock();
 		thread->FrameMemory->Clear();
 		thread->Clip3D->Cleanup();
 		thread->Clip3D->ResetClip(); // reset clips (floor/ceiling)
@@ -247,17 +319,30 @@ namespace swrenderer
 		if (thread->X2 < viewwidth)
 			thread->ClipSegments->Clip(thread->X2, viewwidth, true, &visitor);
 
+		thread->OpaquePassCycles.Reset();
+		thread->PlanePassCycles.Reset();
+		thread->PortalPassCycles.Reset();
+		thread->TranslucentPassCycles.Reset();
+
+		thread->OpaquePassCycles.Clock();
 		thread->OpaquePass->RenderScene(thread->Viewport->Level());
 		thread->Clip3D->ResetClip(); // reset clips (floor/ceiling)
+		thread->OpaquePassCycles.Unclock();
 
 		if (viewactive)
 		{
+			thread->PlanePassCycles.Clock();
 			thread->PlaneList->Render();
+			thread->PlanePassCycles.Unclock();
 
+			thread->PortalPassCycles.Clock();
 			thread->Portal->RenderPlanePortals();
 			thread->Portal->RenderLinePortals();
+			thread->PortalPassCycles.Unclock();
 
+			thread->TranslucentPassCycles.Clock();
 			thread->TranslucentPass->Render();
+			thread->TranslucentPassCycles.Unclock();
 		}
 
 #if 0 // shows the render slice edges
@@ -291,6 +376,8 @@ namespace swrenderer
 			}
 		}
 #endif
+
+		thread->SliceCycles.Unclock();
 	}
 
 	void RenderScene::StartThreads(size_t numThreads)
@@ -396,6 +483,18 @@ namespace swrenderer
 		return out;
 	}
 
+	ADD_STAT(swthreads)
+	{
+		FString out;
+		for (size_t i = 0; i < StatSliceTimes.size(); i++)
+		{
+			if (i > 0)
+				out += (i % 4 == 0) ? "\n" : "    ";
+			out.AppendFormat("thread %d: %4d columns %04.1f ms", (int)i, StatSliceWidths[i], StatSliceTimes[i]);
+		}
+		return out;
+	}
+
 	static double f_acc, w_acc, p_acc, m_acc;
 	static int acc_c;
 
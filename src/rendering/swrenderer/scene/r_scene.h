@@ -54,11 +54,14 @@ namespace swrenderer
 		bool DontMapLines() const { return dontmaplines; }
 
 		RenderThread *MainThread() { return Threads.front().get(); }
+		RenderThread *Thread(size_t index) { return Threads[index].get(); }
+		size_t NumThreads() const { return Threads.size(); }
 
 	private:
 		void RenderActorView(AActor *actor,bool renderplayersprite, bool dontmaplines);
 		void RenderThreadSlices();
 		void RenderThreadSlice(RenderThread *thread);
+		void BalanceSlices(int numThreads);
 		void RenderPSprites();
 
 		void StartThreads(size_t numThreads);
@@ -75,5 +78,9 @@ namespace swrenderer
 		std::mutex end_mutex;
 		std::condition_variable end_condition;
 		size_t finished_threads = 0;
+
+		// Slice boundaries and render times of the last frame, used to even out the work between the threads
+		std::vector<int> SliceBounds;
+		std::vector<double> SliceTimes;
 	};
 }
@@ -973,6 +973,106 @@ DEFINE_ACTION_FUNCTION_NATIVE(DObject, BuiltinNewDoom, BuiltinNewDoom)
 }
 
 
+//==========================================================================
+//
+// Script code cache support
+//
+// States are referenced by their owning class and index. The code
+// generator adds to the state label storage and the resulting label
+// values end up in the code, so these additions get recorded and are
+// replayed when the code is restored from the cache.
+//
+//==========================================================================
+
+static unsigned CacheLabelStart;
+
+static bool CacheEncodeAddress(void *ptr, FString &key)
+{
+	auto state = (FState *)ptr;
+	for (auto cls : PClassActor::AllActorClasses)
+	{
+		if (cls->OwnsState(state))
+		{
+			key.Format("%s:%d", cls->TypeName.GetChars(), int(state - cls->GetStates()));
+			return true;
+		}
+	}
+	return false;
+}
+
+static void *CacheDecodeAddress(const FString &key)
+{
+	auto colon = key.LastIndexOf(':');
+	if (colon < 0) return nullptr;
+	auto cls = PClass::FindActor(key.Left(colon));
+	unsigned index = (unsigned)strtoul(key.GetChars() + colon + 1, nullptr, 10);
+	if (cls == nullptr || index >= cls->GetStateCount()) return nullptr;
+	return cls->GetStates() + index;
+}
+
+static void CacheBeginBuild(FString &fingerprint)
+{
+	CacheLabelStart = StateLabels.Storage.Size();
+	fingerprint.Format("%u", CacheLabelStart);
+}
+
+static bool CacheGetBuildRecords(TArray<FString> &records)
+{
+	auto &storage = StateLabels.Storage;
+	for (unsigned pos = CacheLabelStart; pos + sizeof(int) <= storage.Size(); )
+	{
+		int count;
+		memcpy(&count, &storage[pos], sizeof(int));
+		pos += sizeof(int);
+		FString &record = records[records.Reserve(1)];
+		if (count == 0)
+		{
+			FState *state;
+			FString key;
+			memcpy(&state, &storage[pos], sizeof(state));
+			pos += sizeof(state);
+			if (!CacheEncodeAddress(state, key)) return false;
+			record.Format("P%s", key.GetChars());
+		}
+		else
+		{
+			record = "N";
+			for (int i = 0; i < count; i++)
+			{
+				FName name;
+				memcpy(&name, &storage[pos], sizeof(FName));
+				pos += sizeof(FName);
+				if (i > 0) record << '\n';
+				record << name.GetChars();
+			}
+		}
+	}
+	return true;
+}
+
+static bool CacheReplayBuildRecords(const TArray<FString> &records)
+{
+	for (auto &record : records)
+	{
+		if (record[0] == 'P')
+		{
+			auto state = (FState *)CacheDecodeAddress(record.Mid(1));
+			if (state == nullptr) return false;
+			StateLabels.AddPointer(state);
+		}
+		else if (record[0] == 'N')
+		{
+			TArray<FName> names;
+			for (auto &part : record.Mid(1).Split("\n")) names.Push(part);
+			if (names.Size() < 2) return false;
+			StateLabels.AddNames(names);
+		}
+		else return false;
+	}
+	return true;
+}
+
+
 void SetDoomCompileEnvironment()
 {
 	compileEnvironment.SpecialTypeCast = CustomTypeCast;
@@ -984,6 +1084,11 @@ void SetDoomCompileEnvironment()
 	compileEnvironment.ResolveSpecialFunction = AJumpProcessing;
 	compileEnvironment.CheckCustomGlobalFunctions = ResolveGlobalCustomFunction;
 	compileEnvironment.CustomBuiltinNew = "BuiltinNewDoom";
+	compileEnvironment.CacheEncodeAddress = CacheEncodeAddress;
+	compileEnvironment.CacheDecodeAddress = CacheDecodeAddress;
+	compileEnvironment.CacheBeginBuild = CacheBeginBuild;
+	compileEnvironment.CacheGetBuildRecords = CacheGetBuildRecords;
+	compileEnvironment.CacheReplayBuildRecords = CacheReplayBuildRecords;
 }
 
 
@@ -49,6 +49,7 @@
 #include "v_text.h"
 #include "m_argv.h"
 #include "v_video.h"
+#include "vmcache.h"
 
 void ParseOldDecoration(FScanner &sc, EDefinitionType def, PNamespace *ns);
 EXTERN_CVAR(Bool, strictdecorate);
@@ -1266,6 +1267,8 @@ static void ParseDamageDefinition(FScanner &sc)
 
 void ParseDecorate (FScanner &sc, PNamespace *ns)
 {
+	VMCache::NoteSourceLump(sc.LumpNum);
+
 	// Get actor class name.
 	for(;;)
 	{
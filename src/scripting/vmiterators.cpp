@@ -179,6 +179,8 @@ public:
 	DBlockThingsIterator(AActor *origin, double checkradius = -1, bool ignorerestricted = false)
 		: iterator(check, origin, checkradius, ignorerestricted)
 	{
+		// This can live until the next GC sweep, so it must not keep blocks from being compacted.
+		iterator.Detach();
 		cres.thing = nullptr;
 		cres.Position.Zero();
 		cres.portalflags = 0;
@@ -187,6 +189,7 @@ public:
 	DBlockThingsIterator(double checkx, double checky, double checkz, double checkh, double checkradius, bool ignorerestricted, sector_t *newsec)
 		: iterator(check, currentVMLevel, checkx, checky, checkz, checkh, checkradius, ignorerestricted, newsec)
 	{
+		iterator.Detach();
 		cres.thing = nullptr;
 		cres.Position.Zero();
 		cres.portalflags = 0;
@@ -41,8 +41,15 @@
 #include <string.h>
 #include <math.h>
 
+#include <atomic>
+#include <thread>
+
 #include "doomdata.h"
 #include "nodebuild.h"
+#include "c_cvars.h"
+#include "ctpl.h"
+
+CVAR(Int, nodebuild_threads, 0, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
 
 const int MaxSegs = 64;
 const int SplitCost = 8;
@@ -444,6 +451,7 @@ int FNodeBuilder::SelectSplitter (uint32_t set, node_t &node, uint32_t &splitseg
 	int bestvalue;
 	uint32_t bestseg;
 	uint32_t seg;
+	unsigned int count;
 	bool nosplitters = false;
 
 	bestvalue = 0;
@@ -451,8 +459,10 @@ int FNodeBuilder::SelectSplitter (uint32_t set, node_t &node, uint32_t &splitseg
 
 	seg = set;
 	stepleft = 0;
+	count = 0;
 
 	memset (&PlaneChecked[0], 0, PlaneChecked.Size());
+	SplitterCandidates.Clear();
 
 	D(Printf (PRINT_LOG, "Processing set %d\n", set));
 
@@ -473,28 +483,36 @@ int FNodeBuilder::SelectSplitter (uint32_t set, node_t &node, uint32_t &splitseg
 				}
 
 				stepleft = step;
-				SetNodeFromSeg (node, pseg);
-
-				int value = Heuristic (node, set, nosplit);
-
-				D(Printf (PRINT_LOG, "Seg %5d, ld %d (%5d,%5d)-(%5d,%5d) scores %d\n", seg, Segs[seg].linedef, node.x>>16, node.y>>16,
-					(node.x+node.dx)>>16, (node.y+node.dy)>>16, value));
-
-				if (value > bestvalue)
-				{
-					bestvalue = value;
-					bestseg = seg;
-				}
-				else if (value < 0)
-				{
-					nosplitters = true;
-				}
+				SplitterCandidates.Push(seg);
 			}
 		}
 
+		count++;
 		seg = pseg->next;
 	}
 
+	ScoreSplitters (set, count, nosplit);
+
+	// The candidates are looked at in the same order as they were found so
+	// the choice does not depend on how they were scored.
+	for (unsigned int i = 0; i < SplitterCandidates.Size(); ++i)
+	{
+		int value = SplitterScores[i];
+		seg = SplitterCandidates[i];
+
+		D(Printf (PRINT_LOG, "Seg %5d, ld %d scores %d\n", seg, Segs[seg].linedef, value));
+
+		if (value > bestvalue)
+		{
+			bestvalue = value;
+			bestseg = seg;
+		}
+		else if (value < 0)
+		{
+			nosplitters = true;
+		}
+	}
+
 	if (bestseg == UINT_MAX)
 	{
 		// No lines split any others into two sets, so this is a convex region.
@@ -509,6 +527,64 @@ int FNodeBuilder::SelectSplitter (uint32_t set, node_t &node, uint32_t &splitseg
 	return 1;
 }
 
+// Runs Heuristic for every candidate in SplitterCandidates. Each score only
+// depends on the seg set, so for large sets they are computed on all cores.
+void FNodeBuilder::ScoreSplitters (uint32_t set, unsigned int count, bool nosplit)
+{
+	const unsigned int numcandidates = SplitterCandidates.Size();
+	SplitterScores.Resize(numcandidates);
+
+	int numthreads = nodebuild_threads > 0 ? *nodebuild_threads : int(std::thread::hardware_concurrency());
+	numthreads = clamp<int>(numthreads, 1, 64);
+
+	// Not worth waking up the workers for the small sets near the bottom of the tree.
+	if (numthreads == 1 || numcandidates < 16 || (uint64_t)numcandidates * count < 65536)
+	{
+		for (unsigned int i = 0; i < numcandidates; ++i)
+		{
+			node_t node;
+			SetNodeFromSeg (node, &Segs[SplitterCandidates[i]]);
+			SplitterScores[i] = Heuristic (node, set, nosplit);
+		}
+		return;
+	}
+
+	// Destroyed at exit, which stops and joins the worker threads.
+	static ctpl::thread_pool SplitterPool;
+	if (SplitterPool.size() != numthreads - 1)
+	{
+		SplitterPool.resize(numthreads - 1);
+	}
+
+	std::atomic<unsigned int> next{ 0 };
+	auto worker = [&](int)
+	{
+		TArray<int> touched, colinear;
+		const unsigned int batch = 4;
+		for (unsigned int first; (first = next.fetch_add(batch)) < numcandidates;)
+		{
+			const unsigned int last = min(first + batch, numcandidates);
+			for (unsigned int i = first; i < last; ++i)
+			{
+				node_t node;
+				SetNodeFromSeg (node, &Segs[SplitterCandidates[i]]);
+				SplitterScores[i] = Heuristic (node, set, nosplit, touched, colinear);
+			}
+		}
+	};
+
+	TArray<std::future<void>> futures;
+	for (int i = 0; i < numthreads - 1; i++)
+	{
+		futures.Push(SplitterPool.push(worker));
+	}
+	worker(0);
+	for (auto &f : futures)
+	{
+		f.get();
+	}
+}
+
 // Given a splitter (node), returns a score based on how "good" the resulting
 // split in a set of segs is. Higher scores are better. -1 means this splitter
 // splits something it shouldn't and will only be returned if honorNoSplit is
@@ -516,6 +592,12 @@ int FNodeBuilder::SelectSplitter (uint32_t set, node_t &node, uint32_t &splitseg
 // in the set.
 
 int FNodeBuilder::Heuristic (node_t &node, uint32_t set, bool honorNoSplit)
+{
+	return Heuristic (node, set, honorNoSplit, Touched, Colinear);
+}
+
+// This only reads the builder's data, so it can score several splitters at once.
+int FNodeBuilder::Heuristic (node_t &node, uint32_t set, bool honorNoSplit, TArray<int> &touched, TArray<int> &colinear)
 {
 	// Set the initial score above 0 so that near vertex anti-weighting is less likely to produce a negative score.
 	int score = 1000000;
@@ -530,8 +612,8 @@ int FNodeBuilder::Heuristic (node_t &node, uint32_t set, bool honorNoSplit)
 	unsigned int max, m2, p, q;
 	double frac;
 
-	Touched.Clear ();
-	Colinear.Clear ();
+	touched.Clear ();
+	colinear.Clear ();
 
 	while (i != UINT_MAX)
 	{
@@ -557,32 +639,32 @@ int FNodeBuilder::Heuristic (node_t &node, uint32_t set, bool honorNoSplit)
 			{
 				if ((sidev[0] | sidev[1]) != 0)
 				{
-					max = Touched.Size();
+					max = touched.Size();
 					for (p = 0; p < max; ++p)
 					{
-						if (Touched[p] == test->loopnum)
+						if (touched[p] == test->loopnum)
 						{
 							break;
 						}
 					}
 					if (p == max)
 					{
-						Touched.Push (test->loopnum);
+						touched.Push (test->loopnum);
 					}
 				}
 				else
 				{
-					max = Colinear.Size();
+					max = colinear.Size();
 					for (p = 0; p < max; ++p)
 					{
-						if (Colinear[p] == test->loopnum)
+						if (colinear[p] == test->loopnum)
 						{
 							break;
 						}
 					}
 					if (p == max)
 					{
-						Colinear.Push (test->loopnum);
+						colinear.Push (test->loopnum);
 					}
 				}
 			}
@@ -699,8 +781,8 @@ int FNodeBuilder::Heuristic (node_t &node, uint32_t set, bool honorNoSplit)
 	// seg of that sector must be crossing the container's corner and does not
 	// actually split the container.
 
-	max = Touched.Size ();
-	m2 = Colinear.Size ();
+	max = touched.Size ();
+	m2 = colinear.Size ();
 
 	// If honorNoSplit is false, then both these lists will be empty.
 
@@ -713,10 +795,10 @@ int FNodeBuilder::Heuristic (node_t &node, uint32_t set, bool honorNoSplit)
 
 	for (p = 0; p < max; ++p)
 	{
-		int look = Touched[p];
+		int look = touched[p];
 		for (q = 0; q < m2; ++q)
 		{
-			if (look == Colinear[q])
+			if (look == colinear[q])
 			{
 				break;
 			}
@@ -267,6 +267,8 @@ private:
 
 	TArray<int> Touched;	// Loops a splitter touches on a vertex
 	TArray<int> Colinear;	// Loops with edges colinear to a splitter
+	TArray<uint32_t> SplitterCandidates;	// One seg for each plane considered by SelectSplitter
+	TArray<int> SplitterScores;
 	FEventTree Events;		// Vertices intersected by the current splitter
 
 	TArray<uint32_t> UnsetSegs;			// Segs with no definitive side in current splitter
@@ -300,7 +302,9 @@ private:
 	void DoGLSegSplit (uint32_t set, node_t &node, uint32_t splitseg, uint32_t &outset0, uint32_t &outset1, int side, int sidev0, int sidev1, bool hack);
 	void SplitSegs (uint32_t set, node_t &node, uint32_t splitseg, uint32_t &outset0, uint32_t &outset1, unsigned int &count0, unsigned int &count1);
 	uint32_t SplitSeg (uint32_t segnum, int splitvert, int v1InFront);
+	void ScoreSplitters (uint32_t set, unsigned int count, bool nosplit);
 	int Heuristic (node_t &node, uint32_t set, bool honorNoSplit);
+	int Heuristic (node_t &node, uint32_t set, bool honorNoSplit, TArray<int> &touched, TArray<int> &colinear);
 
 	// Returns:
 	//	0 = seg is in front